@@ -8,7 +8,7 @@ local content = {}
 table.insert(content, {
 	["Type"] = "IntroHeader";
 	["Name"] = "The Light3 instance";
-	["Description"] = "A Light3 is a point light that can be added to a Scene3 to light up specific areas. Light3 objects do not cast any shadows and will light up geometry through walls.\n\nNote: when changing a light property, it won't update on screen unless Scene3.LightsDirty is set to true or the light is re-attached.";
+	["Description"] = "A Light3 is a point light that can be added to a Scene3 to light up specific areas. Light3 objects do not cast any shadows and will light up geometry through walls.\n\nLights are sorted into clusters every frame, so each pixel is only lit by the lights whose range reaches it. A scene can hold up to 1024 lights in view at once.";
 })
 
 table.insert(content, {
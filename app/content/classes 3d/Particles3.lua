@@ -25,6 +25,14 @@ table.insert(content, {
 	["ReadOnly"] = false;
 })
 
+table.insert(content, {
+	["Type"] = "Property";
+	["ValueType"] = "number";
+	["Name"] = "Bounciness";
+	["Description"] = "Defaults to 0.5. The fraction of a particle's speed into a surface that is kept when it bounces off that surface. Only used when Collision is set to 'bounce'.";
+	["ReadOnly"] = false;
+})
+
 table.insert(content, {
 	["Type"] = "Property";
 	["ValueType"] = "number";
@@ -33,6 +41,22 @@ table.insert(content, {
 	["ReadOnly"] = false;
 })
 
+table.insert(content, {
+	["Type"] = "Property";
+	["ValueType"] = "string";
+	["Name"] = "Collision";
+	["Description"] = "Either nil, 'bounce' or 'die'. Set with setCollision().";
+	["ReadOnly"] = true;
+})
+
+table.insert(content, {
+	["Type"] = "Property";
+	["ValueType"] = "number";
+	["Name"] = "CollisionThickness";
+	["Description"] = "Defaults to 1. How far in world units a particle may be behind the geometry in the depth canvas and still collide with it. Anything further back is assumed to be a different object that the particle passes behind.";
+	["ReadOnly"] = false;
+})
+
 table.insert(content, {
 	["Type"] = "Property";
 	["ValueType"] = "texture";
@@ -113,6 +137,14 @@ table.insert(content, {
 	["ReadOnly"] = false;
 })
 
+table.insert(content, {
+	["Type"] = "Property";
+	["ValueType"] = "table";
+	["Name"] = "Heightfield";
+	["Description"] = "The heightfield the particles collide with, or nil if they collide with the depth canvas of the scene instead. Set with setHeightfield().";
+	["ReadOnly"] = true;
+})
+
 table.insert(content, {
 	["Type"] = "Property";
 	["ValueType"] = "number";
@@ -169,6 +201,14 @@ table.insert(content, {
 	["ReadOnly"] = true;
 })
 
+table.insert(content, {
+	["Type"] = "Property";
+	["ValueType"] = "table";
+	["Name"] = "Simulation";
+	["Description"] = "An internal table holding the canvases that store the position and velocity of each particle when Collision is set, or nil otherwise.";
+	["ReadOnly"] = true;
+})
+
 table.insert(content, {
 	["Type"] = "Property";
 	["ValueType"] = "numbercurve";
@@ -264,7 +304,7 @@ table.insert(content, {
 	["Type"] = "Method";
 	["Name"] = "move";
 	["Arguments"] = {"vec3"};
-	["Description"] = "Moves the emitter and any currently emitted particles by some given offset in world units. Particles will keep their relative position.";
+	["Description"] = "Moves the emitter and any currently emitted particles by some given offset in world units. Particles will keep their relative position. Particles that collide with the scene are moved by the next step of their simulation, which happens before they are drawn.";
 })
 
 table.insert(content, {
@@ -282,6 +322,27 @@ table.insert(content, {
 })
 
 
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "setCollision";
+	["Arguments"] = {"mode", "bounciness"};
+	["Description"] = "Makes particles collide with the scene. The mode is 'bounce' to make particles bounce off of geometry, 'die' to make them disappear when they hit something or nil to turn collision off again. Bounciness is optional and sets the Bounciness property.\n\nColliding particles are stepped on the GPU each frame and their positions and velocities are stored in two pairs of float canvases with one texel per particle. By default particles collide with the depth canvas of the scene, which only contains what the camera sees. Particles that are hidden behind other geometry or that are off-screen will not collide with anything.";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "setHeightfield";
+	["Arguments"] = {"image", "corner", "size", "heights"};
+	["Description"] = "Makes colliding particles collide with a heightfield instead of the depth canvas of the scene, which also works for particles that are off-screen. The heights are read from the red channel of the image, which covers the area from corner to corner + size (both vector2). A value of 0 is placed at heights.min and a value of 1 at heights.max (a range). Call without arguments to collide with the depth canvas again.";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "simulate";
+	["Arguments"] = {};
+	["Description"] = "Internal method that is called by a scene3 to step colliding particles to the current time.";
+})
+
 table.insert(content, {
 	["Type"] = "Method";
 	["Name"] = "__tostring";
@@ -140,14 +140,14 @@ table.insert(content, {
 	["Type"] = "Method";
 	["Name"] = "applyAmbientOcclusion";
 	["Arguments"] = {};
-	["Description"] = "FOR INTERNAL USE ONLY. This will apply ambient occlusion to the canvas that is currently being prepared for rendering.";
+	["Description"] = "FOR INTERNAL USE ONLY. This will apply ambient occlusion to the canvas that is currently being prepared for rendering. Does nothing when ambient occlusion is disabled.";
 })
 
 table.insert(content, {
 	["Type"] = "Method";
-	["Name"] = "applyBloom";
+	["Name"] = "applyPostProcessing";
 	["Arguments"] = {};
-	["Description"] = "FOR INTERNAL USE ONLY. This will apply bloom to the canvas that is currently being prepared for rendering.";
+	["Description"] = "FOR INTERNAL USE ONLY. This will apply bloom, draw particles and trails and apply FXAA to the canvas that is currently being prepared for rendering. Passes that have nothing to draw are skipped, and the canvases they need are only taken from a shared pool while they are in use.";
 })
 
 table.insert(content, {
@@ -178,6 +178,13 @@ table.insert(content, {
 	["Description"] = "Adds a particles3 instance to the scene's list of particles that will be drawn. Each particles3 instance takes up one draw call.";
 })
 
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "bakeStatic";
+	["Arguments"] = {"meshes", "cellSize"};
+	["Description"] = "Merges the given array of attached mesh3 instances into a small number of big meshes whose vertices are already transformed to world space, one per unique material in each cell of the world. This turns many draw calls into a few. Cells are cubes of 'cellSize' world units (64 by default) and a mesh belongs to the cell its center is in, so that batches stay small enough to be culled. If 'meshes' is nil, all attached mesh3 instances with their Static property set to true are baked. Mesh3 instances with Static set to true are also baked automatically when attached. Moving or detaching a baked mesh breaks up its batch again. Returns an array with the created batches.";
+})
+
 table.insert(content, {
 	["Type"] = "Method";
 	["Name"] = "detachBlob";
@@ -220,6 +227,27 @@ table.insert(content, {
 	["Description"] = "Returns the current Camera3 used in the scene.";
 })
 
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "getMeshesInRange";
+	["Arguments"] = {"position", "radius"};
+	["Description"] = "Returns an array of all mesh3 and trip3 instances whose bounding sphere overlaps the sphere at the given vector3 position with the given radius. Requires an octree, see Scene3:setOctree().";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "getMeshesOnRay";
+	["Arguments"] = {"line", "maxDistance"};
+	["Description"] = "Returns an array of all mesh3 and trip3 instances whose bounding sphere is hit by the given line3, extended into a ray, sorted from closest to furthest. The second return value is a dictionary with the distance at which each mesh's bounding sphere is hit. Use together with Camera3:screenToRay() for mouse picking. Requires an octree, see Scene3:setOctree().";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "invalidateShadowCache";
+	["Arguments"] = {};
+	["Description"] = "Redraws the static shadow casters into the shadow cache on the next frame. This is called automatically when a static mesh is moved, attached or detached and when an instanced group in the cache is edited, so you only need to call it after changing a static caster in some other way, such as toggling its CastShadow property.";
+})
+
 table.insert(content, {
 	["Type"] = "Method";
 	["Name"] = "on";
@@ -252,21 +280,28 @@ table.insert(content, {
 	["Type"] = "Method";
 	["Name"] = "setAOQuality";
 	["Arguments"] = {"quality"};
-	["Description"] = "Sets the quality of the ambient occlusion. 'quality' must be one of 1, 0.5 or 0.25. Right now the quality only impacts the number of samples taken (24, 16 or 8).";
+	["Description"] = "Sets the quality of the ambient occlusion. 'quality' must be one of 1, 0.5 or 0.25. The quality impacts the number of samples taken (24, 16 or 8). To calculate ambient occlusion at a lower resolution, see setAOResolution().";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "setAOResolution";
+	["Arguments"] = {"resolution", "accumulate"};
+	["Description"] = "Sets the resolution at which ambient occlusion is calculated. 'resolution' must be one of 1, 0.5 or 0.25. At a lower resolution, ambient occlusion is calculated from a downsampled depth and normal buffer and then upsampled with a filter that respects the edges of objects, which is a lot cheaper on large screens.\n\nIf 'accumulate' is true, only half the samples are taken each frame and the result is blended with that of previous frames. This reduces noise at a lower cost, but fast moving objects may leave a faint trail of ambient occlusion.";
 })
 
 table.insert(content, {
 	["Type"] = "Method";
 	["Name"] = "setBloom";
 	["Arguments"] = {"size"};
-	["Description"] = "Sets the size of the scene's bloom in pixels. A size of 0 disables bloom altogether. Note that bloom will appear larger on lower resolutions due to it being in pixels.";
+	["Description"] = "Sets the size of the scene's bloom in pixels. A size of 0 disables bloom altogether. Note that bloom will appear larger on lower resolutions due to it being in pixels.\n\nBloom is blurred by repeatedly halving the bloom canvas and adding the halved canvases back together, where each halving doubles the size of the blur. The size is therefore rounded to the nearest power of two, and large sizes cost little more than small ones.";
 })
 
 table.insert(content, {
 	["Type"] = "Method";
 	["Name"] = "setBloomQuality";
 	["Arguments"] = {"quality"};
-	["Description"] = "Sets the quality at which bloom is rendered. 'quality' must be one of 1, 0.5 or 0.25 and will impact the resolution of the canvas it is drawn to. The difference between high and low quality is hard to see so consider using a low resolution. However, fps gains are minimal at lower resolution.";
+	["Description"] = "Sets the quality at which bloom is rendered. 'quality' must be one of 1, 0.5 or 0.25 and will impact the resolution of the canvas it is drawn to. The difference between high and low quality is hard to see so consider using a low resolution. A lower quality also needs fewer halvings to reach the same bloom size, see setBloom().";
 })
 
 table.insert(content, {
@@ -276,6 +311,13 @@ table.insert(content, {
 	["Description"] = "Updates the light at the given internal index to be positioned at the given vector3 position, with a given color, range and strength.\n\nCurrently, 16 indexes are supported meaning a scene can have up to 16 unique light sources. To disable a light you can set its range or strength to 0.";
 })
 
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "setDeferredLights";
+	["Arguments"] = {"state"};
+	["Description"] = "Enables or disables deferred lighting. When enabled, lights are no longer calculated per mesh but drawn onto the opaque geometry in a separate pass that reads the depth canvas together with the surface color and normal-mapped normal that every opaque mesh writes to two extra canvases, so the cost of a light depends on how much of the screen it covers. Plants, sprite meshes, particles and transparent meshes are still lit the regular way.";
+})
+
 table.insert(content, {
 	["Type"] = "Method";
 	["Name"] = "setDiffuse";
@@ -283,6 +325,55 @@ table.insert(content, {
 	["Description"] = "Sets the scene's diffuse lighting strength.\n- When set to 0, a surface is lit purely based on the distance to the light source.\n- When set to 1, a surface's orientation w.r.t. the light source's position is strongly considered when lighting the surface.";
 })
 
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "setFrustumCulling";
+	["Arguments"] = {"state"};
+	["Description"] = "Enables or disables frustum culling, which is enabled by default. When enabled, meshes whose bounds fall outside of the camera's view are skipped when drawing, and shadow casters outside of the shadow-map are skipped when updating the shadow-map.";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "setOcclusionCulling";
+	["Arguments"] = {"state"};
+	["Description"] = "Enables or disables occlusion culling. When enabled, the depth pre-pass is reduced to a small depth buffer on the GPU, after which meshes, trip3 and instanced groups that are completely hidden behind other geometry are skipped in the color pass. To avoid waiting on the GPU, the buffer is read back one frame after it is drawn, so objects that come out from behind other geometry can appear one frame late. The background is skipped as well when the depth pre-pass covers the whole screen and the camera did not move. Objects with their Silhouette property set are never culled, since their silhouette has to be drawn exactly when they are hidden. The number of objects tested and culled in the last frame is stored in Scene3.OcclusionStats.";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "setOctree";
+	["Arguments"] = {"state", "position", "size", "maxDepth"};
+	["Description"] = "Enables or disables a loose octree holding all attached mesh3 and trip3 instances. This speeds up frustum culling in scenes with many meshes and enables spatial queries. The octree is centered on the given vector3 position (default origin) and spans the given size in world units (default 2048). Meshes are moved inside the octree automatically when their Position, Rotation or Scale changes.";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "setOrderIndependentTransparency";
+	["Arguments"] = {"state"};
+	["Description"] = "Enables or disables order-independent transparency. By default, semi-transparent meshes are sorted from far to near and drawn in that order. When enabled, they are drawn in material order into two extra canvases using weighted blending and then combined onto the render canvas in one pass. This skips the sorting and handles meshes that intersect each other, but layers at a similar depth are blended together approximately.";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "setSceneConstant";
+	["Arguments"] = {"name", "..."};
+	["Description"] = "Sets a uniform that is shared by all of the scene's shaders, such as 'camMatrix' or 'ambientColor'. Takes the same arguments as Shader:send(), but a matrix4 may also be passed. The value is not sent right away: each shader receives the constants that changed the next time it is used to draw, so changing a constant costs nothing for shaders that are not drawn with. The camera calls this method itself whenever it moves.";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "setShadowCache";
+	["Arguments"] = {"state"};
+	["Description"] = "Enables or disables the shadow cache. When enabled, the depth of static shadow casters is kept in a separate canvas that is only redrawn when a cascade moves or a static caster changes. Each frame that canvas is copied into the shadow-map and only the other casters are drawn on top. Static casters are mesh3 and trip3 instances with Static set to true, batches created by Scene3:bakeStatic() and instanced groups whose instances were never edited. With the cache enabled, cascades move in bigger steps so that the cache stays valid for longer.";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "setShadowCascades";
+	["Arguments"] = {"count", "distance", "lambda"};
+	["Description"] = "Splits the shadow-map into 'count' cascades (1 to 4, default 1) that follow the camera, giving nearby geometry sharp shadows while still covering far away geometry. Each cascade covers a slice of the camera's view up to 'distance' (default 100) away from the camera and is drawn into its own area of the shadow canvas, which becomes 'count' times as wide as the canvasSize given to Scene3:setShadowMap(). 'lambda' (default 0.5) blends between evenly spaced slices (0) and logarithmic slices (1). With more than 1 cascade, the position and size given to Scene3:setShadowMap() are ignored.";
+})
+
 table.insert(content, {
 	["Type"] = "Method";
 	["Name"] = "setShadowMap";
@@ -290,6 +381,13 @@ table.insert(content, {
 	["Description"] = "Adds a shadow-map, which is essentially a sun emitting lighting in a given region, creating shadows that is cast onto geometry. Anything in shadow uses ambient occlusion.\n- position: A vector3 of where the sun is.\n- direction: a vector3 of the direction the light is going.\n- size: A vector2 describing the width and height of the shadow-map in world units.\n- canvasSize: How big the canvas is that shadows are rendered to, thus how detailed the shadow-map is.\n- sunColor: A color3 of the sun's light color that is added on top of the ambient color when geometry is in sunlight.\n- shadowStrength: 1 for dark shadows, 0 for no shadows, or something in between to interpolate.";
 })
 
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "unbakeStatic";
+	["Arguments"] = {"batch"};
+	["Description"] = "Breaks up a batch created by Scene3:bakeStatic(), or all batches if 'batch' is nil, so that its meshes are drawn individually again. Call this before changing the material of a baked mesh, then bake it again.";
+})
+
 
 table.insert(content, {
 	["Type"] = "Header";
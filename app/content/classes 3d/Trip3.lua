@@ -169,6 +169,13 @@ table.insert(content, {
 	["Description"] = "";
 })
 
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "addLOD";
+	["Arguments"] = {"mesh", "distance"};
+	["Description"] = "Adds a lower detail love2d mesh that is drawn instead of the trip3's mesh once the camera is at least 'distance' away. Switching levels can be delayed with the LODHysteresis property to prevent flickering, and the LODFade property sets the width of a dithered cross-fade between two levels in world units. Meshes with levels of detail are not merged by Scene3:bakeStatic().";
+})
+
 table.insert(content, {
 	["Type"] = "Method";
 	["Name"] = "attach";
@@ -176,6 +183,13 @@ table.insert(content, {
 	["Description"] = "Links the trip3 to a scene3. If the mesh is already attached to another scene, it is detached before this is executed.";
 })
 
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "clearLODs";
+	["Arguments"] = {};
+	["Description"] = "Removes all levels of detail, so the trip3 always draws its own mesh again.";
+})
+
 table.insert(content, {
 	["Type"] = "Method";
 	["Name"] = "clone";
@@ -136,6 +136,20 @@ table.insert(content, {
 	["Description"] = "";
 })
 
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "addInstance";
+	["Arguments"] = {"position", "rotation", "scale", "col", "shadowCol"};
+	["Description"] = "Adds an instance at the end of the group and returns its index. Only 'position' is required, 'rotation' and 'scale' default to no rotation and a scale of 1, 'col' defaults to white and 'shadowCol' to black. When the group is full, its capacity is doubled, see reserve(). The instance is uploaded the next time the group is drawn.";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "addLOD";
+	["Arguments"] = {"mesh", "distance"};
+	["Description"] = "Adds a lower detail love2d mesh that is drawn for instances that are at least 'distance' away from the camera. Each frame the group is drawn, its instances are split into one instance list per level of detail. Switching levels can be delayed with the LODHysteresis property to prevent flickering. The lists are only rebuilt once the camera moved more than LODUpdateDistance or instances changed.";
+})
+
 table.insert(content, {
 	["Type"] = "Method";
 	["Name"] = "attach";
@@ -144,6 +158,13 @@ table.insert(content, {
 })
 
 
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "clearLODs";
+	["Arguments"] = {};
+	["Description"] = "Removes all levels of detail, so every instance is drawn with the group's own mesh again.";
+})
+
 table.insert(content, {
 	["Type"] = "Method";
 	["Name"] = "detach";
@@ -151,6 +172,48 @@ table.insert(content, {
 	["Description"] = "Detaches the mesh from the scene it's linked to. This does not destroy the trip3group, meaning it can be re-attached later.";
 })
 
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "flushInstances";
+	["Arguments"] = {};
+	["Description"] = "Uploads all instances that were added or edited since the last upload in one go. The scene calls this right before drawing the group, so there is usually no need to call it yourself.";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "removeInstance";
+	["Arguments"] = {"index"};
+	["Description"] = "Removes the instance at the given index by moving the last instance of the group into its slot. This means the last instance's index changes to 'index'!";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "reserve";
+	["Arguments"] = {"capacity"};
+	["Description"] = "Makes sure the group can hold 'capacity' instances without having to create a new instance mesh. Call this before adding many instances to prevent the instance mesh from being recreated several times.";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "setInstanceColor";
+	["Arguments"] = {"index", "col", "shadowCol"};
+	["Description"] = "Sets the color and shadow color of the instance at the given index. Either argument can be nil to keep the current value.";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "setInstanceMatrix";
+	["Arguments"] = {"index", "matrix4"};
+	["Description"] = "Sets the model matrix of the instance at the given index.";
+})
+
+table.insert(content, {
+	["Type"] = "Method";
+	["Name"] = "setInstanceTransform";
+	["Arguments"] = {"index", "position", "rotation", "scale"};
+	["Description"] = "Sets the position, rotation and scale of the instance at the given index. 'rotation' and 'scale' default to no rotation and a scale of 1. Edits are stored on the CPU and all edits made during a frame are uploaded together when the group is drawn, so editing a few instances of a large group every frame is cheap.";
+})
+
 
 
 
@@ -23,6 +23,9 @@ function load()
 
 	-- data structures
 	quadtree = require(filepath("../framework/modules/quadtree", "."))
+	octree = require(filepath("../framework/modules/octree", "."))
+	rendergraph = require(filepath("../framework/modules/rendergraph", "."))
+	shadervariants = require(filepath("../framework/modules/shadervariants", "."))
 	navmesh = require(filepath("../framework/modules/navmesh", "."))
 	floodmap = require(filepath("../framework/modules/floodmap", "."))
 	
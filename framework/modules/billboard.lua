@@ -33,10 +33,12 @@ end
 
 ----------------------------------------------------[[ == OBJECT CREATION == ]]----------------------------------------------------
 
-local function new(texture, position)
+-- all billboards share the same quad, which is drawn once for each texture with per-instance attributes, see Scene3:draw()
+local billboardMesh = nil
 
+local function initMesh()
 	-- don't need normals because we're not doing any fancy lighting
-	local mesh = love.graphics.newMesh(
+	billboardMesh = love.graphics.newMesh(
 		{
 			{"VertexPosition", "float", 3},
 			{"VertexTexCoord", "float", 2}
@@ -52,18 +54,29 @@ local function new(texture, position)
 		"triangles",
 		"static"
 	)
-	mesh:setTexture(texture)
+end
+
+
+
+local function new(texture, position)
+	if billboardMesh == nil then
+		initMesh()
+	end
 
 	module.TotalCreated = module.TotalCreated + 1
 
 	local Obj = {
 		["Id"] = module.TotalCreated;
-		["Mesh"] = mesh;
+		["Mesh"] = billboardMesh;
+		["Texture"] = texture; -- billboards with the same texture are drawn together in one draw call
 		["Position"] = vector3(position);
 		["Rotation"] = 0; -- radians
 		["Center"] = vector2(0.5, 0.5); -- 0,0 = bottom left, 1,1 = top right
 		["WorldSize"] = vector2(1, 1); -- world units
 		["PixelSize"] = vector2(0, 0); -- screen pixels
+		["Color"] = color(1, 1, 1);
+		["UVOffset"] = vector2(0, 0); -- top left corner of the part of the texture that is shown, where 1,1 is the bottom right of the texture
+		["UVSize"] = vector2(1, 1); -- size of the part of the texture that is shown. Use this together with UVOffset to draw from a texture atlas
 		["InFront"] = true; -- if true, does not hide behind geometry; gets drawn in front always (and writes no depth)
 
 		["Scene"] = nil;
@@ -29,21 +29,7 @@ function Camera3:updateCameraMatrices()
 	local camMatrix = matrix4.fromPosition(0, 0, self.Offset):rotateX(self.Rotation.x):rotateY(self.Rotation.y):rotateZ(self.Rotation.z):translate(self.Position.x, self.Position.y, self.Position.z)
 	self.Matrix = camMatrix
 	if self.Scene3 ~= nil then
-		local c1, c2, c3, c4 = camMatrix:columns()
-		local arr = {c1, c2, c3, c4}
-		self.Scene3.Shader:send("camMatrix", arr)
-		self.Scene3.DepthShader:send("camMatrix", arr)
-		self.Scene3.TriplanarShader:send("camMatrix", arr)
-		--self.Scene3.TriplanarDepthShader:send("camMatrix", arr)
-		self.Scene3.FoliageShader:send("camMatrix", arr)
-		self.Scene3.PlantShader:send("camMatrix", arr)
-		self.Scene3.RippleShader:send("camMatrix", arr)
-		self.Scene3.ParticlesShader:send("camMatrix", arr)
-		self.Scene3.TrailShader:send("camMatrix", arr)
-		self.Scene3.BillboardShader:send("camMatrix", arr)
-		self.Scene3.MaskShader:send("camMatrix", arr)
-		self.Scene3.SilhouetteShader:send("camMatrix", arr)
-		self.Scene3.SkyboxShader:send("camMatrix", arr)
+		self.Scene3:setSceneConstant("camMatrix", camMatrix) -- only sent to the scene's shaders once they are used
 	end
 end
 
@@ -168,29 +154,14 @@ function Camera3:setFOV(fov)
 
 	-- update the scene's field-of-view if this camera is attached to one
 	if self.Scene3 ~= nil then
-		self.Scene3.Shader:send("fieldOfView", fov)
-		self.Scene3.DepthShader:send("fieldOfView", fov)
-		self.Scene3.TriplanarShader:send("fieldOfView", fov)
-		--self.Scene3.TriplanarDepthShader:send("fieldOfView", fov)
-		self.Scene3.FoliageShader:send("fieldOfView", fov)
-		self.Scene3.PlantShader:send("fieldOfView", fov)
-		self.Scene3.RippleShader:send("fieldOfView", fov)
-		self.Scene3.ParticlesShader:send("fieldOfView", fov)
-		self.Scene3.TrailShader:send("fieldOfView", fov)
-		self.Scene3.BillboardShader:send("fieldOfView", fov)
-		self.Scene3.MaskShader:send("fieldOfView", fov)
-		self.Scene3.SilhouetteShader:send("fieldOfView", fov)
-		self.Scene3.SkyboxShader:send("fieldOfView", fov)
+		self.Scene3:setSceneConstant("fieldOfView", fov)
 
 		self:updateCameraMatrices()
 
 		local aspectRatio = self.Scene3.RenderCanvas:getWidth() / self.Scene3.RenderCanvas:getHeight()
 		local persp = matrix4.perspective(aspectRatio, fov, 1000, 0.1)
-		local c1, c2, c3, c4 = persp:columns()
-		self.Scene3.SSAOShader:send("perspectiveMatrix", {c1, c2, c3, c4})
-		local invPersp = persp:inverse()
-		local c1, c2, c3, c4 = invPersp:columns()
-		self.Scene3.SSAOShader:send("invPerspectiveMatrix", {c1, c2, c3, c4})
+		self.Scene3:setSceneConstant("perspectiveMatrix", persp)
+		self.Scene3:setSceneConstant("invPerspectiveMatrix", persp:inverse())
 	end
 end
 
@@ -133,6 +133,7 @@ end
 -- pack up and return module
 module.new = new
 module.isMask = isMask
+module.DitherTexture = meshTexture -- shared with the level-of-detail cross-fade in the mesh shaders
 return setmetatable(module, {__call = function(_, ...) return new(...) end})
 
 
@@ -8,15 +8,77 @@ local module = {
 local Mesh3Group = {}
 Mesh3Group.__index = Mesh3Group
 Mesh3Group.__tostring = function(tab) return "{Mesh3Group: " .. tostring(tab.Id) .. "}" end
---[[
-local attributeIndex = {
-	["Position"] = 1;
-	["Rotation"] = 2;
-	["Scale"] = 3;
-	["Color"] = 4;
-	["ColorShadow"] = 5;
+
+
+
+----------------------------------------------------[[ == HELPERS == ]]----------------------------------------------------
+
+-- instance data layout. The first 16 values are the model matrix, followed by the color and shadow color
+local instanceFormat = {
+	{"instMatColumn1", "float", 4},
+	{"instMatColumn2", "float", 4},
+	{"instMatColumn3", "float", 4},
+	{"instMatColumn4", "float", 4},
+	{"instanceColor", "float", 3},
+	{"instanceColorShadow", "float", 3}
 }
-]]
+
+-- scratch array of instance rows, reused when uploading a range of changed instances
+local uploadRows = {}
+
+
+
+local function setInstanceMatrix(row, m)
+	for i = 1, 16 do
+		row[i] = m[i]
+	end
+end
+
+
+
+-- replaces the instance mesh with a bigger "dynamic" one, since instances are being edited after creation
+local function rebuildInstances(self, capacity)
+	local instanceMesh = love.graphics.newMesh(instanceFormat, capacity, "triangles", "dynamic")
+	if self.Count > 0 then
+		for i = 1, self.Count do
+			uploadRows[i] = self.InstanceData[i]
+		end
+		instanceMesh:setVertices(uploadRows, 1)
+		for i = 1, self.Count do
+			uploadRows[i] = nil
+		end
+	end
+
+	for i = 1, #instanceFormat do
+		self.Mesh:attachAttribute(instanceFormat[i][1], instanceMesh, "perinstance")
+	end
+	self.Instances:release()
+	self.Instances = instanceMesh
+	self.Capacity = capacity
+	self.Usage = "dynamic"
+	self.DirtyFrom = nil
+	self.DirtyTo = nil
+	self.Version = self.Version + 1
+end
+
+
+
+local function markDirty(self, index)
+	if self.DirtyFrom == nil then
+		self.DirtyFrom, self.DirtyTo = index, index
+	else
+		self.DirtyFrom = math.min(self.DirtyFrom, index)
+		self.DirtyTo = math.max(self.DirtyTo, index)
+	end
+	-- tracked separately from the upload range, since the scene reads it on its own schedule to grow the bounds of the group
+	if self.BoundsFrom == nil then
+		self.BoundsFrom, self.BoundsTo = index, index
+	else
+		self.BoundsFrom = math.min(self.BoundsFrom, index)
+		self.BoundsTo = math.max(self.BoundsTo, index)
+	end
+end
+
 
 
 ----------------------------------------------------[[ == METHODS == ]]----------------------------------------------------
@@ -38,11 +100,224 @@ function Mesh3Group:detach()
 	self.Scene:detachMesh(self)
 end
 
---[[
-function Mesh3Group:changeInstance(index, property, newValue)
-	self.Instances:setVertexAttribute(index, attributeIndex[property], newValue:components())
+-- instance edits are only stored on the CPU at first. All edits made during a frame are uploaded together in one go by Mesh3Group:flushInstances()
+-- which the scene calls right before drawing. Groups are created with "static" usage and switch to "dynamic" usage the first time they are edited
+
+function Mesh3Group:setInstanceTransform(index, position, rotation, scale)
+	assert(type(index) == "number" and index >= 1 and index <= self.Count, "Mesh3Group:setInstanceTransform(index, position, rotation, scale) requires argument 'index' to be an existing instance index.")
+	assert(vector3.isVector3(position), "Mesh3Group:setInstanceTransform(index, position, rotation, scale) requires argument 'position' to be a vector3.")
+	setInstanceMatrix(self.InstanceData[index], matrix4.fromTransforms(position, rotation or vector3(0, 0, 0), scale or vector3(1, 1, 1)))
+	markDirty(self, index)
+end
+
+
+
+function Mesh3Group:setInstanceMatrix(index, m)
+	assert(type(index) == "number" and index >= 1 and index <= self.Count, "Mesh3Group:setInstanceMatrix(index, m) requires argument 'index' to be an existing instance index.")
+	assert(matrix4.isMatrix4(m), "Mesh3Group:setInstanceMatrix(index, m) requires argument 'm' to be a matrix4.")
+	setInstanceMatrix(self.InstanceData[index], m)
+	markDirty(self, index)
+end
+
+
+
+function Mesh3Group:setInstanceColor(index, col, shadowCol)
+	assert(type(index) == "number" and index >= 1 and index <= self.Count, "Mesh3Group:setInstanceColor(index, col, shadowCol) requires argument 'index' to be an existing instance index.")
+	assert(col == nil or color.isColor(col), "Mesh3Group:setInstanceColor(index, col, shadowCol) requires argument 'col' to be nil or a color.")
+	assert(shadowCol == nil or color.isColor(shadowCol), "Mesh3Group:setInstanceColor(index, col, shadowCol) requires argument 'shadowCol' to be nil or a color.")
+	local row = self.InstanceData[index]
+	if col ~= nil then
+		row[17], row[18], row[19] = col.r, col.g, col.b
+	end
+	if shadowCol ~= nil then
+		row[20], row[21], row[22] = shadowCol.r, shadowCol.g, shadowCol.b
+	end
+	markDirty(self, index)
+end
+
+
+
+-- makes sure the group can hold 'capacity' instances without having to create a new instance mesh
+function Mesh3Group:reserve(capacity)
+	if capacity > self.Capacity then
+		rebuildInstances(self, capacity)
+	end
+end
+
+
+
+-- adds an instance at the end of the group and returns its index. Capacity is doubled whenever it runs out
+function Mesh3Group:addInstance(position, rotation, scale, col, shadowCol)
+	assert(vector3.isVector3(position), "Mesh3Group:addInstance(position, rotation, scale, col, shadowCol) requires argument 'position' to be a vector3.")
+	if self.Count >= self.Capacity then
+		self:reserve(math.max(16, self.Capacity * 2))
+	end
+
+	self.Count = self.Count + 1
+	local row = {}
+	setInstanceMatrix(row, matrix4.fromTransforms(position, rotation or vector3(0, 0, 0), scale or vector3(1, 1, 1)))
+	col = col or color(1, 1, 1)
+	shadowCol = shadowCol or color(0, 0, 0)
+	row[17], row[18], row[19] = col.r, col.g, col.b
+	row[20], row[21], row[22] = shadowCol.r, shadowCol.g, shadowCol.b
+	self.InstanceData[self.Count] = row
+	markDirty(self, self.Count)
+	return self.Count
+end
+
+
+
+-- removes an instance by moving the last instance into its slot. This means that the last instance's index changes to 'index'!
+function Mesh3Group:removeInstance(index)
+	assert(type(index) == "number" and index >= 1 and index <= self.Count, "Mesh3Group:removeInstance(index) requires argument 'index' to be an existing instance index.")
+	local last = self.Count
+	if index ~= last then
+		self.InstanceData[index] = self.InstanceData[last]
+		self.InstanceLODs[index] = self.InstanceLODs[last]
+		markDirty(self, index)
+	end
+	self.InstanceData[last] = nil
+	self.InstanceLODs[last] = nil
+	self.Count = last - 1
+	self.Version = self.Version + 1 -- bounds changed even if nothing has to be uploaded
+end
+
+
+
+-- uploads all instances that changed since the last call in one ranged setVertices() call
+function Mesh3Group:flushInstances()
+	if self.DirtyFrom == nil then
+		return
+	end
+	if self.Usage == "static" then
+		rebuildInstances(self, self.Capacity) -- uploads everything
+		return
+	end
+
+	local from, to = self.DirtyFrom, math.min(self.DirtyTo, self.Count)
+	self.DirtyFrom, self.DirtyTo = nil, nil
+	if to < from then
+		return
+	end
+	for i = from, to do
+		uploadRows[i - from + 1] = self.InstanceData[i]
+	end
+	self.Instances:setVertices(uploadRows, from)
+	for i = 1, to - from + 1 do
+		uploadRows[i] = nil
+	end
+	self.Version = self.Version + 1
+end
+
+
+
+-- adds a lower detail mesh that is drawn for instances that are at least 'distance' away from the camera. Once a group has levels of detail
+-- its instances are split into one instance list per level, see Mesh3Group:updateLODs()
+function Mesh3Group:addLOD(meshRef, distance)
+	assert(type(distance) == "number" and distance > 0, "Mesh3Group:addLOD(meshRef, distance) requires argument 'distance' to be a positive number.")
+	local LODs = self.LODs
+	local index = #LODs + 1
+	while index > 1 and LODs[index - 1].Distance > distance do -- keep the levels sorted from most to least detailed
+		index = index - 1
+	end
+	table.insert(LODs, index, {["Mesh"] = meshRef; ["Distance"] = distance;})
+	self.LODVersion = nil -- split the instances again on the next update
+end
+
+
+
+-- removes all levels of detail and draws every instance with the group's own mesh again
+function Mesh3Group:clearLODs()
+	if self.LODLevels ~= nil then
+		for i = 1, #self.LODLevels do
+			if self.LODLevels[i].Instances ~= nil then
+				self.LODLevels[i].Instances:release()
+			end
+		end
+	end
+	self.LODs = {}
+	self.LODLevels = nil
+	self.LODVersion = nil
+	self.InstanceLODs = {}
+	for i = 1, #instanceFormat do
+		self.Mesh:attachAttribute(instanceFormat[i][1], self.Instances, "perinstance")
+	end
+end
+
+
+
+-- splits the instances into one instance list per level of detail for a camera at x, y, z. The lists are stored in LODLevels, where
+-- LODLevels[1] uses the group's own mesh and LODLevels[n + 1] uses LODs[n]. Called by the scene for groups that are about to be drawn
+-- the split is skipped until the camera moved more than LODUpdateDistance or the instances changed, since it re-uploads all instances
+function Mesh3Group:updateLODs(x, y, z)
+	local LODs = self.LODs
+	if #LODs == 0 then
+		return
+	end
+	if self.LODVersion == self.Version then
+		local dx, dy, dz = x - self.LODCameraX, y - self.LODCameraY, z - self.LODCameraZ
+		if dx * dx + dy * dy + dz * dz < self.LODUpdateDistance * self.LODUpdateDistance then
+			return
+		end
+	end
+	self.LODVersion = self.Version
+	self.LODCameraX, self.LODCameraY, self.LODCameraZ = x, y, z
+
+	local Levels = self.LODLevels
+	if Levels == nil then
+		Levels = {}
+		self.LODLevels = Levels
+	end
+	for i = #Levels + 1, #LODs + 1 do
+		Levels[i] = {["Mesh"] = nil; ["Instances"] = nil; ["Capacity"] = 0; ["Count"] = 0; ["Rows"] = {};}
+	end
+	for i = 1, #Levels do
+		Levels[i].Count = 0
+	end
+
+	-- same switching rules as Mesh3:updateLOD(), but per instance
+	local InstanceLODs = self.InstanceLODs
+	local hysteresis = self.LODHysteresis
+	local row, dx, dy, dz, dist, level, Level
+	for i = 1, self.Count do
+		row = self.InstanceData[i]
+		dx, dy, dz = row[13] - x, row[14] - y, row[15] - z
+		dist = math.sqrt(dx * dx + dy * dy + dz * dz)
+		level = math.min(InstanceLODs[i] or 0, #LODs)
+		while level < #LODs and dist >= LODs[level + 1].Distance + hysteresis do
+			level = level + 1
+		end
+		while level > 0 and dist < LODs[level].Distance - hysteresis do
+			level = level - 1
+		end
+		InstanceLODs[i] = level
+		Level = Levels[level + 1]
+		Level.Count = Level.Count + 1
+		Level.Rows[Level.Count] = row
+	end
+
+	-- upload each list to its own instance mesh and attach that to the level's mesh
+	for i = 1, #Levels do
+		Level = Levels[i]
+		Level.Mesh = (i == 1) and self.Mesh or LODs[i - 1].Mesh
+		for j = #Level.Rows, Level.Count + 1, -1 do
+			Level.Rows[j] = nil
+		end
+		if Level.Count > Level.Capacity then
+			if Level.Instances ~= nil then
+				Level.Instances:release()
+			end
+			Level.Capacity = math.max(16, Level.Capacity * 2, Level.Count)
+			Level.Instances = love.graphics.newMesh(instanceFormat, Level.Capacity, "triangles", "dynamic")
+		end
+		if Level.Count > 0 then
+			Level.Instances:setVertices(Level.Rows, 1)
+			for j = 1, #instanceFormat do
+				Level.Mesh:attachAttribute(instanceFormat[j][1], Level.Instances, "perinstance")
+			end
+		end
+	end
 end
-]]
 
 
 
@@ -98,18 +373,7 @@ local function new(mesh, positions, rotations, scales, cols, shadowcols)
 
 	-- TODO: replace position, rotation, scale with 4 attributes corresponding to the 4 rows (or columns? probs columns) of the model matrix
 	local instanceMesh = love.graphics.newMesh(
-		{
-			{"instMatColumn1", "float", 4},
-			{"instMatColumn2", "float", 4},
-			{"instMatColumn3", "float", 4},
-			{"instMatColumn4", "float", 4},
-			--{"instancePosition", "float", 3}, -- column 1
-			--{"instanceRotation", "float", 3}, -- column 2
-			--{"instanceScale", "float", 3}, -- column 3
-			-- column 4
-			{"instanceColor", "float", 3},
-			{"instanceColorShadow", "float", 3}
-		},
+		instanceFormat,
 		instancesData,
 		"triangles",
 		"static"
@@ -143,6 +407,23 @@ local function new(mesh, positions, rotations, scales, cols, shadowcols)
 		["CastShadow"] = false;
 		["NormalMap"] = nil;
 		["Count"] = #positions;
+		["InstanceData"] = instancesData; -- CPU copy of the instance data, so single instances can be edited without rebuilding the group
+		["Capacity"] = #positions; -- number of instances that fit in the instance mesh
+		["Usage"] = "static"; -- becomes "dynamic" once instances are edited
+		["DirtyFrom"] = nil; -- range of instances that were edited since the last upload
+		["DirtyTo"] = nil;
+		["BoundsFrom"] = nil; -- range of instances that were edited since the scene last updated the bounds of the group
+		["BoundsTo"] = nil;
+		["Version"] = 0; -- incremented whenever the instance data on the GPU changes, used by the scene to know when bounds need updating
+		["LODs"] = {}; -- lower detail meshes, see Mesh3Group:addLOD()
+		["LODHysteresis"] = 0; -- distance past a switch distance before an instance changes its level of detail
+		["LODUpdateDistance"] = 1; -- how far the camera has to move before the instances are split up again
+		["LODLevels"] = nil; -- one instance list per level of detail, set by Mesh3Group:updateLODs()
+		["InstanceLODs"] = {}; -- current level of detail of each instance
+		["LODVersion"] = nil; -- Version the instance lists were last built from
+		["LODCameraX"] = 0;
+		["LODCameraY"] = 0;
+		["LODCameraZ"] = 0;
 		["Scene"] = nil;
 	}
 
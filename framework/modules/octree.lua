@@ -0,0 +1,362 @@
+local module = {}
+
+--[[
+
+A loose octree that stores objects by their bounding sphere.
+
+Each node's bounds are twice as large as the octant it covers, so an object is always stored in exactly one node: the deepest node whose
+octant contains the object's center and whose loose bounds still fit the whole sphere. This means objects never have to be split across
+nodes, and moving an object only ever touches the node it leaves and the node it enters.
+
+Objects with a center outside of the root's bounds are kept in the root node, so the tree keeps working (but becomes slower) when objects
+are placed far outside of the region it was created with.
+
+]]
+
+
+
+----------------------------------------------------[[ == BASE OBJECTS == ]]----------------------------------------------------
+
+local Octree = {}
+Octree.__index = Octree
+
+local SQRT3 = math.sqrt(3)
+
+
+
+----------------------------------------------------[[ == HELPERS == ]]----------------------------------------------------
+
+local function newNode(parent, index, x, y, z, halfSize, depth)
+	return {
+		["Parent"] = parent;
+		["Index"] = index; -- index of this node in the parent's Children table
+		["X"] = x;
+		["Y"] = y;
+		["Z"] = z;
+		["HalfSize"] = halfSize; -- half the size of the octant. The loose bounds extend twice as far from the center
+		["Radius"] = halfSize * 2 * SQRT3; -- radius of the sphere around the loose bounds, used for frustum checks
+		["Depth"] = depth;
+		["Items"] = {};
+		["Children"] = {}; -- sparse, children are only created once an item is inserted into them
+		["Count"] = 0; -- number of items in this node and all of its descendants
+	}
+end
+
+
+
+-- returns the index (1 to 8) of the child octant that contains the given point
+local function getOctant(node, x, y, z)
+	return 1 + (x >= node.X and 1 or 0) + (y >= node.Y and 2 or 0) + (z >= node.Z and 4 or 0)
+end
+
+
+
+local function containsPoint(node, x, y, z)
+	local h = node.HalfSize
+	return math.abs(x - node.X) <= h and math.abs(y - node.Y) <= h and math.abs(z - node.Z) <= h
+end
+
+
+
+-- returns true if the item would be inserted one level deeper than the given node
+local function fitsInChild(tree, node, x, y, z, r)
+	return node.Depth < tree.MaxDepth and r <= node.HalfSize / 2 and containsPoint(node, x, y, z)
+end
+
+
+
+-- squared distance from a point to the loose bounds of a node
+local function distanceToNodeSq(node, x, y, z)
+	local h = node.HalfSize * 2
+	local dx = math.max(math.abs(x - node.X) - h, 0)
+	local dy = math.max(math.abs(y - node.Y) - h, 0)
+	local dz = math.max(math.abs(z - node.Z) - h, 0)
+	return dx * dx + dy * dy + dz * dz
+end
+
+
+
+-- narrows the range [tMin, tMax] of a ray down to the part between two planes along one axis. 'o' and 'd' are the ray's origin and direction
+-- along that axis and 'i' is 1 / d. A ray that runs parallel to the planes is either always or never between them, which is checked directly
+-- since the inverse is infinite and an origin on one of the planes would turn the range into NaN
+local function clipSlab(tMin, tMax, min, max, o, d, i)
+	if d == 0 then
+		if o < min or o > max then
+			return 1, 0 -- empty range
+		end
+		return tMin, tMax
+	end
+	local t1, t2 = (min - o) * i, (max - o) * i
+	if t1 > t2 then t1, t2 = t2, t1 end
+	if t1 > tMin then tMin = t1 end
+	if t2 < tMax then tMax = t2 end
+	return tMin, tMax
+end
+
+
+
+-- slab test of a ray against the loose bounds of a node. 'ix', 'iy' and 'iz' are the inverse of the ray's direction
+local function rayEntersNode(node, ox, oy, oz, dx, dy, dz, ix, iy, iz, maxDistance)
+	local h = node.HalfSize * 2
+	local tMin, tMax = 0, maxDistance
+	tMin, tMax = clipSlab(tMin, tMax, node.X - h, node.X + h, ox, dx, ix)
+	tMin, tMax = clipSlab(tMin, tMax, node.Y - h, node.Y + h, oy, dy, iy)
+	tMin, tMax = clipSlab(tMin, tMax, node.Z - h, node.Z + h, oz, dz, iz)
+	return tMin <= tMax
+end
+
+
+
+-- returns the distance along a normalized ray at which it enters a sphere, or nil if it misses
+local function rayEntersSphere(ox, oy, oz, dx, dy, dz, x, y, z, r)
+	local cx, cy, cz = x - ox, y - oy, z - oz
+	local t = cx * dx + cy * dy + cz * dz
+	local distSq = cx * cx + cy * cy + cz * cz - t * t
+	if distSq > r * r then
+		return nil
+	end
+	local half = math.sqrt(r * r - distSq)
+	if t + half < 0 then
+		return nil -- sphere is behind the ray
+	end
+	return math.max(t - half, 0)
+end
+
+
+
+----------------------------------------------------[[ == OBJECT CREATION == ]]----------------------------------------------------
+
+local function new(position, size, maxDepth)
+	assert(vector3.isVector3(position), "octree.new(position, size, maxDepth) requires argument 'position' to be a vector3.")
+	assert(type(size) == "number", "octree.new(position, size, maxDepth) requires argument 'size' to be a number.")
+	assert(maxDepth == nil or type(maxDepth) == "number", "octree.new(position, size, maxDepth) requires argument 'maxDepth' to be nil or a number.")
+
+	local Obj = {
+		["Root"] = newNode(nil, nil, position.x, position.y, position.z, size / 2, 0);
+		["MaxDepth"] = maxDepth ~= nil and maxDepth or 8;
+		["Count"] = 0;
+
+		["Nodes"] = {}; -- dictionary of [Object] = node it is stored in
+		["Slots"] = {}; -- dictionary of [Object] = index in the node's Items array
+		["Bounds"] = {}; -- dictionary of [Object] = {x, y, z, radius}
+	}
+
+	return setmetatable(Obj, Octree)
+end
+
+
+
+----------------------------------------------------[[ == METHODS == ]]----------------------------------------------------
+
+local function isOctree(t)
+	return getmetatable(t) == Octree
+end
+
+
+
+function Octree:has(Object)
+	return self.Nodes[Object] ~= nil
+end
+
+
+
+function Octree:insert(Object, x, y, z, r)
+	if self.Nodes[Object] ~= nil then
+		return self:update(Object, x, y, z, r)
+	end
+
+	-- walk down until the item no longer fits in a smaller octant
+	local node = self.Root
+	while fitsInChild(self, node, x, y, z, r) do
+		local index = getOctant(node, x, y, z)
+		local child = node.Children[index]
+		if child == nil then
+			local q = node.HalfSize / 2
+			local bits = index - 1 -- bit 1 = positive x, bit 2 = positive y, bit 3 = positive z
+			child = newNode(
+				node,
+				index,
+				node.X + (bits % 2 == 1 and q or -q),
+				node.Y + (math.floor(bits / 2) % 2 == 1 and q or -q),
+				node.Z + (bits >= 4 and q or -q),
+				q,
+				node.Depth + 1
+			)
+			node.Children[index] = child
+		end
+		node = child
+	end
+
+	node.Items[#node.Items + 1] = Object
+	self.Nodes[Object] = node
+	self.Slots[Object] = #node.Items
+	self.Bounds[Object] = {x, y, z, r}
+	self.Count = self.Count + 1
+
+	while node ~= nil do
+		node.Count = node.Count + 1
+		node = node.Parent
+	end
+	return true
+end
+
+
+
+function Octree:remove(Object)
+	local node = self.Nodes[Object]
+	if node == nil then
+		return false
+	end
+
+	-- swap-remove the item from its node
+	local slot = self.Slots[Object]
+	local Items = node.Items
+	local last = Items[#Items]
+	Items[slot] = last
+	self.Slots[last] = slot
+	Items[#Items] = nil
+
+	self.Nodes[Object] = nil
+	self.Slots[Object] = nil
+	self.Bounds[Object] = nil
+	self.Count = self.Count - 1
+
+	-- update counts and prune branches that have become empty
+	while node ~= nil do
+		node.Count = node.Count - 1
+		if node.Count == 0 and node.Parent ~= nil then
+			node.Parent.Children[node.Index] = nil
+		end
+		node = node.Parent
+	end
+	return true
+end
+
+
+
+-- call whenever the bounds of an item change. Items only move to a different node if they no longer belong in their current one
+function Octree:update(Object, x, y, z, r)
+	local node = self.Nodes[Object]
+	if node == nil then
+		return self:insert(Object, x, y, z, r)
+	end
+
+	local belongsHere
+	if node.Parent == nil then
+		belongsHere = not fitsInChild(self, node, x, y, z, r)
+	else
+		belongsHere = containsPoint(node, x, y, z) and r <= node.HalfSize and not fitsInChild(self, node, x, y, z, r)
+	end
+
+	if belongsHere then
+		local bounds = self.Bounds[Object]
+		bounds[1], bounds[2], bounds[3], bounds[4] = x, y, z, r
+		return true
+	end
+
+	self:remove(Object)
+	return self:insert(Object, x, y, z, r)
+end
+
+
+
+local function collectInRange(tree, node, x, y, z, radius, target)
+	local Items = node.Items
+	local Bounds = tree.Bounds
+	for i = 1, #Items do
+		local b = Bounds[Items[i]]
+		local maxDist = radius + b[4]
+		if (b[1] - x)^2 + (b[2] - y)^2 + (b[3] - z)^2 <= maxDist * maxDist then
+			target[#target + 1] = Items[i]
+		end
+	end
+	for _, child in pairs(node.Children) do
+		if distanceToNodeSq(child, x, y, z) <= radius * radius then
+			collectInRange(tree, child, x, y, z, radius, target)
+		end
+	end
+end
+
+
+
+-- returns an array of all items whose bounding sphere overlaps the given sphere
+function Octree:getInRange(position, radius)
+	assert(vector3.isVector3(position), "Octree:getInRange(position, radius) requires argument 'position' to be a vector3.")
+	local target = {}
+	collectInRange(self, self.Root, position.x, position.y, position.z, radius, target)
+	return target
+end
+
+
+
+local function collectOnRay(tree, node, ox, oy, oz, dx, dy, dz, ix, iy, iz, maxDistance, target, distances)
+	local Items = node.Items
+	local Bounds = tree.Bounds
+	for i = 1, #Items do
+		local b = Bounds[Items[i]]
+		local t = rayEntersSphere(ox, oy, oz, dx, dy, dz, b[1], b[2], b[3], b[4])
+		if t ~= nil and t <= maxDistance then
+			target[#target + 1] = Items[i]
+			distances[Items[i]] = t
+		end
+	end
+	for _, child in pairs(node.Children) do
+		if rayEntersNode(child, ox, oy, oz, dx, dy, dz, ix, iy, iz, maxDistance) then
+			collectOnRay(tree, child, ox, oy, oz, dx, dy, dz, ix, iy, iz, maxDistance, target, distances)
+		end
+	end
+end
+
+
+
+-- returns an array of all items whose bounding sphere is hit by the ray going from line.from through line.to, sorted from closest to furthest
+-- the second return value is a dictionary with the distance along the ray at which each item's bounding sphere is entered
+function Octree:atRay(line, maxDistance)
+	assert(line3.isLine3(line), "Octree:atRay(line, maxDistance) requires argument 'line' to be a line3.")
+	maxDistance = maxDistance ~= nil and maxDistance or math.huge
+
+	local dir = (line.to - line.from):norm()
+	-- inverse direction for the slab tests. Components that are zero give inf, which the slab test never uses, see clipSlab()
+	local ix, iy, iz = 1 / dir.x, 1 / dir.y, 1 / dir.z
+	local target = {}
+	local distances = {}
+	collectOnRay(self, self.Root, line.from.x, line.from.y, line.from.z, dir.x, dir.y, dir.z, ix, iy, iz, maxDistance, target, distances)
+	table.sort(target, function(a, b) return distances[a] < distances[b] end)
+	return target, distances
+end
+
+
+
+local function collectInFrustum(tree, node, test, frustum, target, n)
+	local Items = node.Items
+	local Bounds = tree.Bounds
+	for i = 1, #Items do
+		local b = Bounds[Items[i]]
+		if test(frustum, b[1], b[2], b[3], b[4]) then
+			n = n + 1
+			target[n] = Items[i]
+		end
+	end
+	for _, child in pairs(node.Children) do
+		if test(frustum, child.X, child.Y, child.Z, child.Radius) then
+			n = collectInFrustum(tree, child, test, frustum, target, n)
+		end
+	end
+	return n
+end
+
+
+
+-- writes all items that pass test(frustum, x, y, z, radius) into 'target' starting at index 1 and returns how many were written
+-- whole branches are skipped when the sphere around their bounds fails the test, so the test has to be conservative for spheres
+function Octree:inFrustum(test, frustum, target)
+	return collectInFrustum(self, self.Root, test, frustum, target, 0)
+end
+
+
+
+----------------------------------------------------[[ == RETURN == ]]----------------------------------------------------
+
+module.new = new
+module.isOctree = isOctree
+return setmetatable(module, {__call = function(_, ...) return new(...) end})
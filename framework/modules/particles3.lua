@@ -1,5 +1,7 @@
 
 
+local ffi = require("ffi")
+
 ----------------------------------------------------[[ == BASE OBJECTS == ]]----------------------------------------------------
 
 local module = {
@@ -16,74 +18,58 @@ Particles3.__tostring = function(tab) return "{Particles3 (" .. tostring(tab.Max
 
 ----------------------------------------------------[[ == HELPER FUNCTIONS == ]]----------------------------------------------------
 
-local function getVectorInCone(vec, maxAngle)
-	local vecNormal = vector3(vec):setMag(1)
-
+-- number of floats per particle in the instance mesh, see the vertex format in new()
+local INSTANCE_FLOATS = 12
 
-	-- generate random polar and azimuthal angles (whatever that may mean)
-	local theta = math.acos(love.math.random() * (math.cos(maxAngle) - 1) + 1) -- constrain to cone
-	local phi = math.random() * 2 * math.pi
+-- width of the state canvases of emitters that collide with the scene. The particle in slot i is stored at texel ((i-1) % STATE_WIDTH, (i-1) / STATE_WIDTH)
+local STATE_WIDTH = 256
 
-	-- convert spherical coordinates to Cartesian coordinates
-	local randomVector = vector3(
-		math.sin(theta) * math.cos(phi),
-		math.sin(theta) * math.sin(phi),
-		math.cos(theta)
-	)
 
-	---------
 
-
-	-- align the random vector with the base vector
-	local up = vector3(0, 0, 1)
-	if math.abs(vecNormal.z) > 0.999 then -- Handle near-vertical vectors
-		up = vector3(1, 0, 0)
+-- returns two unit vectors that are perpendicular to the given direction and to each other, as 6 numbers
+-- emitting uses these to place particles on a disc around the source without creating vectors for each particle
+local function getPerpendicularBasis(dx, dy, dz)
+	local ax, ay, az = 1, 0, 0
+	if math.abs(dx) > 0.9 then
+		ax, ay, az = 0, 1, 0
 	end
-
-	-- Compute a rotation matrix
-	local right = vector3(
-		up.y * vecNormal.z - up.z * vecNormal.y,
-		up.z * vecNormal.x - up.x * vecNormal.z,
-		up.x * vecNormal.y - up.y * vecNormal.x
-	)
-	right:setMag(1)
-	local upAligned = vector3(
-		vecNormal.y * right.z - vecNormal.z * right.y,
-		vecNormal.z * right.x - vecNormal.x * right.z,
-		vecNormal.x * right.y - vecNormal.y * right.x
-	)
-
-	-- apply rotation matrix to random vector
-	local newRandomVector = vector3(
-		randomVector.x * right.x + randomVector.y * upAligned.x + randomVector.z * vecNormal.x,
-		randomVector.x * right.y + randomVector.y * upAligned.y + randomVector.z * vecNormal.y,
-		randomVector.x * right.z + randomVector.y * upAligned.z + randomVector.z * vecNormal.z
-	)
-	newRandomVector:setMag(1)
-
-	return newRandomVector
+	-- first = direction x arbitrary vector
+	local px, py, pz = dy * az - dz * ay, dz * ax - dx * az, dx * ay - dy * ax
+	local mag = math.sqrt(px * px + py * py + pz * pz)
+	px, py, pz = px / mag, py / mag, pz / mag
+	-- second = direction x first
+	local qx, qy, qz = dy * pz - dz * py, dz * px - dx * pz, dx * py - dy * px
+	mag = math.sqrt(qx * qx + qy * qy + qz * qz)
+	return px, py, pz, qx / mag, qy / mag, qz / mag
 end
 
 
 
-local function getRandomPerpendicularVector(vec)
-	if vec:getMag() == 0 then
-		return vector3.random()
+-- returns the 'right' and 'up' axes used to rotate a random vector in a cone around the z-axis onto the given (unit) direction, as 6 numbers
+local function getConeBasis(nx, ny, nz)
+	local ux, uy, uz = 0, 0, 1
+	if math.abs(nz) > 0.999 then -- Handle near-vertical vectors
+		ux, uy, uz = 1, 0, 0
 	end
+	local rx, ry, rz = uy * nz - uz * ny, uz * nx - ux * nz, ux * ny - uy * nx
+	local mag = math.sqrt(rx * rx + ry * ry + rz * rz)
+	rx, ry, rz = rx / mag, ry / mag, rz / mag
+	return rx, ry, rz, ny * rz - nz * ry, nz * rx - nx * rz, nx * ry - ny * rx
+end
 
-	local arbitraryVector = (math.abs(vec.x) > 0.9 and vector3.new(0, 1, 0) or vector3.new(1, 0, 0))
-	local perpendicular = vec:cross(arbitraryVector):norm()
-	local perpendicular2 = vec:cross(perpendicular):norm()
-	local angle = love.math.random() * 2 * math.pi
 
-	local randomVector = perpendicular * math.cos(angle) + perpendicular2 * math.sin(angle)
 
-	return randomVector
+-- clears the moves and redirects that were made since the last simulation step of a colliding emitter, once they have been sent to the shader
+local function resetPendingTransform(Simulation)
+	local Offset, Rotation = Simulation.Offset, Simulation.Rotation
+	Offset[1], Offset[2], Offset[3] = 0, 0, 0
+	Rotation[1][1], Rotation[1][2], Rotation[1][3] = 1, 0, 0
+	Rotation[2][1], Rotation[2][2], Rotation[2][3] = 0, 1, 0
+	Rotation[3][1], Rotation[3][2], Rotation[3][3] = 0, 0, 1
 end
 
 
 
-
 local function redirectVectors(vecs, dirA, dirB)
 	local rotMatrix = matrix3.fromRodrigues(dirA, dirB)
 
@@ -112,7 +98,7 @@ function Particles3:move(x, y, z)
 	-- for each vertex in the instance mesh, offset the instPosition by the given amount, essentially shifting all active & inactive particles at once
 	local offset = vector3.isVector3(x) and x or vector3(x, y, z)
 	local newSource = self.Source + offset
-	for i = 1, self.MaxParticles do
+	for i = 1, self.HighWater do -- slots past the high water mark hold no live particles
 		self.MatricesData[i][1] = self.MatricesData[i][1] + offset.x -- gotta work with offsets relative to particle and not relative to source!
 		self.MatricesData[i][2] = self.MatricesData[i][2] + offset.y
 		self.MatricesData[i][3] = self.MatricesData[i][3] + offset.z
@@ -124,6 +110,12 @@ function Particles3:move(x, y, z)
 		)
 	end
 
+	-- particles that collide with the scene are drawn from their state, which is moved by the next simulation step
+	if self.Simulation ~= nil then
+		local Offset = self.Simulation.Offset
+		Offset[1], Offset[2], Offset[3] = Offset[1] + offset.x, Offset[2] + offset.y, Offset[3] + offset.z
+	end
+
 	-- update all vertices at once using the local data copy
 	self.Source = newSource
 end
@@ -144,14 +136,26 @@ function Particles3:redirect(x, y, z)
 	
 	-- get array of all velocities to redirect
 	local arr = {}
-	for i = 1, #self.MatricesData do
+	for i = 1, self.HighWater do
 		arr[i] = vector3(self.MatricesData[i][4], self.MatricesData[i][5], self.MatricesData[i][6])
 	end
 
 	arr = redirectVectors(arr, vector3(self.Direction):norm(), newDirection)
 
+	-- particles that collide with the scene are drawn from their state, which is rotated by the next simulation step
+	if self.Simulation ~= nil then
+		local m = matrix3.fromRodrigues(vector3(self.Direction):norm(), newDirection)
+		local R = self.Simulation.Rotation
+		for i = 1, 3 do
+			local a, b, c = R[1][i], R[2][i], R[3][i]
+			R[1][i] = m[1] * a + m[2] * b + m[3] * c
+			R[2][i] = m[4] * a + m[5] * b + m[6] * c
+			R[3][i] = m[7] * a + m[8] * b + m[9] * c
+		end
+	end
+
 	-- for some reason calling setVertexAttribute() on each particle is faster than calling setVertices() once with all updated data
-	for i = 1, #self.MatricesData do
+	for i = 1, #arr do
 		self.MatricesData[i][4] = arr[i].x
 		self.MatricesData[i][5] = arr[i].y
 		self.MatricesData[i][6] = arr[i].z
@@ -167,20 +171,14 @@ end
 
 
 
+-- emitting creates no tables or vectors, so that large bursts do not cause garbage collection hitches
+-- the particle data is written into a preallocated byte buffer, which is uploaded with one setVertices() call for each run of consecutive slots
 function Particles3:emit(count)
 	if count <= 0 then return end
-	count = math.min(count, self.MaxParticles) -- limiting is required to ensure you only wrap around the pool at most once, otherwise the for-loop below breaks
+	count = math.min(count, self.MaxParticles) -- the staging buffer holds at most one particle per slot in the pool
 
 	local emittedAt = love.timer.getTime()
 
-	local lifetime
-	local velocity
-	local rotation
-	local rotationSpeed
-	local scaleOffset
-	local offsetVector
-	local position
-
 	local facingMode = 0
 	if self.FacesCamera and self.FacesVelocity then
 		facingMode = 0.75
@@ -190,60 +188,275 @@ function Particles3:emit(count)
 		facingMode = 0.5
 	end
 
-	
+	-- everything that is the same for each particle is calculated once
+	local dx, dy, dz = self.Direction.x, self.Direction.y, self.Direction.z
+	local dirMag = math.sqrt(dx * dx + dy * dy + dz * dz)
+	local px, py, pz, qx, qy, qz = 0, 0, 0, 0, 0, 0
+	local rx, ry, rz, ux, uy, uz = 1, 0, 0, 0, 1, 0
+	local nx, ny, nz = 0, 0, 1
+	if dirMag > 0 then
+		nx, ny, nz = dx / dirMag, dy / dirMag, dz / dirMag
+		px, py, pz, qx, qy, qz = getPerpendicularBasis(dx, dy, dz)
+		rx, ry, rz, ux, uy, uz = getConeBasis(nx, ny, nz)
+	end
+	local minRadiusSq = self.SpawnRadius.min^2
+	local radiusRangeSq = self.SpawnRadius.max^2 - minRadiusSq
+	local cosDeviation = math.cos(self.DirectionDeviation)
+	local isLine = line3.isLine3(self.Source)
+	local sx, sy, sz, lx, ly, lz
+	if isLine then
+		sx, sy, sz = self.Source.from.x, self.Source.from.y, self.Source.from.z
+		lx, ly, lz = self.Source.to.x - sx, self.Source.to.y - sy, self.Source.to.z - sz
+	else
+		sx, sy, sz = self.Source.x, self.Source.y, self.Source.z
+	end
 
-	local cache = {}
+	-- once every particle has died the pool starts over at the first slot, so that only the slots at the start of the pool are drawn
+	if emittedAt >= self.LastDeath then
+		self.SpawnIndex = 1
+		self.HighWater = 0
+	end
+
+	local deaths = self.DeathTimes
+	local staging = self.StagingPointer
+	local staged = 0 -- number of particles in the staging buffer
+	local stagedStart = self.SpawnIndex
+	local slot, offset, radius, angle, ox, oy, oz, x, y, z, t, theta, phi, sinTheta, cx, cy, cz, speed, lifetime, Matrix
 
 	for i = 1, count do
 
-		-- calculate new instance properties
-		offsetVector = getRandomPerpendicularVector(self.Direction) * math.sqrt(love.math.random() * (self.SpawnRadius.max^2 - self.SpawnRadius.min^2) + self.SpawnRadius.min^2)
-		if line3.isLine3(self.Source) then
-			position = self.Source.from + love.math.random() * (self.Source.to - self.Source.from) + offsetVector
+		-- pick the slot. Normally this is the next slot in the pool, but live particles are skipped by claiming a slot past the high water mark instead,
+		-- and once the oldest particle (in the first slot) has died the pool wraps around early so that the range of slots in use stays small
+		slot = self.SpawnIndex
+		if slot > self.HighWater then
+			if self.HighWater > 0 and deaths[1] <= emittedAt then
+				slot = 1
+			end
+		elseif deaths[slot] > emittedAt and self.HighWater < self.MaxParticles then
+			slot = self.HighWater + 1
+		end
+
+		-- upload the staged data so far if the slot does not follow the previous one
+		if slot ~= stagedStart + staged then
+			if staged > 0 then
+				self.Instances:setVertices(self.Staging, stagedStart, staged)
+				staged = 0
+			end
+			stagedStart = slot
+		end
+
+		-- random point on a disc (or ring) around the source, perpendicular to the emit direction
+		radius = math.sqrt(love.math.random() * radiusRangeSq + minRadiusSq)
+		if dirMag > 0 then
+			angle = love.math.random() * 2 * math.pi
+			cx, cy = math.cos(angle) * radius, math.sin(angle) * radius
+			ox, oy, oz = px * cx + qx * cy, py * cx + qy * cy, pz * cx + qz * cy
+		else -- no direction, so any direction will do
+			z = love.math.random() * 2 - 1
+			angle = love.math.random() * 2 * math.pi
+			t = math.sqrt(1 - z * z)
+			ox, oy, oz = t * math.cos(angle) * radius, t * math.sin(angle) * radius, z * radius
+		end
+		if isLine then
+			t = love.math.random()
+			x, y, z = sx + lx * t + ox, sy + ly * t + oy, sz + lz * t + oz
 		else
-			position = self.Source + offsetVector
+			x, y, z = sx + ox, sy + oy, sz + oz
 		end
+
+		-- random direction within a cone around the emit direction
+		theta = math.acos(love.math.random() * (cosDeviation - 1) + 1)
+		phi = love.math.random() * 2 * math.pi
+		sinTheta = math.sin(theta)
+		cx, cy, cz = sinTheta * math.cos(phi), sinTheta * math.sin(phi), math.cos(theta)
+		speed = self.Speed:randomDecimal()
 		lifetime = self.Lifetime:randomDecimal()
-		velocity = getVectorInCone(self.Direction, self.DirectionDeviation) * self.Speed:randomDecimal()
-		rotation = self.Rotation:randomDecimal()
-		rotationSpeed = self.RotationSpeed:randomDecimal()
-		scaleOffset = (love.math.random() - 0.5) * 2
 
+		-- write the particle into the staging buffer, in the same order as the vertex format of the instance mesh
+		offset = staged * INSTANCE_FLOATS
+		staging[offset] = x
+		staging[offset + 1] = y
+		staging[offset + 2] = z
+		staging[offset + 3] = emittedAt
+		staging[offset + 4] = lifetime
+		staging[offset + 5] = (cx * rx + cy * ux + cz * nx) * speed
+		staging[offset + 6] = (cx * ry + cy * uy + cz * ny) * speed
+		staging[offset + 7] = (cx * rz + cy * uz + cz * nz) * speed
+		staging[offset + 8] = self.Rotation:randomDecimal()
+		staging[offset + 9] = self.RotationSpeed:randomDecimal()
+		staging[offset + 10] = (love.math.random() - 0.5) * 2
+		staging[offset + 11] = facingMode
+		staged = staged + 1
+
+		-- keep a local copy of the position and velocity for :move() and :redirect()
+		Matrix = self.MatricesData[slot]
+		Matrix[1], Matrix[2], Matrix[3] = x, y, z
+		Matrix[4], Matrix[5], Matrix[6] = staging[offset + 5], staging[offset + 6], staging[offset + 7]
+
+		deaths[slot] = emittedAt + lifetime
+		if deaths[slot] > self.LastDeath then
+			self.LastDeath = deaths[slot]
+		end
+		if slot > self.HighWater then
+			self.HighWater = slot
+		end
+
+		self.SpawnIndex = (slot % self.MaxParticles) + 1
+	end
+
+	-- upload the (remaining) staged particles
+	if staged > 0 then
+		self.Instances:setVertices(self.Staging, stagedStart, staged)
+	end
+end
+
+
+
+-- returns true if any particle emitted by this emitter is still alive
+function Particles3:hasLiveParticles(time)
+	return (time or love.timer.getTime()) < self.LastDeath
+end
 
-		-- compile particle data
-		self.MatricesData[self.SpawnIndex] = {position.x, position.y, position.z, velocity.x, velocity.y, velocity.z}
-		table.insert(
-			cache,
-			{position.x, position.y, position.z, emittedAt, lifetime, velocity.x, velocity.y, velocity.z, rotation, rotationSpeed, scaleOffset, facingMode}
-		)
 
 
-		-- batch-update data (so far) if you're wrapping around the pool
-		self.SpawnIndex = (self.SpawnIndex % self.MaxParticles) + 1
-		if self.SpawnIndex == 1 then
-			self.Instances:setVertices(cache, self.MaxParticles - #cache + 1, #cache)
-			cache = {}
+-- makes particles collide with the scene instead of passing through it. 'mode' is "bounce", "die" or nil to turn collision off again
+-- colliding particles are stepped each frame on the GPU, with their position and velocity kept in a pair of float canvases that are swapped every step
+-- they collide with the depth canvas of the scene, unless a heightfield is set with Particles3:setHeightfield(). Since the depth canvas only holds what the
+-- camera sees, particles that are hidden or off-screen do not collide with anything. 'bounciness' is the fraction of speed kept when bouncing off something
+function Particles3:setCollision(mode, bounciness)
+	assert(mode == nil or mode == "bounce" or mode == "die", "Particles3:setCollision(mode, bounciness) requires argument 'mode' to be \"bounce\", \"die\" or nil.")
+	self.Collision = mode
+	self.Bounciness = bounciness or self.Bounciness
+
+	if mode == nil then
+		if self.Simulation ~= nil then
+			for i = 1, 2 do
+				self.Simulation.States[i][1]:release()
+				self.Simulation.States[i][2]:release()
+			end
+			self.Simulation.Points:release()
+			self.Simulation = nil
 		end
+		return
+	end
+	if self.Simulation ~= nil then
+		return
 	end
 
-	-- batch-update particles using (remaining) data in the cache
-	if #cache > 0 then
-		self.Instances:setVertices(cache, self.SpawnIndex - #cache, #cache)
+	local width = math.min(self.MaxParticles, STATE_WIDTH)
+	local height = math.ceil(self.MaxParticles / width)
+	local states = {}
+	for i = 1, 2 do
+		states[i] = {}
+		for j = 1, 2 do
+			states[i][j] = love.graphics.newCanvas(width, height, {["format"] = "rgba32f"})
+			states[i][j]:setFilter("nearest", "nearest")
+		end
+	end
+
+	-- one point per particle, placed on the center of its texel. The emit data of each particle is attached from the instance mesh
+	local vertices = {}
+	for i = 1, self.MaxParticles do
+		vertices[i] = {(i - 1) % width + 0.5, math.floor((i - 1) / width) + 0.5}
 	end
+	local points = love.graphics.newMesh({{"VertexPosition", "float", 2}}, vertices, "points", "static")
+	points:attachAttribute("instPosition", self.Instances)
+	points:attachAttribute("instEmittedAt", self.Instances)
+	points:attachAttribute("instVelocity", self.Instances)
+
+	self.Simulation = {
+		["States"] = states; -- two pairs of {positions, velocities} canvases
+		["Current"] = 1; -- index of the pair that holds the latest state
+		["Width"] = width;
+		["Points"] = points;
+		["LastStep"] = love.timer.getTime();
+		["Offset"] = {0, 0, 0}; -- moves and redirects since the last step, applied to the state by the next step
+		["Rotation"] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}; -- rows
+	}
+end
+
+
+
+-- makes colliding particles collide with a heightfield instead of the depth canvas of the scene, which also works for particles the camera cannot see
+-- 'image' holds the heights in its red channel and covers the area from 'corner' to 'corner + size' (both vector2). A value of 0 is at the minimum height
+-- of 'heights' (a range) and 1 at its maximum. Call without arguments to collide with the depth canvas again
+function Particles3:setHeightfield(image, corner, size, heights)
+	if image == nil then
+		self.Heightfield = nil
+		return
+	end
+	assert(type(image) == "userdata" and image.typeOf ~= nil and image:typeOf("Texture"), "Particles3:setHeightfield(image, corner, size, heights) requires argument 'image' to be nil or a texture.")
+	assert(vector2.isVector2(corner) and vector2.isVector2(size), "Particles3:setHeightfield(image, corner, size, heights) requires arguments 'corner' and 'size' to be vector2s.")
+	assert(range.isRange(heights), "Particles3:setHeightfield(image, corner, size, heights) requires argument 'heights' to be a range.")
+	self.Heightfield = {
+		["Image"] = image;
+		["Bounds"] = {corner.x, corner.y, size.x, size.y};
+		["Range"] = {heights.min, heights.max};
+	}
+end
+
+
+
+-- steps the state of colliding particles to the current time. This assumes the simulation shader is already set - which is done in scene3
+function Particles3:simulate(shaderRef)
+	local Simulation = self.Simulation
+	local time = love.timer.getTime()
+	local dt = math.min(time - Simulation.LastStep, 0.1) -- long hitches would otherwise move particles straight through thin geometry
+	Simulation.LastStep = time
+	if not self:hasLiveParticles(time) then
+		resetPendingTransform(Simulation)
+		return
+	end
+
+	local source = Simulation.States[Simulation.Current]
+	Simulation.Current = 3 - Simulation.Current
+	shaderRef:send("statePositions", source[1])
+	shaderRef:send("stateVelocities", source[2])
+	shaderRef:send("gravity", {self.Gravity.x, self.Gravity.y, self.Gravity.z})
+	shaderRef:send("currentTime", time)
+	shaderRef:send("deltaTime", dt)
+	shaderRef:send("drag", self.Drag)
+	shaderRef:send("stateOffset", Simulation.Offset)
+	shaderRef:send("stateRotation", "row", Simulation.Rotation)
+	resetPendingTransform(Simulation)
+	if self.Collision == "bounce" then
+		shaderRef:send("bounciness", self.Bounciness)
+	end
+	if self.Heightfield ~= nil then
+		shaderRef:send("heightfield", self.Heightfield.Image)
+		shaderRef:send("heightfieldBounds", self.Heightfield.Bounds)
+		shaderRef:send("heightfieldRange", self.Heightfield.Range)
+	else
+		shaderRef:send("collisionThickness", self.CollisionThickness)
+	end
+
+	love.graphics.setCanvas(Simulation.States[Simulation.Current])
+	Simulation.Points:setDrawRange(1, self.HighWater) -- same as when drawing, slots past the high water mark hold no live particles
+	love.graphics.draw(Simulation.Points)
 end
 
 
 
 -- this assumes the correct shader is already set - which is done in scene3
 function Particles3:draw(shaderRef)
+	local time = love.timer.getTime()
+	if not self:hasLiveParticles(time) then
+		return
+	end
 	shaderRef:send("dataTexture", self.DataTexture)
 	shaderRef:send("gravity", {self.Gravity.x, self.Gravity.y, self.Gravity.z})
-	shaderRef:send("currentTime", love.timer.getTime())
+	shaderRef:send("currentTime", time)
 	shaderRef:send("drag", self.Drag)
 	shaderRef:send("brightness", self.Brightness)
 	shaderRef:send("zOffset", self.ZOffset)
 	shaderRef:send("flipbookData", {self.FlipbookSize, self.FlipbookFrames}) -- pack into vec2 to reduce send calls I guess
-	love.graphics.drawInstanced(self.Mesh, self.MaxParticles) -- draw all the particles, but in practice most of them will be drawn at a scale of 0 because they're inactive
+	if self.Simulation ~= nil then
+		local state = self.Simulation.States[self.Simulation.Current]
+		shaderRef:send("statePositions", state[1])
+		shaderRef:send("stateVelocities", state[2])
+		shaderRef:send("stateWidth", self.Simulation.Width)
+	end
+	love.graphics.drawInstanced(self.Mesh, self.HighWater) -- live particles are always in the first HighWater slots. Dead ones in between are drawn at a scale of 0
 end
 
 
@@ -332,9 +545,11 @@ local function new(img, maxParticles, properties)
 	-- dummy data, will be updated automatically when :emit() is called
 	local instancesData = {}
 	local matricesData = {}
+	local deathTimes = {}
 	for i = 1, maxParticles do
 		instancesData[i] = {0, 0, 0, -9999, 0, 0, 0, 0, 0, 0, 0}
 		matricesData[i] = {0, 0, 0, 0, 0, 0}
+		deathTimes[i] = -math.huge
 	end
 
 	-- create instance mesh
@@ -354,6 +569,9 @@ local function new(img, maxParticles, properties)
 		"stream"
 	)
 
+	-- staging buffer that Particles3:emit() writes new particles into before uploading them, see INSTANCE_FLOATS
+	local staging = love.data.newByteData(maxParticles * INSTANCE_FLOATS * 4)
+
 	mesh:attachAttribute("instPosition", instanceMesh, "perinstance") -- first vertex attribute
 	mesh:attachAttribute("instEmittedAt", instanceMesh, "perinstance") -- second vertex attribute
 	mesh:attachAttribute("instLifetime", instanceMesh, "perinstance") -- third vertex attribute
@@ -432,13 +650,23 @@ local function new(img, maxParticles, properties)
 		["Brightness"] = brightness;
 		["FlipbookSize"] = fbSize; -- size of the flipbook image. A size of 3 means 9 cells, 4 = 16 cells, 5 = 25 cells etc.
 		["FlipbookFrames"] = fbFrames; -- the number of frames to play during the particle's lifetime
+		["Collision"] = nil; -- nil, "bounce" or "die", see Particles3:setCollision()
+		["Bounciness"] = properties.Bounciness or 0.5;
+		["CollisionThickness"] = properties.CollisionThickness or 1; -- how far behind the depth canvas particles still collide, since anything further back may be a different object
+		["Heightfield"] = nil; -- see Particles3:setHeightfield()
+		["Simulation"] = nil; -- state canvases of colliding particles
 
 		["DataTexture"] = dataTexture; -- contains curves encoded into an image for faster look-ups on the GPU
 		["SpawnIndex"] = 1; -- counter that keeps track of how many particles have spawned so it knows which particles are next up in the pool to emit
+		["HighWater"] = 0; -- number of slots at the start of the pool that may hold live particles, only these instances are drawn
+		["DeathTimes"] = deathTimes; -- the time at which the particle in each slot dies
+		["LastDeath"] = -math.huge; -- the time at which the last live particle dies. Emitters without live particles are not drawn at all
 		["MaxParticles"] = maxParticles; -- maximum number of particles that can be emitted. Cannot be changed as it's tied to the mesh instancing logic
 
 		["Mesh"] = mesh;
 		["Instances"] = instanceMesh;
+		["Staging"] = staging;
+		["StagingPointer"] = ffi.cast("float*", staging:getFFIPointer());
 		["MatricesData"] = matricesData; -- local copy of particle positions (index 1,2,3) and velocity (index 4,5,6) to-be-used in :move() and :redirect()
 		["Scene"] = nil;
 	}
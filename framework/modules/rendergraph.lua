@@ -0,0 +1,348 @@
+
+local module = {}
+
+--[[
+
+A small render graph for chains of full-screen passes, such as the post-processing in Scene3.
+
+Each pass declares the resources it reads and the resources it draws to. A resource is either an imported canvas that lives outside of the
+graph (like a scene's render canvas) or a transient canvas that only exists while the graph is being executed. When a graph is executed:
+- passes whose condition fails are culled, and so are passes that read a transient resource that no earlier pass wrote to
+- passes that only write to transient resources that are never read afterwards (and are not marked as output) are culled as well
+- transient canvases are taken from a pool right before the first pass that uses them and handed back right after the last pass that uses
+  them. Resources whose lifetimes don't overlap share the same canvas when they have the same size and format (aliasing)
+- the canvas is only switched when a pass draws to different targets than the pass before it
+
+A pool can be shared by multiple graphs. Canvases that have not been used for a number of frames are released to free up video memory.
+
+]]
+
+
+
+----------------------------------------------------[[ == BASE OBJECTS == ]]----------------------------------------------------
+
+local RenderGraph = {}
+RenderGraph.__index = RenderGraph
+
+local CanvasPool = {}
+CanvasPool.__index = CanvasPool
+
+
+
+----------------------------------------------------[[ == HELPERS == ]]----------------------------------------------------
+
+local function getPoolKey(width, height, format, filter)
+	return width .. "x" .. height .. ":" .. format .. ":" .. filter
+end
+
+
+
+-- returns true if the pass draws to exactly the same canvases as the targets that are currently set
+local function sameTargets(targets, pass)
+	if targets == nil or #targets ~= #pass.Targets or targets.depthstencil ~= pass.Targets.depthstencil then
+		return false
+	end
+	for i = 1, #targets do
+		if targets[i] ~= pass.Targets[i] then
+			return false
+		end
+	end
+	return true
+end
+
+
+
+----------------------------------------------------[[ == OBJECT CREATION == ]]----------------------------------------------------
+
+local function newPool()
+	local Object = {
+		["Free"] = {}; -- [key] = array of canvases that are not in use
+		["Keys"] = {}; -- [canvas] = key
+		["LastUsed"] = {}; -- [canvas] = frame in which the canvas was last handed out
+		["Frame"] = 0;
+		["Count"] = 0; -- number of canvases owned by the pool, both in use and free
+	}
+	return setmetatable(Object, CanvasPool)
+end
+
+
+
+local function new(pool)
+	assert(pool == nil or getmetatable(pool) == CanvasPool, "rendergraph.new(pool) requires argument 'pool' to be nil or a canvas pool.")
+	local Object = {
+		["Pool"] = pool or newPool();
+		["Passes"] = {};
+		["Resources"] = {}; -- [name] = {Canvas, Imported, Width, Height, Format, Filter, Output}
+		["Executed"] = 0; -- number of passes that were not culled during the last execution
+
+		-- scratch tables that are cleared and reused every execution
+		["Written"] = {};
+		["Needed"] = {};
+		["LastUse"] = {};
+	}
+	return setmetatable(Object, RenderGraph)
+end
+
+
+
+----------------------------------------------------[[ == POOL METHODS == ]]----------------------------------------------------
+
+-- returns a canvas of the given size and format that is not in use, creating one if there are none
+function CanvasPool:acquire(width, height, format, filter)
+	width, height = math.floor(width), math.floor(height)
+	if format == nil then format = "normal" end
+	if filter == nil then filter = "linear" end
+	local key = getPoolKey(width, height, format, filter)
+	local free = self.Free[key]
+	local canvas
+	if free ~= nil and #free > 0 then
+		canvas = table.remove(free)
+	else
+		canvas = love.graphics.newCanvas(width, height, {["format"] = format; ["readable"] = true;})
+		canvas:setFilter(filter)
+		self.Keys[canvas] = key
+		self.Count = self.Count + 1
+	end
+	self.LastUsed[canvas] = self.Frame
+	return canvas
+end
+
+
+
+-- hands a canvas from CanvasPool:acquire() back so that it can be reused
+function CanvasPool:release(canvas)
+	local key = self.Keys[canvas]
+	if self.Free[key] == nil then
+		self.Free[key] = {}
+	end
+	table.insert(self.Free[key], canvas)
+end
+
+
+
+-- starts a new frame and releases any free canvases that have not been used in the last 'maxIdleFrames' frames
+function CanvasPool:nextFrame(maxIdleFrames)
+	self.Frame = self.Frame + 1
+	for key, free in pairs(self.Free) do
+		for i = #free, 1, -1 do
+			if self.Frame - self.LastUsed[free[i]] > maxIdleFrames then
+				local canvas = table.remove(free, i)
+				self.Keys[canvas] = nil
+				self.LastUsed[canvas] = nil
+				self.Count = self.Count - 1
+				canvas:release()
+			end
+		end
+	end
+end
+
+
+
+-- releases all free canvases, for example after the screen was resized
+function CanvasPool:clear()
+	for key, free in pairs(self.Free) do
+		for i = #free, 1, -1 do
+			self.Keys[free[i]] = nil
+			self.LastUsed[free[i]] = nil
+			self.Count = self.Count - 1
+			free[i]:release()
+			free[i] = nil
+		end
+	end
+end
+
+
+
+----------------------------------------------------[[ == GRAPH METHODS == ]]----------------------------------------------------
+
+local function isRenderGraph(t)
+	return getmetatable(t) == RenderGraph
+end
+
+
+
+-- adds a canvas that lives outside of the graph. Writing to an imported resource always counts as useful work, so such passes are never culled
+function RenderGraph:import(name, canvas)
+	local Resource = self.Resources[name]
+	if Resource == nil then
+		Resource = {}
+		self.Resources[name] = Resource
+	end
+	Resource.Imported = true
+	Resource.Canvas = canvas
+end
+
+
+
+-- declares a transient canvas that is taken from the pool while it is in use. Calling this again updates the size and format
+function RenderGraph:create(name, width, height, format, filter)
+	local Resource = self.Resources[name]
+	if Resource == nil then
+		Resource = {}
+		self.Resources[name] = Resource
+	end
+	Resource.Imported = false
+	Resource.Width = width
+	Resource.Height = height
+	Resource.Format = format or "normal"
+	Resource.Filter = filter or "linear"
+end
+
+
+
+-- marks a transient resource as output, so that it stays alive after executing until RenderGraph:finish() is called
+function RenderGraph:setOutput(name, state)
+	self.Resources[name].Output = (state ~= false)
+end
+
+
+
+-- adds a pass, which is executed in the order the passes were added
+-- 'reads' is an array of resource names. 'writes' is an array of resource names that are set as canvas, with an optional 'depthstencil' key
+-- 'func' is called with the arguments passed to RenderGraph:execute() and draws the pass. 'condition' is an optional function that gets the same
+-- arguments and returns false to cull the pass
+function RenderGraph:addPass(name, reads, writes, func, condition)
+	local Pass = {
+		["Name"] = name;
+		["Reads"] = reads;
+		["Writes"] = writes;
+		["Func"] = func;
+		["Condition"] = condition;
+		["Targets"] = {}; -- reused every frame as the argument to love.graphics.setCanvas()
+		["Keep"] = false;
+	}
+	table.insert(self.Passes, Pass)
+	return Pass
+end
+
+
+
+-- returns the canvas of a resource, or nil if it is a transient resource that is not alive right now
+function RenderGraph:get(name)
+	return self.Resources[name].Canvas
+end
+
+
+
+-- culls passes, assigns canvases from the pool and runs the passes that are left. Returns the number of passes that were executed
+function RenderGraph:execute(...)
+	local Passes = self.Passes
+	local Resources = self.Resources
+
+	local written, needed, lastUse = self.Written, self.Needed, self.LastUse
+	for name in pairs(Resources) do
+		written[name], needed[name], lastUse[name] = nil, nil, nil
+	end
+
+	-- forward: a pass runs if its condition passes and every transient resource it reads was written by an earlier pass
+	for i = 1, #Passes do
+		local Pass = Passes[i]
+		Pass.Keep = Pass.Condition == nil or Pass.Condition(...) ~= false
+		if Pass.Keep then
+			for j = 1, #Pass.Reads do
+				if not Resources[Pass.Reads[j]].Imported and not written[Pass.Reads[j]] then
+					Pass.Keep = false
+					break
+				end
+			end
+		end
+		if Pass.Keep then
+			for j = 1, #Pass.Writes do
+				written[Pass.Writes[j]] = true
+			end
+		end
+	end
+
+	-- backward: a pass is culled if nothing after it uses what it draws
+	for i = #Passes, 1, -1 do
+		local Pass = Passes[i]
+		if Pass.Keep then
+			local useful = false
+			for j = 1, #Pass.Writes do
+				local Resource = Resources[Pass.Writes[j]]
+				if Resource.Imported or Resource.Output or needed[Pass.Writes[j]] then
+					useful = true
+					break
+				end
+			end
+			Pass.Keep = useful
+			if useful then
+				for j = 1, #Pass.Reads do
+					needed[Pass.Reads[j]] = true
+				end
+			end
+		end
+	end
+
+	-- lifetimes: the index of the last pass that uses each transient resource
+	for i = 1, #Passes do
+		local Pass = Passes[i]
+		if Pass.Keep then
+			for j = 1, #Pass.Reads do
+				lastUse[Pass.Reads[j]] = i
+			end
+			for j = 1, #Pass.Writes do
+				lastUse[Pass.Writes[j]] = i
+			end
+		end
+	end
+
+	-- run the passes, handing canvases back to the pool as soon as their last pass is done with them
+	local Pool = self.Pool
+	local targets = nil
+	self.Executed = 0
+	for i = 1, #Passes do
+		local Pass = Passes[i]
+		if Pass.Keep then
+			local Targets = Pass.Targets
+			for j = 1, #Pass.Writes do
+				local Resource = Resources[Pass.Writes[j]]
+				if Resource.Canvas == nil then
+					Resource.Canvas = Pool:acquire(Resource.Width, Resource.Height, Resource.Format, Resource.Filter)
+				end
+				Targets[j] = Resource.Canvas
+			end
+			Targets.depthstencil = Pass.Writes.depthstencil and Resources[Pass.Writes.depthstencil].Canvas or nil
+
+			if not sameTargets(targets, Pass) then
+				love.graphics.setCanvas(Targets)
+				targets = Targets
+			end
+			profiler:pushLabel(Pass.Name)
+			Pass.Func(...)
+			profiler:popLabel()
+			self.Executed = self.Executed + 1
+
+			for name, index in pairs(lastUse) do
+				local Resource = Resources[name]
+				if index == i and not Resource.Imported and not Resource.Output then
+					Pool:release(Resource.Canvas)
+					Resource.Canvas = nil
+				end
+			end
+		end
+	end
+
+	return self.Executed
+end
+
+
+
+-- hands the canvases of output resources back to the pool. Call this once the outputs of the last RenderGraph:execute() are no longer needed
+function RenderGraph:finish()
+	for name, Resource in pairs(self.Resources) do
+		if not Resource.Imported and Resource.Canvas ~= nil then
+			self.Pool:release(Resource.Canvas)
+			Resource.Canvas = nil
+		end
+	end
+end
+
+
+
+----------------------------------------------------[[ == RETURN == ]]----------------------------------------------------
+
+module.new = new
+module.newPool = newPool
+module.isRenderGraph = isRenderGraph
+return setmetatable(module, {__call = function(_, ...) return new(...) end})
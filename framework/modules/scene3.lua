@@ -6,8 +6,6 @@ local connection = require("framework.connection")
 --[[
 
 3d graphics features wishlist:
-- frustum culling
-- deferred point lights
 - colored fog: starting distance, color and thickness & ending distance, color and thickness
 ]]
 
@@ -25,10 +23,15 @@ local SHADER_PLANTVERT_PATH = "framework/shaders/plantvert.c"
 local SHADER_PLANTFRAG_PATH = "framework/shaders/plantfrag.c"
 local SHADER_PARTICLES_VERT = "framework/shaders/particlesvert.c"
 local SHADER_PARTICLES_FRAG = "framework/shaders/particlesfrag.c"
+local SHADER_PARTICLE_SIM_PATH = "framework/shaders/particlesim.c"
 local SHADER_SSAO_PATH = "framework/shaders/ssao3d.c"
 local SHADER_SSAOBLEND_PATH = "framework/shaders/ssaoblend.c"
 local SHADER_AOBLUR_PATH = "framework/shaders/aoblur.c"
-local SHADER_BLOOMBLUR_PATH = "framework/shaders/bloomblur.c"
+local SHADER_AODOWNSAMPLE_PATH = "framework/shaders/aodownsample.c"
+local SHADER_AOUPSAMPLE_PATH = "framework/shaders/aoupsample.c"
+local SHADER_AOTEMPORAL_PATH = "framework/shaders/aotemporal.c"
+local SHADER_BLOOMDOWN_PATH = "framework/shaders/bloomdownsample.c"
+local SHADER_BLOOMUP_PATH = "framework/shaders/bloomupsample.c"
 local SHADER_SHADOWMAP_PATH = "framework/shaders/shadowmap.c"
 local SHADER_TRIVERT_PATH = "framework/shaders/trivert3d.c"
 local SHADER_TRIFRAG_PATH = "framework/shaders/trifrag.c"
@@ -39,6 +42,77 @@ local SHADER_MASK_PATH = "framework/shaders/dither3d.c"
 local SHADER_SILHOUETTE_PATH = "framework/shaders/silhouette.c"
 local SHADER_FXAA_PATH = "framework/shaders/fxaa.c"
 local SHADER_SKYBOX_PATH = "framework/shaders/skybox.c"
+local SHADER_DEFERRED_LIGHT_PATH = "framework/shaders/deferredlight.c"
+local SHADER_HIZ_PATH = "framework/shaders/hizdepth.c"
+local SHADER_SHADOWCOPY_PATH = "framework/shaders/shadowcopy.c"
+
+-- shader permutations, see shadervariants.lua. Instead of switching features with boolean uniforms, each combination of features is its own shader
+-- the variants are picked with a mask, where each feature is the bit of its position in the list
+local MESH_FEATURES = {"INSTANCED", "SPRITESHEET", "OIT"}
+local VFX_FEATURES = {"BLENDS", "SIMULATED"}
+local PARTICLE_SIM_FEATURES = {"HEIGHTFIELD", "DIES"}
+local VARIANT_INSTANCED = 1
+local VARIANT_SPRITESHEET = 2
+local VARIANT_OIT = 4
+local VARIANT_BLENDS = 1
+local VARIANT_SIMULATED = 2
+local VARIANT_HEIGHTFIELD = 1
+local VARIANT_DIES = 2
+
+-- clustered lighting. The camera's view is split into CLUSTER_X by CLUSTER_Y tiles, each split into CLUSTER_Z slices that grow exponentially with depth
+local CLUSTER_X = 16
+local CLUSTER_Y = 8
+local CLUSTER_Z = 24
+local MAX_LIGHTS = 1024 -- width of the light data texture, lights past this number are not drawn
+local LIGHT_INDICES_WIDTH = 1024 -- same as LIGHT_INDICES_WIDTH in the shaders
+local LIGHT_INDICES_HEIGHT = 64 -- the light indices texture can hold LIGHT_INDICES_WIDTH * LIGHT_INDICES_HEIGHT cluster-light pairs
+
+-- masks write this value to the stencil buffer of the depth canvas, and masked meshes are only drawn where the stencil value is different
+-- silhouettes use a second value so that they don't undo the masks. They replace the mask value, so they are drawn after all masked meshes
+local MASK_STENCIL = 1
+local SILHOUETTE_STENCIL = 2
+local MASK_INSTANCE_FORMAT = {
+	{"MaskPosition", "float", 3},
+	{"MaskRadii", "float", 2}, -- inner radius, outer radius
+}
+
+-- billboards are drawn in batches of the same texture, with one instance per billboard
+local BILLBOARD_INSTANCE_FORMAT = {
+	{"BillboardPosition", "float", 4}, -- position, rotation
+	{"BillboardSize", "float", 4}, -- world size, pixel size
+	{"BillboardCenter", "float", 2},
+	{"BillboardColor", "float", 4},
+	{"BillboardUV", "float", 4}, -- offset, size
+}
+
+-- trails are drawn in batches of the same texture and number of segments. Their paths are stored in a texture shared by all trails, see placeTrailPath()
+local TRAIL_INSTANCE_FORMAT = {
+	{"TrailTiming", "float", 4}, -- age, duration, length, path row
+	{"TrailColor", "float", 4},
+	{"TrailStyle", "float", 2}, -- brightness, faces camera
+}
+
+-- occlusion culling. The depth canvas is reduced by 4x4 blocks until it is at most HIZ_MAX_WIDTH pixels wide, which is then read back
+local HIZ_MAX_WIDTH = 128
+local HIZ_MAX_TEXELS = 256 -- objects covering more pixels of the reduced depth buffer than this are not tested, since they are rarely hidden
+local HIZ_LATENCY = 1 -- frames between reducing the depth canvas and reading it back, so the read back does not wait for the GPU to finish the current frame
+local OCCLUDABLE_KEYS = {"InstancedMeshes", "BasicMeshes", "InstancedTrip3", "BasicTrip3"}
+
+-- cascaded shadow maps. The cascades are placed side by side in the shadow canvas, so it is 'count' times as wide as the canvas size given to Scene3:setShadowMap()
+local MAX_SHADOW_CASCADES = 4 -- same as the size of shadowCascadeMatrices in the shaders
+local SHADOW_CASTER_DEPTH = 100 -- how far towards the sun from the center of a cascade shadow casters are still drawn
+local SHADOW_CACHE_STEP = 0.25 -- with the shadow cache, cascades move in steps of this fraction of their radius so that their cached depth stays valid for longer
+local CASCADE_LABELS = {"cascade 1", "cascade 2", "cascade 3", "cascade 4"}
+
+-- transient canvases for post-processing and masks are taken from a pool, see newRenderGraphs(). Pooled canvases that are not used for this many frames are released
+local CANVAS_IDLE_FRAMES = 120
+
+-- ambient occlusion at a lower resolution, see Scene3:setAOResolution(). With accumulation enabled, this fraction of last frame's result is kept
+local AO_HISTORY_WEIGHT = 0.8
+
+-- bloom is blurred by halving the bloom canvas up to this many times and adding the halved canvases back up, see Scene3:setBloom()
+local MAX_BLOOM_LEVELS = 7
+local MIN_BLOOM_SIZE = 8 -- the smallest canvas in the bloom chain is at least this many pixels wide and high
 
 
 
@@ -118,6 +192,18 @@ local dataImage = love.graphics.newImage(dataMap)
 dataImage:setWrap("repeat")
 dataImage:setFilter("nearest")
 
+-- quad drawn once per light in the deferred light pass, the shader places each quad in front of its light
+local lightQuad = love.graphics.newMesh(
+	{
+		{"VertexPosition", "float", 2}
+	},
+	{
+		{-1, -1}, {1, -1}, {1, 1}, {-1, 1}
+	},
+	"fan",
+	"static"
+)
+
 
 
 ----------------------------------------------------[[ == GLOBAL SHADERS == ]]----------------------------------------------------
@@ -142,6 +228,21 @@ local vfxMixShader = love.graphics.newShader(
 )
 
 
+-- resolves order-independent transparency onto the render canvas with regular alpha blending, see Scene3:setOrderIndependentTransparency()
+local oitResolveShader = love.graphics.newShader(
+	[[
+		uniform Image weightCanvas;
+
+		vec4 effect(vec4 color, Image tex, vec2 texture_coords, vec2 screen_coords) {
+			vec4 accumulated = Texel(tex, texture_coords);
+			vec4 weights = Texel(weightCanvas, texture_coords); // r = sum of weights, g = -log of how much of the background is still visible
+			float alpha = 1.0 - exp(-weights.g);
+			return vec4(accumulated.rgb / max(weights.r, 1e-5), alpha);
+		}
+	]]
+)
+
+
 local DEPTH_PASS_FRAG = [[
 	#pragma language glsl3
 	void effect() {
@@ -150,6 +251,16 @@ local DEPTH_PASS_FRAG = [[
 ]]
 
 
+-- draws 2d background images at the far plane, so that with a 'lequal' depth test they only cover pixels that no geometry was drawn to
+local BACKGROUND_VERT = [[
+	#pragma language glsl3
+	vec4 position(mat4 transform_projection, vec4 vertex_position) {
+		vec4 result = transform_projection * vertex_position;
+		return vec4(result.xy, result.w, result.w);
+	}
+]]
+
+
 
 ----------------------------------------------------[[ == HELPERS == ]]----------------------------------------------------
 
@@ -189,361 +300,2632 @@ end
 
 
 
-----------------------------------------------------[[ == FUNCTIONS == ]]----------------------------------------------------
+-- local bounding spheres of love meshes. A single love mesh is usually shared by many mesh3 instances, so it only has to be computed once
+local meshBounds = setmetatable({}, {__mode = "k"})
+-- world bounding spheres of scene objects, these get recomputed whenever the object's Matrix (or instance mesh) has been replaced
+local worldBounds = setmetatable({}, {__mode = "k"})
 
--- check if an object is a scene
-local function isScene3(t)
-	return getmetatable(t) == Scene3
+
+local function getMeshBounds(loveMesh)
+	local bounds = meshBounds[loveMesh]
+	if bounds ~= nil then
+		return bounds[1], bounds[2], bounds[3], bounds[4]
+	end
+
+	-- find where the vertex positions are stored
+	local attributeIndex = 1
+	local format = loveMesh:getVertexFormat()
+	for i = 1, #format do
+		if format[i][1] == "VertexPosition" then
+			attributeIndex = i
+			break
+		end
+	end
+
+	local count = loveMesh:getVertexCount()
+	local minX, minY, minZ = math.huge, math.huge, math.huge
+	local maxX, maxY, maxZ = -math.huge, -math.huge, -math.huge
+	for i = 1, count do
+		local x, y, z = loveMesh:getVertexAttribute(i, attributeIndex)
+		z = z or 0
+		if x < minX then minX = x end
+		if y < minY then minY = y end
+		if z < minZ then minZ = z end
+		if x > maxX then maxX = x end
+		if y > maxY then maxY = y end
+		if z > maxZ then maxZ = z end
+	end
+
+	if count == 0 then
+		meshBounds[loveMesh] = {0, 0, 0, 0}
+		return 0, 0, 0, 0
+	end
+
+	-- center the sphere on the bounding box, then grow it until it fits the vertex furthest away from that center
+	local cx, cy, cz = (minX + maxX) / 2, (minY + maxY) / 2, (minZ + maxZ) / 2
+	local radiusSq = 0
+	for i = 1, count do
+		local x, y, z = loveMesh:getVertexAttribute(i, attributeIndex)
+		z = z or 0
+		local distSq = (x - cx)^2 + (y - cy)^2 + (z - cz)^2
+		if distSq > radiusSq then
+			radiusSq = distSq
+		end
+	end
+
+	local radius = math.sqrt(radiusSq)
+	meshBounds[loveMesh] = {cx, cy, cz, radius}
+	return cx, cy, cz, radius
 end
 
 
 
-function Scene3:applyAmbientOcclusion()
-	local pingCanvas = self.ReuseCanvas1
-	local pongCanvas = self.ReuseCanvas2
+-- transforms a local bounding sphere by a model matrix. The radius is scaled by the largest axis scale so the sphere stays conservative
+local function transformSphere(m, cx, cy, cz, radius)
+	local x = cx * m[1] + cy * m[5] + cz * m[9] + m[13]
+	local y = cx * m[2] + cy * m[6] + cz * m[10] + m[14]
+	local z = cx * m[3] + cy * m[7] + cz * m[11] + m[15]
+	local scaleSq = math.max(m[1]^2 + m[2]^2 + m[3]^2, m[5]^2 + m[6]^2 + m[7]^2, m[9]^2 + m[10]^2 + m[11]^2)
+	return x, y, z, radius * math.sqrt(scaleSq)
+end
 
 
-	-- set ambient occlusion canvas as render target, and draw ambient occlusion data to the AO canvas
-	love.graphics.setCanvas(pingCanvas)
-	love.graphics.setShader(self.SSAOShader)
-	love.graphics.draw(self.DepthCanvas, 0, 0, 0, 1 / self.SSAA, 1 / self.SSAA) -- set the ambient occlusion shader in motion
 
+-- returns the world-space bounding sphere (x, y, z, radius) of a mesh3, trip3, spritemesh3, ripplemesh3 or any of the instanced groups
+local function getWorldBounds(Object)
+	local key = Object.Matrix or Object.InstanceData or Object.Instances
+	local bounds = worldBounds[Object]
+	if bounds ~= nil and bounds[1] == key and bounds[6] == Object.Count and bounds[7] == Object.Version then
+		return bounds[2], bounds[3], bounds[4], bounds[5]
+	end
 
-	
-	-- apply horizontal and vertical gaussian blur in two passes, using the reuse canvas to draw to that, and then back to the ambient occlusion canvas
-	profiler:pushLabel("blur")
-	love.graphics.setCanvas(pongCanvas)
-	love.graphics.setShader(self.AOBlurShader)
-	--self.AOBlurShader:send("depthTexture", self.DepthCanvas)
-	self.AOBlurShader:send("blurDirection", {1, 0})
-	love.graphics.draw(pingCanvas)
-	love.graphics.setCanvas(pingCanvas)
-	self.AOBlurShader:send("blurDirection", {0, 1})
-	love.graphics.draw(pongCanvas)
-	profiler:popLabel()
-	
+	local cx, cy, cz, radius = getMeshBounds(Object.Mesh)
+	local x, y, z, r
+	if Object.Matrix ~= nil then
+		x, y, z, r = transformSphere(Object.Matrix, cx, cy, cz, radius)
+		worldBounds[Object] = {key, x, y, z, r}
+		return x, y, z, r
+	end
 
+	-- instanced group: the first 16 values of each instance are its model matrix, so merge the bounds of all instances into one box
+	-- groups keep a CPU copy of their instance data, which is read instead of the mesh when it exists
+	local InstanceData = Object.InstanceData
+	local minX, minY, minZ = math.huge, math.huge, math.huge
+	local maxX, maxY, maxZ = -math.huge, -math.huge, -math.huge
+	local from, to, grown = 1, Object.Count, 0
+	if bounds ~= nil and bounds[1] == key and InstanceData ~= nil then
+		-- only the instances that were edited or added since the last update have to be merged into the box. The box never shrinks this way,
+		-- so once more instances were edited or removed than the group holds it is rebuilt from all instances, which keeps the cost per edit constant
+		from, to = Object.BoundsFrom or 1, math.min(Object.BoundsTo or 0, Object.Count)
+		grown = bounds[14] + math.max(0, to - from + 1) + math.max(0, bounds[6] - Object.Count)
+		if grown <= Object.Count then
+			minX, minY, minZ, maxX, maxY, maxZ = bounds[8], bounds[9], bounds[10], bounds[11], bounds[12], bounds[13]
+		else
+			from, to, grown = 1, Object.Count, 0
+		end
+	end
+	Object.BoundsFrom, Object.BoundsTo = nil, nil
+
+	local ix, iy, iz, ir
+	for i = from, to do
+		ix, iy, iz, ir = transformSphere(InstanceData ~= nil and InstanceData[i] or {Object.Instances:getVertex(i)}, cx, cy, cz, radius)
+		minX = math.min(minX, ix - ir)
+		minY = math.min(minY, iy - ir)
+		minZ = math.min(minZ, iz - ir)
+		maxX = math.max(maxX, ix + ir)
+		maxY = math.max(maxY, iy + ir)
+		maxZ = math.max(maxZ, iz + ir)
+	end
+	if Object.Count == 0 or minX > maxX then
+		x, y, z, r = 0, 0, 0, 0
+	else
+		x, y, z = (minX + maxX) / 2, (minY + maxY) / 2, (minZ + maxZ) / 2
+		r = math.sqrt((maxX - minX)^2 + (maxY - minY)^2 + (maxZ - minZ)^2) / 2
+	end
 
-	-- now blend the ambient occlusion result with whatever has been drawn already
-	love.graphics.setCanvas(self.PrepareCanvas)
-	profiler:pushLabel("clear")
-	love.graphics.clear()
-	profiler:popLabel()
-	love.graphics.setShader(self.SSAOBlendShader) -- set the blend shader so we can apply ambient occlusion to the render canvas
-	
-	love.graphics.draw(self.RenderCanvas)
+	worldBounds[Object] = {key, x, y, z, r, Object.Count, Object.Version, minX, minY, minZ, maxX, maxY, maxZ, grown}
+	return x, y, z, r
+end
 
-	-- copy result to render canvas
-	love.graphics.setShader()
-	love.graphics.setCanvas(self.RenderCanvas)
-	love.graphics.draw(self.PrepareCanvas)
 
-	-- revert canvas state
-	love.graphics.setShader(self.Shader)
-	love.graphics.setCanvas({self.RenderCanvas, self.NormalCanvas, self.BloomCanvas, ["depthstencil"] = self.DepthCanvas})
-	
 
+-- frustum test for a sphere against the camera frustum that was computed in Scene3:updateFrustum()
+local function sphereInFrustum(f, x, y, z, r)
+	local dx, dy, dz = x - f.px, y - f.py, z - f.pz
+	local depth = -(dx * f.bx + dy * f.by + dz * f.bz) -- the camera looks along its negative z-axis
+	if depth < f.near - r or depth > f.far + r then
+		return false
+	end
+	local vx = dx * f.rx + dy * f.ry + dz * f.rz
+	if math.abs(vx) - depth * f.tanX > r * f.secX then
+		return false
+	end
+	local vy = dx * f.ux + dy * f.uy + dz * f.uz
+	if math.abs(vy) - depth * f.tanY > r * f.secY then
+		return false
+	end
+	return true
 end
 
 
 
-function Scene3:applyBloom()
-	-- choose ping-pong canvases based on the quality you set
-	local pingCanvas, pongCanvas
-	if self.BloomQuality == 1 then
-		pingCanvas = self.ReuseCanvas1
-		pongCanvas = self.ReuseCanvas2
-	elseif self.BloomQuality == 0.5 then
-		pingCanvas = self.ReuseCanvas3
-		pongCanvas = self.ReuseCanvas4
-	else -- 0.25
-		pingCanvas = self.ReuseCanvas5
-		pongCanvas = self.ReuseCanvas6
+-- the sun uses an orthographic projection, so its frustum is simply a box
+local function sphereInBox(f, x, y, z, r)
+	local dx, dy, dz = x - f.px, y - f.py, z - f.pz
+	if math.abs(dx * f.rx + dy * f.ry + dz * f.rz) > f.halfX + r then
+		return false
+	end
+	if math.abs(dx * f.ux + dy * f.uy + dz * f.uz) > f.halfY + r then
+		return false
 	end
+	local depth = -(dx * f.bx + dy * f.by + dz * f.bz)
+	return depth >= f.near - r and depth <= f.far + r
+end
+
 
-	-- bloom canvas will have mostly black pixels, but any mesh with bloom > 0 and a non-black color, will be drawn as a non-black color
-	-- the idea is to blur the bloom canvas, then draw it over the scene using additive blending, using a special shader for it
 
-	-- TODO: edit the blur shader so that is knows about the quality and adjusts the blur size accordingly!
+-- writes all objects from 'source' that pass the test into 'target', reusing the target array to avoid creating garbage every frame
+local function cullArray(source, target, test, frustum, shadowsOnly)
+	local n = 0
+	local Object, x, y, z, r
+	for i = 1, #source do
+		Object = source[i]
+		if not shadowsOnly or Object.CastShadow then
+			x, y, z, r = getWorldBounds(Object)
+			if test(frustum, x, y, z, r) then
+				n = n + 1
+				target[n] = Object
+			end
+		end
+	end
+	for i = n + 1, #target do
+		target[i] = nil
+	end
+	return target
+end
+
 
-	-- draw scene to reuse canvas, then blur it
-	love.graphics.setCanvas(pingCanvas)
-	love.graphics.setShader(self.BloomBlurShader)
-	-- re-use the blur-shader that was made for ambient occlusion. We can ignore the depth texture by disabling depth tolerance
-	self.BloomBlurShader:send("blurDirection", {1, 0})
-	love.graphics.draw(self.BloomCanvas, 0, 0, 0, 1 / self.SSAA * self.BloomQuality, 1 / self.SSAA * self.BloomQuality)
-	love.graphics.setCanvas(pongCanvas)
-	self.BloomBlurShader:send("blurDirection", {0, 1})
-	-- draw to second reuse canvas for second blurring pass
-	love.graphics.draw(pingCanvas)
-	-- then finally, draw everything on top of the already rendered scene
 
+-- material sort keys. Opaque meshes are drawn ordered by these keys so that consecutive draws share as much state as possible
+-- each mesh type has its own render queue and shader, so the shader is implicitly part of the key
+local materialKeys = setmetatable({}, {__mode = "k"}) -- [mesh] = last computed material key
+local textureIds = setmetatable({}, {__mode = "k"}) -- [image] = small unique number used to build material keys
+local totalTextureIds = 0
 
-	--love.graphics.setShader(self.BloomBlendShader)
-	--self.BloomBlendShader:send("bloomTexture", self.ReuseCanvas2)
-	local blendMode = love.graphics.getBlendMode()
-	love.graphics.setBlendMode("add")
-	love.graphics.setCanvas(self.RenderCanvas)
-	love.graphics.draw(pongCanvas, 0, 0, 0, self.SSAA / self.BloomQuality, self.SSAA / self.BloomQuality)
-	love.graphics.setBlendMode(blendMode)
-	--love.graphics.setShader() -- not needed since whatever comes after this will set the correct shader
+local function getTextureId(image)
+	local id = textureIds[image]
+	if id == nil then
+		totalTextureIds = totalTextureIds + 1
+		id = totalTextureIds
+		textureIds[image] = id
+	end
+	return id
 end
 
 
 
+-- key layout, from most to least significant: transparency bucket, texture, normal map, masked
+local function getMaterialKey(Mesh)
+	local key = getTextureId(Mesh.Texture or blankImage) * 2^21 + getTextureId(Mesh.NormalMap or normalImage) * 2 + (Mesh.Masked and 1 or 0)
+	if Mesh.Transparency ~= 0 then
+		key = key + 2^48 -- semi-transparent meshes are postponed anyway, so keep them out of the way of the opaque ones
+	end
+	return key
+end
 
-function Scene3:updateShadowMap(firstPass)
-	-- prepare for drawing
-	love.graphics.setMeshCullMode("none") -- "front" can be used to fix peter-panning, but prevents the backfaces from having any shadows!! that's why we set to "none"
-	love.graphics.setDepthMode("lequal", true)
-	love.graphics.setShader(self.ShadowMapShader)
-	love.graphics.setCanvas({["depthstencil"] = self.ShadowDepthCanvas})
 
-	
-	
-	if firstPass then -- first pass, which excludes foliage
 
-		profiler:pushLabel("clear")
-		love.graphics.clear() -- we should clear since if you remove an object, the shadow in that area won't get overwritten
-		profiler:popLabel()
+local function compareMaterial(a, b)
+	local keyA, keyB = materialKeys[a], materialKeys[b]
+	if keyA ~= keyB then
+		return keyA < keyB
+	end
+	return a.Id < b.Id
+end
 
-		-- render all meshes and instanced meshes that have shadows enabled to the shadow canvas
-		local Mesh
-		-- isInstanced should still be true from the second pass
-		--self.ShadowMapShader:send("isInstanced", true)
-		self.ShadowMapShader:send("meshTexture", blankImage) -- for instanced meshes, assume texture is opaque (otherwise you'd use foliage3)
-
-		if #self.InstancedMeshes > 0 then
-			profiler:pushLabel("inst meshes")
-			for i = 1, #self.InstancedMeshes do
-				Mesh = self.InstancedMeshes[i]
-				if Mesh.CastShadow then
-					love.graphics.drawInstanced(Mesh.Mesh, Mesh.Count)
-				end
-			end
-			profiler:popLabel()
+
+
+-- binary search for where a mesh is (or should be inserted) in a render queue, using the keys that were stored when it was last sorted
+local function findRenderQueueLocation(queue, Mesh)
+	local l, r = 1, #queue + 1
+	while l < r do
+		local index = math.floor((l + r) / 2)
+		if compareMaterial(queue[index], Mesh) then
+			l = index + 1
+		else
+			r = index
 		end
+	end
+	return l
+end
 
-		if #self.InstancedTrip3 > 0 then
-			profiler:pushLabel("inst trip3")
-			for i = 1, #self.InstancedTrip3 do
-				Mesh = self.InstancedTrip3[i]
-				if Mesh.CastShadow then
-					love.graphics.drawInstanced(Mesh.Mesh, Mesh.Count)
-				end
-			end
-			profiler:popLabel()
+
+
+-- checks if any of the meshes in 'arr' changed material since they were last sorted. If so, their queue gets sorted again
+-- 'arr' is re-sorted as well if anything changed, or if it did not come straight out of the queue (e.g. from the octree)
+local function sortByMaterial(arr, queue, unordered)
+	local changed = false
+	local Mesh, key
+	for i = 1, #arr do
+		Mesh = arr[i]
+		key = getMaterialKey(Mesh)
+		if key ~= materialKeys[Mesh] then
+			materialKeys[Mesh] = key
+			changed = true
 		end
-		
-		self.ShadowMapShader:send("isInstanced", false)
-
-		if #self.BasicMeshes > 0 then
-			profiler:pushLabel("basic meshes")
-			for i = 1, #self.BasicMeshes do
-				Mesh = self.BasicMeshes[i]
-				if Mesh.CastShadow then
-					local c1, c2, c3, c4 = Mesh.Matrix:columns()
-					self.ShadowMapShader:send("meshMatrix", {c1, c2, c3, c4})
-					love.graphics.draw(Mesh.Mesh)
-				end
-			end
-			profiler:popLabel()
+	end
+	if changed then
+		table.sort(queue, compareMaterial)
+	end
+	if (changed or unordered) and arr ~= queue then
+		table.sort(arr, compareMaterial)
+	end
+end
+
+
+
+local function getRenderQueue(scene, mesh)
+	if mesh3.isMesh3(mesh) then
+		return scene.RenderQueue.BasicMeshes
+	elseif trip3.isTrip3(mesh) then
+		return scene.RenderQueue.BasicTrip3
+	elseif spritemesh3.isSpritemesh3(mesh) then
+		return scene.RenderQueue.SpriteMeshes
+	end
+	return nil
+end
+
+
+
+local function addToRenderQueue(scene, mesh)
+	local queue = getRenderQueue(scene, mesh)
+	if queue ~= nil then
+		materialKeys[mesh] = getMaterialKey(mesh)
+		table.insert(queue, findRenderQueueLocation(queue, mesh), mesh)
+	end
+end
+
+
+
+local function removeFromRenderQueue(scene, mesh)
+	local queue = getRenderQueue(scene, mesh)
+	if queue ~= nil then
+		local index = findRenderQueueLocation(queue, mesh)
+		if queue[index] == mesh then
+			table.remove(queue, index)
 		end
+	end
+end
 
-		if #self.BasicTrip3 > 0 then
-			profiler:pushLabel("basic trip3")
-			for i = 1, #self.BasicTrip3 do
-				Mesh = self.BasicTrip3[i]
-				if Mesh.CastShadow then
-					self.ShadowMapShader:send("meshTexture", Mesh.Texture or blankImage)
-					local c1, c2, c3, c4 = Mesh.Matrix:columns()
-					self.ShadowMapShader:send("meshMatrix", {c1, c2, c3, c4})
-					love.graphics.draw(Mesh.Mesh)
-				end
+
+
+-- semi-transparent meshes are drawn back to front. The queue is kept between frames, so after a frame in which little moved it is already
+-- (nearly) sorted and a single insertion sort pass puts it in order. Depth keys are only computed again when the mesh or the camera moved
+local function queueTransparent(self, Mesh)
+	local Queue = self.TransparentQueue
+	if self.OrderIndependent then -- no order needed, so keep the order in which they are drawn, which is by material
+		table.insert(Queue.Batched, Mesh)
+		return
+	end
+	local Entry = Queue.Entries[Mesh]
+	if Entry == nil then
+		Entry = {["Key"] = 0; ["Stamp"] = -math.huge; ["x"] = nil; ["y"] = nil; ["z"] = nil;}
+		Queue.Entries[Mesh] = Entry
+	end
+	if Entry.Stamp ~= Queue.Stamp - 1 and Entry.Stamp ~= Queue.Stamp then -- not in the queue since last frame, so add it at the end
+		table.insert(Queue.Meshes, Mesh)
+	end
+	Entry.Stamp = Queue.Stamp
+end
+
+
+
+-- removes the meshes that were not queued this frame, updates the depth keys that are out of date and sorts the queue from far to near
+-- returns the queue, which is only valid until the next frame. With order-independent transparency the meshes are returned in the order they were queued
+local function sortTransparent(self)
+	local Queue = self.TransparentQueue
+	if self.OrderIndependent then
+		local Batched = Queue.Batched
+		Queue.Batched, Queue.Spare = Queue.Spare, Batched
+		for i = #Queue.Batched, 1, -1 do
+			Queue.Batched[i] = nil
+		end
+		return Batched
+	end
+	local Meshes, Entries, stamp = Queue.Meshes, Queue.Entries, Queue.Stamp
+	local cam = self.Camera3.Position
+	local cameraMoved = cam.x ~= Queue.CameraX or cam.y ~= Queue.CameraY or cam.z ~= Queue.CameraZ
+	Queue.CameraX, Queue.CameraY, Queue.CameraZ = cam.x, cam.y, cam.z
+
+	local count = 0
+	local Mesh, Entry, pos
+	for i = 1, #Meshes do
+		Mesh = Meshes[i]
+		Entry = Entries[Mesh]
+		Meshes[i] = nil
+		if Entry.Stamp == stamp then
+			count = count + 1
+			Meshes[count] = Mesh
+			pos = Mesh.Position
+			if cameraMoved or pos.x ~= Entry.x or pos.y ~= Entry.y or pos.z ~= Entry.z then
+				Entry.x, Entry.y, Entry.z = pos.x, pos.y, pos.z
+				Entry.Key = (pos.x - cam.x)^2 + (pos.y - cam.y)^2 + (pos.z - cam.z)^2
 			end
-			profiler:popLabel()
 		end
+	end
+
+	-- insertion sort, furthest first. This is close to linear when the order barely changed since last frame
+	local key, j
+	for i = 2, count do
+		Mesh = Meshes[i]
+		key = Entries[Mesh].Key
+		j = i - 1
+		while j >= 1 and Entries[Meshes[j]].Key < key do
+			Meshes[j + 1] = Meshes[j]
+			j = j - 1
+		end
+		Meshes[j + 1] = Mesh
+	end
 
-	else -- second pass, which includes foliage
+	Queue.Stamp = stamp + 1
+	return Meshes
+end
 
-		self.ShadowMapShader:send("isInstanced", true) -- very important that this is outside the if-statement!
 
-		if #self.Foliage > 0 then
-			profiler:pushLabel("foliage")
-			for i = 1, #self.Foliage do -- foliage is always instanced
-				Mesh = self.Foliage[i]
-				if Mesh.CastShadow then
-					self.ShadowMapShader:send("meshTexture", Mesh.Texture or blankImage) -- foliage will have alpha clipping, so sending over image is important
-					love.graphics.drawInstanced(Mesh.Mesh, Mesh.Count)
-				end
-			end
-			profiler:popLabel()
+
+-- static batching. Meshes that are baked into a batch are taken out of the render queue and octree, and the batch (a mesh3 with an identity matrix) is drawn in their place
+local MAX_BATCH_VERTICES = 65535 -- smaller batches are culled more precisely, and the vertex map can use 16-bit indices
+local STATIC_CELL_SIZE = 64 -- batches only merge meshes whose centers are in the same cell of this size, so that each batch can still be culled
+local bakedInto = setmetatable({}, {__mode = "k"}) -- [mesh3] = batch it is part of
+
+-- meshes can only be merged if they look exactly the same apart from their transform
+local function getBatchKey(Mesh)
+	local format = Mesh.Mesh:getVertexFormat()
+	local attributes = {}
+	for i = 1, #format do
+		attributes[i] = format[i][1] .. format[i][2] .. format[i][3]
+	end
+	return table.concat({
+		tostring(Mesh.Texture or blankImage), tostring(Mesh.NormalMap or normalImage), table.concat(attributes, ","),
+		Mesh.Color.r, Mesh.Color.g, Mesh.Color.b, Mesh.ColorShadow.r, Mesh.ColorShadow.g, Mesh.ColorShadow.b,
+		Mesh.Brightness, Mesh.Reflectance, Mesh.Bloom, Mesh.FresnelStrength, Mesh.FresnelPower,
+		Mesh.FresnelColor.r, Mesh.FresnelColor.g, Mesh.FresnelColor.b, Mesh.UVVelocity.x, Mesh.UVVelocity.y,
+		tostring(Mesh.Masked), tostring(Mesh.CastShadow)
+	}, "|")
+end
+
+
+
+-- appends the vertices of a mesh3, transformed by its matrix, to 'vertices'. Positions use the full matrix, normals use the inverse-transpose (like vertex3d.c does) and tangents use the plain rotation & scale
+local function appendTransformedVertices(Mesh, vertices)
+	local m = Mesh.Matrix
+	local a11, a12, a13 = m[1], m[5], m[9]
+	local a21, a22, a23 = m[2], m[6], m[10]
+	local a31, a32, a33 = m[3], m[7], m[11]
+	-- cofactor matrix, which is the inverse-transpose multiplied by the determinant. The scale doesn't matter as normals are normalized anyway
+	local c11, c12, c13 = a22 * a33 - a23 * a32, a23 * a31 - a21 * a33, a21 * a32 - a22 * a31
+	local c21, c22, c23 = a13 * a32 - a12 * a33, a11 * a33 - a13 * a31, a12 * a31 - a11 * a32
+	local c31, c32, c33 = a12 * a23 - a13 * a22, a13 * a21 - a11 * a23, a11 * a22 - a12 * a21
+	local sign = (a11 * c11 + a12 * c12 + a13 * c13) < 0 and -1 or 1
+
+	-- find where each attribute starts in the flat list of vertex components
+	local positionAt, normalsAt, tangentsAt = nil, {}, {}
+	local offset = 1
+	local format = Mesh.Mesh:getVertexFormat()
+	for i = 1, #format do
+		local name = format[i][1]
+		if name == "VertexPosition" then
+			positionAt = offset
+		elseif name == "VertexNormal" or name == "SurfaceNormal" then
+			normalsAt[#normalsAt + 1] = offset
+		elseif name == "VertexTangent" or name == "VertexBitangent" then
+			tangentsAt[#tangentsAt + 1] = offset
 		end
+		offset = offset + format[i][3]
+	end
 
+	local x, y, z, len
+	for i = 1, Mesh.Mesh:getVertexCount() do
+		local v = {Mesh.Mesh:getVertex(i)}
+		x, y, z = v[positionAt], v[positionAt + 1], v[positionAt + 2]
+		v[positionAt] = x * a11 + y * a12 + z * a13 + m[13]
+		v[positionAt + 1] = x * a21 + y * a22 + z * a23 + m[14]
+		v[positionAt + 2] = x * a31 + y * a32 + z * a33 + m[15]
+		for k = 1, #normalsAt do
+			local at = normalsAt[k]
+			x, y, z = v[at], v[at + 1], v[at + 2]
+			x, y, z = (x * c11 + y * c12 + z * c13) * sign, (x * c21 + y * c22 + z * c23) * sign, (x * c31 + y * c32 + z * c33) * sign
+			len = math.sqrt(x * x + y * y + z * z)
+			if len > 0 then
+				v[at], v[at + 1], v[at + 2] = x / len, y / len, z / len
+			end
+		end
+		for k = 1, #tangentsAt do
+			local at = tangentsAt[k]
+			x, y, z = v[at], v[at + 1], v[at + 2]
+			x, y, z = x * a11 + y * a12 + z * a13, x * a21 + y * a22 + z * a23, x * a31 + y * a32 + z * a33
+			len = math.sqrt(x * x + y * y + z * z)
+			if len > 0 then
+				v[at], v[at + 1], v[at + 2] = x / len, y / len, z / len
+			end
+		end
+		vertices[#vertices + 1] = v
 	end
+end
 
-	-- revert peter-panning
-	love.graphics.setMeshCullMode("back")
+
+
+-- uniform cache: for each shader, remember the last value sent to each uniform so that sending the same value again can be skipped
+-- vectors and matrices are copied into scratch tables owned by the cache, which are then also what gets sent, so no garbage is created
+-- any uniform that is sent through these functions should *never* be sent through Shader:send() directly, or the cache will go out of sync!
+local uniformCache = setmetatable({}, {__mode = "k"}) -- [shader] = {[name] = last value}
+local uniformsSent = 0
+local uniformsSkipped = 0
+
+local function getUniformCache(shader)
+	local cache = uniformCache[shader]
+	if cache == nil then
+		cache = {}
+		uniformCache[shader] = cache
+	end
+	return cache
 end
 
 
 
+-- shader variants leave out the code of the features they don't have, and with it any uniforms only that code used. Sending those is an error,
+-- so check once per shader and uniform whether the uniform exists. Sets of variants check this for each variant themselves, see shadervariants.lua
+local uniformExists = setmetatable({}, {__mode = "k"}) -- [shader] = {[name] = true/false}
 
+local function usesUniform(shader, name)
+	local exists = uniformExists[shader]
+	if exists == nil then
+		exists = {}
+		uniformExists[shader] = exists
+	end
+	local found = exists[name]
+	if found == nil then
+		found = shadervariants.isShaderVariants(shader) or shader:hasUniform(name)
+		exists[name] = found
+	end
+	return found
+end
 
 
-function Scene3:drawVFX()
-	profiler:pushLabel("vfx")
 
-	-- draw non-blending particles
-	local blendMode, alphaMode = love.graphics.getBlendMode()
-	local comp, write = love.graphics.getDepthMode()
+-- for numbers, booleans and textures
+local function sendUniform(shader, name, value)
+	local cache = getUniformCache(shader)
+	if cache[name] == value then
+		uniformsSkipped = uniformsSkipped + 1
+		return
+	end
+	cache[name] = value
+	if usesUniform(shader, name) then
+		uniformsSent = uniformsSent + 1
+		shader:send(name, value)
+	end
+end
 
-	-- for non-blending particles and trails we do write depth and we do need depth testing
-	love.graphics.setCanvas({self.RenderCanvas, ["depthstencil"] = self.DepthCanvas}) -- draw directly to the scene
-	love.graphics.setDepthMode("less", true) -- front-most non-blending particles appear on top
 
 
-	-- draw any particles that have no blending whatsoever directly to the render canvas. Typically these are particles without semi-transparency
-	
-	if #self.Particles > 0 then
-		profiler:pushLabel("particles")
-		love.graphics.setShader(self.ParticlesShader)
-		self.ParticlesShader:send("blends", false)
-		for i = 1, #self.Particles do
-			if not self.Particles[i].Blends then
-				self.Particles[i]:draw(self.ParticlesShader)
-			end
-		end
-		profiler:popLabel()
+-- for vec2, vec3 and vec4. Leave 'z' and 'w' nil for smaller vectors
+local function sendVector(shader, name, x, y, z, w)
+	local cache = getUniformCache(shader)
+	local v = cache[name]
+	if v == nil then
+		v = {}
+		cache[name] = v
+	elseif v[1] == x and v[2] == y and v[3] == z and v[4] == w then
+		uniformsSkipped = uniformsSkipped + 1
+		return
 	end
-	
+	v[1], v[2], v[3], v[4] = x, y, z, w
+	if usesUniform(shader, name) then
+		uniformsSent = uniformsSent + 1
+		shader:send(name, v)
+	end
+end
+
+
 
-	-- draw non-blending trails
-	if #self.Trails > 0 then
-		profiler:pushLabel("trails")
-		love.graphics.setShader(self.TrailShader)
-		self.TrailShader:send("blends", false)
-		for i = 1, #self.Trails do
-			if not self.Trails[i].Blends then
-				self.Trails[i]:draw(self.TrailShader)
+-- for mat4 uniforms, replaces the 'local c1, c2, c3, c4 = m:columns()' and 'send(name, {c1, c2, c3, c4})' pattern
+local function sendMatrix(shader, name, m)
+	local cache = getUniformCache(shader)
+	local columns = cache[name]
+	if columns == nil then
+		columns = {{}, {}, {}, {}}
+		cache[name] = columns
+	else
+		local same = true
+		for i = 1, 4 do
+			local c = columns[i]
+			if c[1] ~= m[i] or c[2] ~= m[i + 4] or c[3] ~= m[i + 8] or c[4] ~= m[i + 12] then
+				same = false
+				break
 			end
 		end
-		profiler:popLabel()
+		if same then
+			uniformsSkipped = uniformsSkipped + 1
+			return
+		end
+	end
+	for i = 1, 4 do
+		local c = columns[i]
+		c[1], c[2], c[3], c[4] = m[i], m[i + 4], m[i + 8], m[i + 12]
 	end
+	if usesUniform(shader, name) then
+		uniformsSent = uniformsSent + 1
+		shader:send(name, columns)
+	end
+end
 
 
-	-- optimization: if there are no blended vfx, this ensures you don't clear the vfx canvases for no reason!
-	if #self.Particles > 0 or #self.Trails > 0 then
-		profiler:pushLabel("vfx blend")
-		-- now do particles and trails that are set to blend
-		-- initialize canvases & operations
-		--love.graphics.setCanvas({self.VFXCanvas1, self.VFXCanvas2})
-		--love.graphics.clear(0, 0, 0, 1)
-		love.graphics.setCanvas({self.VFXCanvas1, self.VFXCanvas2, ["depthstencil"] = self.DepthCanvas})
-		love.graphics.clear(0, 0, 0, 1, false, false) -- don't clear depth or stencil
-		love.graphics.setDepthMode("less", false)
-		love.graphics.setBlendMode("add")
 
+-- scene constants: uniforms that many of the scene's shaders share, like the camera, the sun, the shadow cascades, lights, blob shadows, time, wind and ambient
+-- setting a constant only stores its value. A registered shader receives the constants that changed since it was last used when it is bound with
+-- useShader(), so moving the camera costs one send for each shader that is drawn with afterwards instead of one for every shader of the scene
+-- constants should *never* be sent to registered shaders in any other way, or the shaders will go out of sync!
 
-		-- draw any blending particles
-		if #self.Particles > 0 then
-			love.graphics.setShader(self.ParticlesShader)
-			self.ParticlesShader:send("blends", true)
-			for i = 1, #self.Particles do
-				if self.Particles[i].Blends then
-					self.Particles[i]:draw(self.ParticlesShader)
+-- stores the arguments that would be passed to Shader:send(). A matrix4 is turned into columns, which are copied into a table owned by the constant
+local function setConstant(self, name, ...)
+	local Constants = self.SceneConstants
+	local args = Constants.Values[name]
+	if args == nil then
+		args = {["n"] = 0}
+		Constants.Values[name] = args
+		table.insert(Constants.Names, name)
+	end
+	local n = select("#", ...)
+	local value = ...
+	if n == 1 and matrix4.isMatrix4(value) then
+		local columns = args.Columns
+		if columns == nil then
+			columns = {{}, {}, {}, {}}
+			args.Columns = columns
+		elseif args[1] == columns then
+			local same = true
+			for i = 1, 4 do
+				local c = columns[i]
+				if c[1] ~= value[i] or c[2] ~= value[i + 4] or c[3] ~= value[i + 8] or c[4] ~= value[i + 12] then
+					same = false
+					break
 				end
 			end
+			if same then
+				return
+			end
+		end
+		for i = 1, 4 do
+			local c = columns[i]
+			c[1], c[2], c[3], c[4] = value[i], value[i + 4], value[i + 8], value[i + 12]
+		end
+		args[1] = columns
+	elseif n == 1 and type(value) ~= "table" then
+		if args.n == 1 and args[1] == value then
+			return -- numbers, booleans and textures that did not change
+		end
+		args[1] = value
+	else
+		for i = 1, n do
+			args[i] = select(i, ...)
 		end
+	end
+	args.n = n
+	Constants.Revision = Constants.Revision + 1
+	Constants.Versions[name] = Constants.Revision
+end
+
+
+
+-- registers a shader (or a set of shader variants) that receives the scene constants it uses whenever it is bound with useShader()
+local function registerShader(self, shader)
+	self.SceneConstants.Registered[shader] = true
+end
+
+
 
-		-- draw any blending trails
-		if #self.Trails > 0 then
-			love.graphics.setShader(self.TrailShader)
-			self.TrailShader:send("blends", true)
-			for i = 1, #self.Trails do
-				if self.Trails[i].Blends then
-					self.Trails[i]:draw(self.TrailShader)
+-- binds a shader, or the variant with the features in 'mask' when it is a set of shader variants, and returns the bound shader
+-- registered shaders first receive any constants that changed since the last time they were bound
+local function useShader(self, shader, mask)
+	local Constants = self.SceneConstants
+	local registered = Constants.Registered[shader]
+	if shadervariants.isShaderVariants(shader) then
+		shader = shader:get(mask)
+	end
+	if registered then
+		local Synced = Constants.Synced[shader]
+		if Synced == nil then
+			Synced = {["Revision"] = -1; ["Versions"] = {};}
+			Constants.Synced[shader] = Synced
+		end
+		if Synced.Revision ~= Constants.Revision then
+			local Versions = Synced.Versions
+			for i = 1, #Constants.Names do
+				local name = Constants.Names[i]
+				local version = Constants.Versions[name]
+				if Versions[name] ~= version then
+					Versions[name] = version
+					if usesUniform(shader, name) then
+						local args = Constants.Values[name]
+						uniformsSent = uniformsSent + 1
+						shader:send(name, unpack(args, 1, args.n))
+					end
 				end
 			end
+			Synced.Revision = Constants.Revision
 		end
-		
+	end
+	love.graphics.setShader(shader)
+	return shader
+end
 
 
-		-- start blending the particles that have blends=true onto the render canvas
-		-- we draw to the render canvas using default blend settings, but the shader itself will 'blend' the particle fragments with each other during the write operation
-		love.graphics.setCanvas({self.RenderCanvas})
-		love.graphics.setBlendMode(blendMode, alphaMode)
-		love.graphics.setDepthMode("always", false) -- don't set depth. Don't need to compare as it's already been done beforehand
-		love.graphics.setShader(vfxMixShader)
-		love.graphics.setColor(1, 1, 1, 1)
-		love.graphics.draw(self.VFXCanvas1)
-		profiler:popLabel()
+
+local function alwaysTrue()
+	return true
+end
+
+
+
+-- same as cullArray(), but queries the scene's octree which holds both the mesh3 and trip3 instances, and splits the results between the two target arrays
+local octreeResults = {}
+
+local function cullOctree(tree, targetMeshes, targetTrip3, test, frustum, shadowsOnly)
+	local count = tree:inFrustum(test, frustum, octreeResults)
+	local nMeshes, nTrip3 = 0, 0
+	local Object
+	for i = 1, count do
+		Object = octreeResults[i]
+		octreeResults[i] = nil
+		if not shadowsOnly or Object.CastShadow then
+			if mesh3.isMesh3(Object) then
+				nMeshes = nMeshes + 1
+				targetMeshes[nMeshes] = Object
+			else
+				nTrip3 = nTrip3 + 1
+				targetTrip3[nTrip3] = Object
+			end
+		end
 	end
+	for i = nMeshes + 1, #targetMeshes do
+		targetMeshes[i] = nil
+	end
+	for i = nTrip3 + 1, #targetTrip3 do
+		targetTrip3[i] = nil
+	end
+end
 
-	-- reset
-	love.graphics.setDepthMode(comp, write)
 
-	-- no need to reset the shader here as it's done literally the next line after returning from this function
-	profiler:popLabel()
+
+-- scratch arrays for Scene3:updateLightClusters()
+local clusterCounts = {} -- [cluster index + 1] = number of lights in that cluster
+local clusterOffsets = {} -- [cluster index + 1] = index of the cluster's first light in the light indices texture
+local lightTiles = {} -- array of {x0, x1, y0, y1, z0, z1} with the clusters each binned light touches
+for i = 1, CLUSTER_X * CLUSTER_Y * CLUSTER_Z do
+	clusterCounts[i] = 0
+	clusterOffsets[i] = 0
 end
 
+-- the fields of the camera frustum that the clusters depend on, see lightClustersChanged()
+local CLUSTER_FRUSTUM_KEYS = {"px", "py", "pz", "rx", "ry", "rz", "ux", "uy", "uz", "bx", "by", "bz", "tanX", "tanY", "near", "far"}
 
 
 
+-- stores one value of the snapshot in lightClustersChanged(), returning true if it differs from before or 'changed' was true already
+local function updateSnapshot(snapshot, n, v, changed)
+	if snapshot[n] ~= v then
+		snapshot[n] = v
+		return true
+	end
+	return changed
+end
 
 
-function Scene3:draw(renderTarget, x, y) -- nil or a canvas
-	if x == nil then x = 0 end
-	if y == nil then y = 0 end
-	-- get some graphics settings so they can be reverted later
-	local prevCanvas = love.graphics.getCanvas()
-	local prevDepthMode, prevWrite = love.graphics.getDepthMode()
 
-	profiler:pushLabel("scene3")
+-- compares the camera and every light against the values they had when the clusters were last built, and stores the current values
+-- lights are plain tables that can be changed anywhere, so comparing them is the only reliable way to know. It is much cheaper than binning and uploading
+local function lightClustersChanged(Clusters, f, Lights)
+	local snapshot = Clusters.Snapshot
+	local changed = snapshot.Count ~= #Lights
+	snapshot.Count = #Lights
+	local keys = CLUSTER_FRUSTUM_KEYS
+	for i = 1, #keys do
+		changed = updateSnapshot(snapshot, i, f[keys[i]], changed)
+	end
+	local n = #keys
+	for i = 1, #Lights do
+		local light = Lights[i]
+		changed = updateSnapshot(snapshot, n + 1, light.Position.x, changed)
+		changed = updateSnapshot(snapshot, n + 2, light.Position.y, changed)
+		changed = updateSnapshot(snapshot, n + 3, light.Position.z, changed)
+		changed = updateSnapshot(snapshot, n + 4, light.Range, changed)
+		changed = updateSnapshot(snapshot, n + 5, light.Color.r, changed)
+		changed = updateSnapshot(snapshot, n + 6, light.Color.g, changed)
+		changed = updateSnapshot(snapshot, n + 7, light.Color.b, changed)
+		changed = updateSnapshot(snapshot, n + 8, light.Strength, changed)
+		n = n + 8
+	end
+	return changed
+end
+
+
+
+-- creates a float texture that is written to on the CPU, returns both the image data and the image
+local function newDataTexture(width, height, format)
+	local data = love.image.newImageData(width, height, format)
+	local image = love.graphics.newImage(data)
+	image:setFilter("nearest", "nearest")
+	return data, image
+end
+
+
+
+-- returns the range of tiles (0-based) on one axis covered by the view-space interval [lo, hi] somewhere between depth dMin and dMax
+-- a projected coordinate is furthest from the center at the smallest depth, so each side is divided by the depth that makes it the widest
+-- 'tiles' is how many tiles span the view, which is fractional when the last tile sticks out past the edge. 'count' is the number of tiles that exist
+-- the range is clamped to the tiles that exist. The third return value is false if the interval reaches past the edge of the view
+local function getTileRange(lo, hi, dMin, dMax, tan, tiles, count)
+	count = count or tiles
+	local ndcLo = lo / ((lo < 0 and dMin or dMax) * tan)
+	local ndcHi = hi / ((hi > 0 and dMin or dMax) * tan)
+	local t0 = math.floor((ndcLo * 0.5 + 0.5) * tiles)
+	local t1 = math.floor((ndcHi * 0.5 + 0.5) * tiles)
+	return math.max(0, math.min(count - 1, t0)), math.max(0, math.min(count - 1, t1)), t0 >= 0 and t1 < tiles
+end
+
+
+
+-- returns true if a sphere is completely behind the depths in the reduced depth buffer 'depthData' of size 'width' by 'height'
+-- 'spanX' and 'spanY' are the number of pixels of the reduced depth buffer that span the view. Each pixel covers a whole 4x4 block of the level before
+-- it, so the last column and row stick out past the edge of the view and the spans are smaller than the size
+local function sphereOccluded(f, depthData, width, height, spanX, spanY, x, y, z, r)
+	local dx, dy, dz = x - f.px, y - f.py, z - f.pz
+	local depth = -(dx * f.bx + dy * f.by + dz * f.bz)
+	local dMin = depth - r
+	if dMin <= f.near then
+		return false -- touches the near plane, so it is always in front
+	end
+	local vx = dx * f.rx + dy * f.ry + dz * f.rz
+	local vy = dx * f.ux + dy * f.uy + dz * f.uz
+	local x0, x1, insideX = getTileRange(vx - r, vx + r, dMin, depth + r, f.tanX, spanX, width)
+	local y0, y1, insideY = getTileRange(vy - r, vy + r, dMin, depth + r, f.tanY, spanY, height)
+	if not (insideX and insideY) then
+		return false -- nothing is known about the depth outside of the view the buffer was drawn with, which differs from the current one while the camera turns
+	end
+	if (x1 - x0 + 1) * (y1 - y0 + 1) > HIZ_MAX_TEXELS then
+		return false
+	end
+
+	-- depth buffer value of the sphere's closest point, using the same projection as the shaders
+	local near, far = f.near, f.far
+	local sphereDepth = ((far + near) / (far - near) - 2 * far * near / ((far - near) * dMin)) * 0.5 + 0.5
+	for py = y0, y1 do
+		for px = x0, x1 do
+			if depthData:getPixel(px, py) >= sphereDepth then
+				return false
+			end
+		end
+	end
+	return true
+end
+
+
+
+-- releases the reduced depth canvases, they are created again by Scene3:cullOccluded() the next time occlusion culling runs
+local function releaseHiZ(HiZ)
+	for i = #HiZ.Levels, 1, -1 do
+		HiZ.Levels[i]:release()
+		HiZ.Levels[i] = nil
+	end
+	for i = #HiZ.Readbacks, 1, -1 do
+		HiZ.Readbacks[i].Canvas:release()
+		HiZ.Readbacks[i] = nil
+	end
+	HiZ.SourceWidth, HiZ.SourceHeight = 0, 0
+end
+
+
+
+-- sets the canvases that opaque geometry is drawn to. The albedo and shading normal canvases only exist when deferred lights are enabled
+local function setGeometryCanvas(self)
+	love.graphics.setCanvas({self.RenderCanvas, self.NormalCanvas, self.BloomCanvas, self.AlbedoCanvas, self.ShadingNormalCanvas, ["depthstencil"] = self.DepthCanvas})
+end
+
+
+
+-- masked meshes skip the pixels that a mask wrote to the stencil buffer. The stencil test is only changed when a mesh's Masked property differs from the one before
+local stencilMasked = false
+local function setMasked(masked)
+	masked = (masked == true)
+	if masked ~= stencilMasked then
+		stencilMasked = masked
+		if masked then
+			love.graphics.setStencilTest("notequal", MASK_STENCIL)
+		else
+			love.graphics.setStencilTest()
+		end
+	end
+end
+
+
+
+-- writes all masks to the stencil buffer of the canvas that is currently set, in a single instanced draw call
+-- the position and radii of each mask are stored in an instance mesh, which only grows when there are more masks than it can hold
+local maskDrawMesh, maskDrawCount = nil, 0
+local function drawMaskInstances()
+	love.graphics.drawInstanced(maskDrawMesh, maskDrawCount)
+end
+
+local function drawMasks(self)
+	local Masks = self.Masks
+	local Instances = self.MaskInstances
+	if Instances.Capacity < #Masks then
+		if Instances.Mesh ~= nil then
+			Instances.Mesh:release()
+		end
+		Instances.Capacity = math.max(#Masks, Instances.Capacity * 2)
+		Instances.Mesh = love.graphics.newMesh(MASK_INSTANCE_FORMAT, Instances.Capacity, "triangles", "dynamic")
+	end
+
+	local vertices = Instances.Vertices
+	for i = 1, #Masks do
+		local Mask = Masks[i]
+		local v = vertices[i]
+		if v == nil then
+			v = {}
+			vertices[i] = v
+		end
+		v[1], v[2], v[3], v[4], v[5] = Mask.Position.x, Mask.Position.y, Mask.Position.z, Mask.InnerRadius, Mask.OuterRadius
+	end
+	for i = #Masks + 1, #vertices do
+		vertices[i] = nil
+	end
+	Instances.Mesh:setVertices(vertices)
+
+	-- all masks share the same mesh, which may be drawn by other scenes as well, so the attributes are attached right before drawing
+	maskDrawMesh, maskDrawCount = Masks[1].Mesh, #Masks
+	maskDrawMesh:attachAttribute("MaskPosition", Instances.Mesh, "perinstance")
+	maskDrawMesh:attachAttribute("MaskRadii", Instances.Mesh, "perinstance")
+	useShader(self, self.MaskShader)
+	love.graphics.stencil(drawMaskInstances, "replace", MASK_STENCIL, true) -- the stencil buffer is cleared at the start of the frame
+end
+
+
+
+-- returns the batch that billboards with the given texture and InFront value are drawn in, creating it if it does not exist yet
+local function getBillboardBatch(self, texture, inFront)
+	local Batches = self.BillboardBatches
+	local pair = Batches.Lookup[texture]
+	if pair == nil then
+		pair = {}
+		Batches.Lookup[texture] = pair
+	end
+	local Batch = pair[inFront]
+	if Batch == nil then
+		Batch = {
+			["Texture"] = texture;
+			["InFront"] = inFront;
+			["Mesh"] = nil; -- dynamic instance mesh, grows when there are more billboards than it can hold
+			["Capacity"] = 0;
+			["Count"] = 0; -- number of billboards in the batch this frame
+			["Members"] = {}; -- [instance] = billboard that was written to that instance
+			["Vertices"] = {}; -- [instance] = the attributes last written to that instance
+		}
+		pair[inFront] = Batch
+		table.insert(Batches, Batch)
+	end
+	return Batch
+end
+
+
+
+-- adds a billboard to its batch. Instances are only written to the instance mesh when their billboard changed, or when a different billboard
+-- ended up in the same instance since last frame, so static billboards cost no upload at all
+local function addBillboardInstance(self, Object)
+	local Batch = getBillboardBatch(self, Object.Texture or blankImage, Object.InFront) -- billboards without a texture are drawn untextured
+	local n = Batch.Count + 1
+	Batch.Count = n
+
+	local vertices = Batch.Vertices
+	if n > Batch.Capacity then
+		local old = Batch.Mesh
+		Batch.Capacity = math.max(n, Batch.Capacity * 2, 16)
+		Batch.Mesh = love.graphics.newMesh(BILLBOARD_INSTANCE_FORMAT, Batch.Capacity, "triangles", "dynamic")
+		if old ~= nil then
+			Batch.Mesh:setVertices(vertices) -- holds exactly the instances of the old mesh
+			old:release()
+		end
+	end
+
+	local v = vertices[n]
+	if v == nil then
+		v = {}
+		vertices[n] = v
+	end
+	local pos, size, pixels, center, col, uvOffset, uvSize = Object.Position, Object.WorldSize, Object.PixelSize, Object.Center, Object.Color, Object.UVOffset, Object.UVSize
+	if Batch.Members[n] ~= Object
+		or v[1] ~= pos.x or v[2] ~= pos.y or v[3] ~= pos.z or v[4] ~= Object.Rotation
+		or v[5] ~= size.x or v[6] ~= size.y or v[7] ~= pixels.x or v[8] ~= pixels.y
+		or v[9] ~= center.x or v[10] ~= center.y
+		or v[11] ~= col.r or v[12] ~= col.g or v[13] ~= col.b or v[14] ~= col.a
+		or v[15] ~= uvOffset.x or v[16] ~= uvOffset.y or v[17] ~= uvSize.x or v[18] ~= uvSize.y then
+		Batch.Members[n] = Object
+		v[1], v[2], v[3], v[4] = pos.x, pos.y, pos.z, Object.Rotation
+		v[5], v[6], v[7], v[8] = size.x, size.y, pixels.x, pixels.y
+		v[9], v[10] = center.x, center.y
+		v[11], v[12], v[13], v[14] = col.r, col.g, col.b, col.a
+		v[15], v[16], v[17], v[18] = uvOffset.x, uvOffset.y, uvSize.x, uvSize.y
+		Batch.Mesh:setVertex(n, v)
+	end
+end
+
+
+
+-- draws all billboards with one instanced draw call per texture. Billboards that are drawn in front are drawn last so that they cover the others
+local function drawBillboards(self)
+	local Batches = self.BillboardBatches
+	for i = 1, #Batches do
+		Batches[i].Count = 0
+	end
+	for i = 1, #self.Billboards do
+		addBillboardInstance(self, self.Billboards[i])
+	end
+
+	-- all billboards share the same quad, which may be drawn by other scenes as well, so the texture and attributes are set right before drawing
+	if #self.Billboards > 0 then
+		local quad = self.Billboards[1].Mesh
+		useShader(self, self.BillboardShader)
+		for pass = 1, 2 do
+			local inFront = (pass == 2)
+			for i = 1, #Batches do
+				local Batch = Batches[i]
+				if Batch.Count > 0 and Batch.InFront == inFront then
+					love.graphics.setDepthMode(inFront and "always" or "less", not inFront)
+					quad:setTexture(Batch.Texture)
+					for j = 1, #BILLBOARD_INSTANCE_FORMAT do
+						quad:attachAttribute(BILLBOARD_INSTANCE_FORMAT[j][1], Batch.Mesh, "perinstance")
+					end
+					love.graphics.drawInstanced(quad, Batch.Count)
+				end
+			end
+		end
+	end
+
+	-- batches of textures that are no longer used are removed so that the textures can be garbage collected
+	for i = #Batches, 1, -1 do
+		local Batch = Batches[i]
+		if Batch.Count == 0 then
+			Batch.Mesh:release()
+			Batches.Lookup[Batch.Texture][Batch.InFront] = nil
+			if next(Batches.Lookup[Batch.Texture]) == nil then
+				Batches.Lookup[Batch.Texture] = nil
+			end
+			table.remove(Batches, i)
+		end
+	end
+end
+
+
+
+-- copies the sampled path of a trail into the texture that holds the paths of all trails in the scene, at two rows that are not in use yet
+-- the texture doubles in height when it is full. Otherwise only the rows of the trail are uploaded
+local function placeTrailPath(self, trail)
+	local Paths = self.TrailPaths
+	local slot = table.remove(Paths.Free)
+	if slot == nil then
+		Paths.Used = Paths.Used + 1
+		slot = Paths.Used
+	end
+	Paths.Slots[trail] = slot
+	local row = (slot - 1) * 2
+
+	if slot > Paths.Capacity then
+		local oldData, oldImage = Paths.Data, Paths.Image
+		Paths.Capacity = math.max(slot, Paths.Capacity * 2, 8)
+		-- samples are interpolated in the shader, since not all systems can filter 32-bit float textures
+		Paths.Data, Paths.Image = newDataTexture(trail.PathData:getWidth(), Paths.Capacity * 2, "rgba32f")
+		if oldData ~= nil then
+			Paths.Data:paste(oldData, 0, 0, 0, 0, oldData:getWidth(), oldData:getHeight())
+			oldData:release()
+			oldImage:release()
+		end
+		Paths.Data:paste(trail.PathData, 0, row, 0, 0, trail.PathData:getWidth(), 2)
+		Paths.Image:replacePixels(Paths.Data)
+	else
+		Paths.Data:paste(trail.PathData, 0, row, 0, 0, trail.PathData:getWidth(), 2)
+		Paths.Image:replacePixels(trail.PathData, 1, 1, 0, row)
+	end
+end
+
+
+
+-- marks the rows of a trail's path as free so that the next trail that is attached can use them
+local function freeTrailPath(self, trail)
+	local Paths = self.TrailPaths
+	local slot = Paths.Slots[trail]
+	if slot ~= nil then
+		Paths.Slots[trail] = nil
+		table.insert(Paths.Free, slot)
+	end
+end
+
+
+
+-- draws all trails that have their Blends property set to 'blends', with one instanced draw call per texture and number of segments
+-- the per-instance data changes every frame since the age of each trail does, so all instances are written every time
+local function drawTrails(self, blends)
+	local Batches = self.TrailBatches[blends and 2 or 1]
+	for i = 1, #Batches do
+		Batches[i].Count = 0
+	end
+
+	local time = love.timer.getTime()
+	local visible = 0
+	for i = 1, #self.Trails do
+		local Trail = self.Trails[i]
+		local x0, x1 = Trail:getRange(time)
+		if Trail.Blends == blends and x1 >= 0 and x0 <= 1 then
+			local pair = Batches.Lookup[Trail.Texture]
+			if pair == nil then
+				pair = {}
+				Batches.Lookup[Trail.Texture] = pair
+			end
+			local Batch = pair[Trail.Mesh]
+			if Batch == nil then
+				Batch = {
+					["Texture"] = Trail.Texture;
+					["Strip"] = Trail.Mesh;
+					["Mesh"] = nil; -- dynamic instance mesh, grows when there are more trails than it can hold
+					["Capacity"] = 0;
+					["Count"] = 0;
+					["Vertices"] = {};
+				}
+				pair[Trail.Mesh] = Batch
+				table.insert(Batches, Batch)
+			end
+
+			local n = Batch.Count + 1
+			Batch.Count = n
+			visible = visible + 1
+			local v = Batch.Vertices[n]
+			if v == nil then
+				v = {}
+				Batch.Vertices[n] = v
+			end
+			v[1], v[2], v[3], v[4] = time - Trail.SpawnedAt, Trail.Duration, Trail.Length, (self.TrailPaths.Slots[Trail] - 1) * 2
+			v[5], v[6], v[7], v[8] = Trail.Color.r, Trail.Color.g, Trail.Color.b, Trail.Color.a
+			v[9], v[10] = Trail.Brightness, Trail.FacesCamera and 1 or 0
+		end
+	end
+
+	if visible > 0 then
+		useShader(self, self.TrailShader, blends and VARIANT_BLENDS or 0)
+		sendUniform(self.TrailShader, "trailPaths", self.TrailPaths.Image)
+	end
+	for i = #Batches, 1, -1 do
+		local Batch = Batches[i]
+		if Batch.Count > 0 then
+			if Batch.Count > Batch.Capacity then
+				if Batch.Mesh ~= nil then
+					Batch.Mesh:release()
+				end
+				Batch.Capacity = math.max(Batch.Count, Batch.Capacity * 2, 16)
+				Batch.Mesh = love.graphics.newMesh(TRAIL_INSTANCE_FORMAT, Batch.Capacity, "triangles", "dynamic")
+			end
+			for j = Batch.Count + 1, #Batch.Vertices do
+				Batch.Vertices[j] = nil
+			end
+			Batch.Mesh:setVertices(Batch.Vertices)
+
+			-- strip meshes are shared by all trails with the same number of segments, so the attributes are attached right before drawing
+			for j = 1, #TRAIL_INSTANCE_FORMAT do
+				Batch.Strip:attachAttribute(TRAIL_INSTANCE_FORMAT[j][1], Batch.Mesh, "perinstance")
+			end
+			sendUniform(self.TrailShader, "meshTexture", Batch.Texture)
+			love.graphics.drawInstanced(Batch.Strip, Batch.Count)
+		else
+			-- batches of textures that are no longer used are removed so that the textures can be garbage collected
+			if Batch.Mesh ~= nil then
+				Batch.Mesh:release()
+			end
+			Batches.Lookup[Batch.Texture][Batch.Strip] = nil
+			if next(Batches.Lookup[Batch.Texture]) == nil then
+				Batches.Lookup[Batch.Texture] = nil
+			end
+			table.remove(Batches, i)
+		end
+	end
+end
+
+
+
+-- picks the level of detail of all basic meshes and instanced groups in the given per-frame arrays, see Mesh3:updateLOD() and Mesh3Group:updateLODs()
+local function updateLODs(arrays, x, y, z)
+	local arr
+	for _, key in ipairs({"BasicMeshes", "BasicTrip3"}) do
+		arr = arrays[key]
+		for i = 1, #arr do
+			if arr[i].LODs ~= nil and #arr[i].LODs > 0 then -- static batches have no levels of detail
+				arr[i]:updateLOD(x, y, z)
+			end
+		end
+	end
+	for _, key in ipairs({"InstancedMeshes", "InstancedTrip3"}) do
+		arr = arrays[key]
+		for i = 1, #arr do
+			arr[i]:updateLODs(x, y, z)
+		end
+	end
+end
+
+
+
+-- draws all instances of a mesh3group or trip3group, with one draw per level of detail if the group has any
+local function drawInstancedGroup(Group)
+	local Levels = Group.LODLevels
+	if Levels == nil then
+		love.graphics.drawInstanced(Group.Mesh, Group.Count)
+		return
+	end
+	for i = 1, #Levels do
+		if Levels[i].Count > 0 then
+			love.graphics.drawInstanced(Levels[i].Mesh, Levels[i].Count)
+		end
+	end
+end
+
+
+
+-- draws a basic mesh or trip3 with its current level of detail. While cross-fading, both levels are drawn with complementary dither patterns
+local function drawLOD(shader, Mesh)
+	if Mesh.LODFadeMesh == nil then
+		love.graphics.draw(Mesh.LODMesh or Mesh.Mesh)
+		return
+	end
+	sendUniform(shader, "lodDither", Mesh.LODFadeAmount)
+	love.graphics.draw(Mesh.LODMesh)
+	sendUniform(shader, "lodDither", -Mesh.LODFadeAmount)
+	love.graphics.draw(Mesh.LODFadeMesh)
+	sendUniform(shader, "lodDither", 0)
+end
+
+
+
+-- fills in a box for sphereInBox(). x, y is the center of the box and z is the depth it looks down from, all in the sun's view space
+local function setShadowBox(f, sun, x, y, z, halfX, halfY, near, far)
+	f.px = sun[13] + sun[1] * x + sun[5] * y + sun[9] * z
+	f.py = sun[14] + sun[2] * x + sun[6] * y + sun[10] * z
+	f.pz = sun[15] + sun[3] * x + sun[7] * y + sun[11] * z
+	f.rx, f.ry, f.rz = sun[1], sun[2], sun[3]
+	f.ux, f.uy, f.uz = sun[5], sun[6], sun[7]
+	f.bx, f.by, f.bz = sun[9], sun[10], sun[11]
+	f.halfX, f.halfY = halfX, halfY
+	f.near, f.far = near, far
+end
+
+
+
+-- orthographic projection from the sun's view space onto the same box as setShadowBox(). 'tile' and 'tiles' squeeze the result into one of the cascades
+-- that are placed side by side in the shadow canvas. Use 0 and 1 to get the cascade's own normalized coordinates
+local function getCascadeMatrix(x, y, z, halfX, halfY, near, far, tile, tiles)
+	local m33 = -2 / (far - near)
+	return matrix4.new(
+		1 / (halfX * tiles), 0, 0, 0,
+		0, 1 / halfY, 0, 0,
+		0, 0, m33, 0,
+		-x / (halfX * tiles) + (2 * tile + 1) / tiles - 1, -y / halfY, -(far + near) / (far - near) - m33 * z, 1
+	)
+end
+
+
+
+-- updates the cascades for every shader that receives shadows. Only called when a cascade moved
+local function sendShadowCascades(self)
+	local Cascades = self.ShadowCascades
+	local matrices, splits = {}, {}
+	for i = 1, MAX_SHADOW_CASCADES do
+		local Cascade = Cascades.List[math.min(i, Cascades.Count)]
+		matrices[i] = {Cascade.Matrix:columns()}
+		splits[i] = Cascade.Split
+	end
+	setConstant(self, "shadowCascadeMatrices", unpack(matrices))
+	setConstant(self, "shadowCascadeSplits", splits)
+	setConstant(self, "shadowCascadeCount", Cascades.Count)
+end
+
+
+
+-- places the sun and, without cascades, the single shadow map using the settings from Scene3:setShadowMap(). Cascades are placed every frame in Scene3:updateShadowCascades()
+local function placeShadowMap(self)
+	local Cascades = self.ShadowCascades
+	local sun
+	if Cascades.Count == 1 then
+		sun = matrix4.lookAtWorld(Cascades.Position, Cascades.Direction) -- matrix of where the sun is
+	else
+		sun = matrix4.lookAtWorld(vector3(0, 0, 0), Cascades.Direction) -- cascades are placed relative to the world's origin
+	end
+	Cascades.SunMatrix = sun
+
+	setConstant(self, "sunWorldMatrix", sun) -- the shadow map shader draws with it, the other shaders need it to sample the shadow map
+
+	if Cascades.Count == 1 then
+		local Cascade = Cascades.List[1]
+		local halfX, halfY = Cascades.Size.x / 2, Cascades.Size.y / 2
+		setShadowBox(Cascade, sun, 0, 0, 0, halfX, halfY, 0.1, 100)
+		setShadowBox(self.ShadowFrustum, sun, 0, 0, 0, halfX, halfY, 0.1, 100) -- used to cull shadow casters that are outside of the shadow map
+		Cascade.Matrix = getCascadeMatrix(0, 0, 0, halfX, halfY, 0.1, 100, 0, 1)
+		Cascade.AtlasMatrix = Cascade.Matrix
+		Cascade.Split = 1000
+		sendShadowCascades(self)
+	else
+		for i = 1, Cascades.Count do
+			Cascades.List[i].X = nil -- the sun may have turned, so force the cascades to be placed again
+		end
+	end
+	self:invalidateShadowCache()
+end
+
+
+
+-- create new canvases (but only if their sizes are different from the current ones)
+-- this will make it possible to potentially move the shadowmap around every frame
+local function createShadowCanvases(self)
+	local Cascades = self.ShadowCascades
+	local width, height = Cascades.CanvasSize.x * Cascades.Count, Cascades.CanvasSize.y
+	if self.ShadowDepthCanvas ~= nil and self.ShadowDepthCanvas:getWidth() == width and self.ShadowDepthCanvas:getHeight() == height then
+		return
+	end
+
+	self.ShadowCanvas = love.graphics.newCanvas(Cascades.CanvasSize.x, Cascades.CanvasSize.y)
+	local shadowDepthCanvas = love.graphics.newCanvas(width, height,
+		{
+			["type"] = "2d";
+			["format"] = "depth24";
+			["readable"] = true;
+		}
+	)
+	self.ShadowDepthCanvas = shadowDepthCanvas
+	shadowDepthCanvas:setDepthSampleMode("less")
+
+	setConstant(self, "shadowCanvas", self.ShadowDepthCanvas)
+	setConstant(self, "shadowCanvasSize", {width, height}) -- the particles shader only takes 1 sample, so it has no use for the size
+end
+
+
+
+-- static shadow casters are kept in the shadow cache, see Scene3:setShadowCache()
+local shadowCached = setmetatable({}, {__mode = "k"}) -- [object] = true if it was drawn into the shadow cache. Instanced groups stop being static once edited
+local function isCachedCaster(Object)
+	if Object.LODLevels ~= nil or (Object.LODs ~= nil and #Object.LODs > 0) then
+		return false
+	end
+	return Object.Static == true or Object.Usage == "static"
+end
+
+
+
+-- draws the casters of the first shadow pass that overlap a cascade. 'cached' is nil to draw all casters, true to only draw the casters that go into the
+-- shadow cache and false to only draw the casters that don't
+local function drawShadowCasters(self, Cascade, cached)
+	local Casters = self.ShadowCasters
+	local Mesh
+	local Shader = useShader(self, self.ShadowMapShader, VARIANT_INSTANCED)
+	sendMatrix(Shader, "orthoMatrix", Cascade.AtlasMatrix)
+	sendUniform(Shader, "meshTexture", blankImage) -- for instanced meshes, assume texture is opaque (otherwise you'd use foliage3)
+
+	for _, key in ipairs({"InstancedMeshes", "InstancedTrip3"}) do
+		for i = 1, #Casters[key] do
+			Mesh = Casters[key][i]
+			if Mesh.CastShadow and (cached == nil or isCachedCaster(Mesh) == cached) and sphereInBox(Cascade, getWorldBounds(Mesh)) then
+				drawInstancedGroup(Mesh)
+				if cached then
+					shadowCached[Mesh] = true
+				end
+			end
+		end
+	end
+
+	Shader = useShader(self, self.ShadowMapShader)
+	sendMatrix(Shader, "orthoMatrix", Cascade.AtlasMatrix)
+	sendUniform(Shader, "meshTexture", blankImage)
+	for i = 1, #Casters.BasicMeshes do
+		Mesh = Casters.BasicMeshes[i]
+		if Mesh.CastShadow and (cached == nil or isCachedCaster(Mesh) == cached) and sphereInBox(Cascade, getWorldBounds(Mesh)) then
+			sendMatrix(Shader, "meshMatrix", Mesh.Matrix)
+			love.graphics.draw(Mesh.LODMesh or Mesh.Mesh)
+		end
+	end
+
+	local lastKey = nil
+	for i = 1, #Casters.BasicTrip3 do -- sorted by material, so the texture only changes when the material key changes
+		Mesh = Casters.BasicTrip3[i]
+		if Mesh.CastShadow and (cached == nil or isCachedCaster(Mesh) == cached) and sphereInBox(Cascade, getWorldBounds(Mesh)) then
+			if materialKeys[Mesh] ~= lastKey then
+				lastKey = materialKeys[Mesh]
+				sendUniform(Shader, "meshTexture", Mesh.Texture or blankImage)
+			end
+			sendMatrix(Shader, "meshMatrix", Mesh.Matrix)
+			love.graphics.draw(Mesh.LODMesh or Mesh.Mesh)
+		end
+	end
+end
+
+
+
+-- returns true if anything in view has bloom, otherwise the bloom canvas is empty and the bloom passes can be culled
+local function hasBloom(self)
+	if self.BloomStrength <= 0 then
+		return false
+	end
+	for _, Objects in pairs(self.Visible) do
+		for i = 1, #Objects do
+			if Objects[i].Bloom ~= nil and Objects[i].Bloom > 0 then
+				return true
+			end
+		end
+	end
+	return false
+end
+
+
+
+-- steps the particles of emitters that collide with the scene, see Particles3:setCollision(). This runs after the scene is drawn, so that the
+-- particles collide with the depth canvas of the current frame, and before the particles are drawn so that they are drawn at their new positions
+local function simulateParticles(self)
+	local simulating = false
+	for i = 1, #self.Particles do
+		local Particles = self.Particles[i]
+		if Particles.Simulation ~= nil then
+			if not simulating then
+				simulating = true
+				love.graphics.push("all")
+				love.graphics.origin()
+				love.graphics.setBlendMode("replace", "premultiplied")
+				love.graphics.setDepthMode("always", false)
+				love.graphics.setPointSize(1)
+				love.graphics.setColor(1, 1, 1, 1)
+			end
+			local mask = (Particles.Heightfield ~= nil and VARIANT_HEIGHTFIELD or 0) + (Particles.Collision == "die" and VARIANT_DIES or 0)
+			local Shader = useShader(self, self.ParticleSimShader, mask)
+			if Particles.Heightfield == nil then
+				sendUniform(Shader, "depthTexture", self.DepthCanvas)
+			end
+			Particles:simulate(Shader)
+		end
+	end
+	if simulating then
+		love.graphics.pop()
+	end
+end
+
+
+
+-- returns true if any attached particles or trails have their Blends property set to 'blends'. Emitters without live particles are ignored
+local function hasVFX(self, blends)
+	for i = 1, #self.Particles do
+		if self.Particles[i].Blends == blends and self.Particles[i]:hasLiveParticles() then
+			return true
+		end
+	end
+	for i = 1, #self.Trails do
+		if self.Trails[i].Blends == blends then
+			return true
+		end
+	end
+	return false
+end
+
+
+
+-- ambient occlusion passes. The canvas of each pass is set by the render graph
+-- 'AODepth' and 'AONormal' are the depth and normal canvases at the resolution of the ambient occlusion, see buildAOGraph()
+
+-- halves the depth & normal canvases, taking the closest depth of each 2x2 block together with its normal
+local function passAODownsample(self, sourceDepthName, sourceNormalName, targetName)
+	local source = self.AOGraph:get(sourceDepthName)
+	local target = self.AOGraph:get(targetName)
+	love.graphics.setShader(self.AODownsampleShader)
+	sendUniform(self.AODownsampleShader, "sourceDepth", source)
+	sendUniform(self.AODownsampleShader, "sourceNormal", self.AOGraph:get(sourceNormalName))
+	sendVector(self.AODownsampleShader, "sourceSize", source:getWidth(), source:getHeight())
+	sendVector(self.AODownsampleShader, "targetSize", target:getWidth(), target:getHeight())
+	love.graphics.draw(source, 0, 0, 0, target:getWidth() / source:getWidth(), target:getHeight() / source:getHeight())
+end
+
+local function passSSAO(self)
+	local depth = self.AOGraph:get("AODepth")
+	local scale = self.AOGraph:get("Occlusion"):getWidth() / depth:getWidth()
+	local samples = self.AOQuality == 1 and 24 or (self.AOQuality == 0.5 and 16 or 8)
+	if self.AOAccumulate then
+		-- fewer samples per frame, with the sample directions rotated every frame so that the accumulated result covers all of them
+		samples = samples / 2
+		self.AOFrame = self.AOFrame + 1
+		sendVector(self.SSAOShader, "noiseOffset", (self.AOFrame * 0.618034) % 1, (self.AOFrame * 0.381966) % 1)
+	end
+	useShader(self, self.SSAOShader)
+	sendUniform(self.SSAOShader, "samples", samples)
+	sendUniform(self.SSAOShader, "normalTexture", self.AOGraph:get("AONormal"))
+	love.graphics.draw(depth, 0, 0, 0, scale, scale) -- set the ambient occlusion shader in motion
+end
+
+-- blends this frame's ambient occlusion with last frame's, reprojected using the camera of last frame
+local function passAOTemporal(self)
+	local shader = useShader(self, self.AOTemporalShader)
+	sendUniform(shader, "historyTexture", self.AOGraph:get("AOHistoryPrevious"))
+	sendUniform(shader, "depthTexture", self.AOGraph:get("AODepth"))
+	if self.AOHistoryCamera ~= nil then
+		sendMatrix(shader, "prevViewMatrix", self.AOHistoryCamera:inverse())
+		sendUniform(shader, "historyWeight", AO_HISTORY_WEIGHT)
+	else
+		sendUniform(shader, "historyWeight", 0)
+	end
+	love.graphics.draw(self.AOGraph:get("Occlusion"))
+	self.AOHistoryCamera = self.Camera3.Matrix -- the camera replaces its matrix instead of changing it, so keeping a reference is enough
+end
+
+-- apply horizontal and vertical gaussian blur in two passes
+local function passAOBlurX(self)
+	local occlusion = self.AOGraph:get(self.AOAccumulate and "AOHistory" or "Occlusion")
+	love.graphics.setShader(self.AOBlurShader)
+	sendUniform(self.AOBlurShader, "depthTexture", self.AOGraph:get("AODepth"))
+	sendVector(self.AOBlurShader, "screenSize", occlusion:getWidth(), occlusion:getHeight())
+	sendVector(self.AOBlurShader, "blurDirection", 1, 0)
+	love.graphics.draw(occlusion)
+end
+
+local function passAOBlurY(self)
+	sendVector(self.AOBlurShader, "blurDirection", 0, 1)
+	love.graphics.draw(self.AOGraph:get("OcclusionBlurX"))
+end
+
+-- scales the blurred ambient occlusion back up to the scene's size, without letting it bleed across edges
+local function passAOUpsample(self)
+	local occlusion = self.AOGraph:get("OcclusionBlurred")
+	love.graphics.setShader(self.AOUpsampleShader)
+	sendUniform(self.AOUpsampleShader, "depthTexture", self.DepthCanvas)
+	sendUniform(self.AOUpsampleShader, "lowDepthTexture", self.AOGraph:get("AODepth"))
+	sendVector(self.AOUpsampleShader, "lowSize", occlusion:getWidth(), occlusion:getHeight())
+	love.graphics.draw(occlusion, 0, 0, 0, 1 / self.AOResolution, 1 / self.AOResolution)
+end
+
+-- blend the ambient occlusion result with whatever has been drawn already
+local function passAOBlend(self)
+	love.graphics.clear()
+	love.graphics.setShader(self.SSAOBlendShader) -- set the blend shader so we can apply ambient occlusion to the render canvas
+	sendUniform(self.SSAOBlendShader, "aoTexture", self.AOGraph:get(self.AOResolution < 1 and "OcclusionUpsampled" or "OcclusionBlurred"))
+	love.graphics.draw(self.RenderCanvas)
+end
+
+-- copy result to render canvas
+local function passAOCopy(self)
+	love.graphics.setShader()
+	love.graphics.draw(self.AOGraph:get("OcclusionResult"))
+end
+
+
+
+-- bloom passes. The bloom canvas will have mostly black pixels, but any mesh with bloom > 0 and a non-black color, will be drawn as a non-black color
+-- the idea is to blur the bloom canvas, then draw it over the scene using additive blending
+-- the blur halves the bloom canvas a number of times ('BloomMip1', 'BloomMip2', ...), then adds each halved canvas onto the next larger one on the way back up
+-- each level doubles the size of the blur, so large bloom costs only a few more tiny passes
+local function passBloomDownsample(self, source, scale)
+	love.graphics.setShader(self.BloomDownsampleShader)
+	sendVector(self.BloomDownsampleShader, "sourceSize", source:getWidth(), source:getHeight())
+	love.graphics.draw(source, 0, 0, 0, scale, scale)
+end
+
+local function passBloomUpsample(self, source, scale)
+	local blendMode, alphaMode = love.graphics.getBlendMode()
+	love.graphics.setBlendMode("add")
+	love.graphics.setShader(self.BloomUpsampleShader)
+	sendVector(self.BloomUpsampleShader, "sourceSize", source:getWidth(), source:getHeight())
+	love.graphics.draw(source, 0, 0, 0, scale, scale)
+	love.graphics.setBlendMode(blendMode, alphaMode)
+end
+
+-- BloomMip1 now holds the sum of all levels, which is averaged while drawing it over the scene
+local function passBloom(self)
+	local strength = 1 / self.BloomLevels
+	love.graphics.setColor(strength, strength, strength, 1)
+	passBloomUpsample(self, self.PostGraph:get("BloomMip1"), self.SSAA / self.BloomQuality)
+	love.graphics.setColor(1, 1, 1, 1)
+end
+
+
+
+-- draw any particles and trails that have no blending whatsoever directly to the render canvas. Typically these are particles without semi-transparency
+-- for non-blending particles and trails we do write depth and we do need depth testing
+local function passVFX(self)
+	love.graphics.setDepthMode("less", true) -- front-most non-blending particles appear on top
+	local Shader = useShader(self, self.ParticlesShader)
+	for i = 1, #self.Particles do
+		local Particles = self.Particles[i]
+		if not Particles.Blends then
+			local mask = Particles.Simulation ~= nil and VARIANT_SIMULATED or 0
+			if self.ParticlesShader:get(mask) ~= Shader then
+				Shader = useShader(self, self.ParticlesShader, mask)
+			end
+			Particles:draw(Shader)
+		end
+	end
+	drawTrails(self, false)
+end
+
+-- sum up the particles and trails that are set to blend into the two VFX canvases
+local function passVFXBlend(self)
+	local blendMode, alphaMode = love.graphics.getBlendMode()
+	love.graphics.clear(0, 0, 0, 1, false, false) -- don't clear depth or stencil
+	love.graphics.setDepthMode("less", false)
+	love.graphics.setBlendMode("add")
+	local Shader = useShader(self, self.ParticlesShader, VARIANT_BLENDS)
+	for i = 1, #self.Particles do
+		local Particles = self.Particles[i]
+		if Particles.Blends then
+			local mask = VARIANT_BLENDS + (Particles.Simulation ~= nil and VARIANT_SIMULATED or 0)
+			if self.ParticlesShader:get(mask) ~= Shader then
+				Shader = useShader(self, self.ParticlesShader, mask)
+			end
+			Particles:draw(Shader)
+		end
+	end
+	drawTrails(self, true)
+	love.graphics.setBlendMode(blendMode, alphaMode)
+end
+
+-- blend the particles that have blends=true onto the render canvas
+-- we draw to the render canvas using default blend settings, but the shader itself will 'blend' the particle fragments with each other during the write operation
+local function passVFXMix(self)
+	love.graphics.setDepthMode("always", false) -- don't set depth. Don't need to compare as it's already been done beforehand
+	love.graphics.setShader(self.VFXMixShader)
+	sendUniform(self.VFXMixShader, "countCanvas", self.PostGraph:get("VFXCount"))
+	love.graphics.setColor(1, 1, 1, 1)
+	love.graphics.draw(self.PostGraph:get("VFXColor"))
+end
+
+
+
+local function passFXAA(self)
+	love.graphics.setShader(self.FXAAShader)
+	sendVector(self.FXAAShader, "inverseScreenSize", 1 / self.RenderCanvas:getWidth(), 1 / self.RenderCanvas:getHeight())
+	love.graphics.draw(self.RenderCanvas)
+end
+
+
+
+-- builds the render graph for ambient occlusion, which depends on the canvas size and the settings from Scene3:setAOResolution()
+-- below full resolution, the depth & normal canvases are halved until they reach the resolution of the ambient occlusion. The ambient occlusion is
+-- calculated and blurred at that resolution and then upsampled before it is blended with the scene
+local function buildAOGraph(self, width, height)
+	local ssaa = self.SSAA
+	local resolution = self.AOResolution
+	local aoWidth, aoHeight = width * resolution, height * resolution
+
+	local AOGraph = rendergraph.new(self.CanvasPool)
+	AOGraph:import("RenderCanvas", self.RenderCanvas)
+	AOGraph:import("DepthCanvas", self.DepthCanvas)
+	AOGraph:import("NormalCanvas", self.NormalCanvas)
+
+	if resolution < 1 then
+		local levels = math.max(1, math.floor(math.log(ssaa / resolution) / math.log(2) + 0.5))
+		local sourceDepth, sourceNormal = "DepthCanvas", "NormalCanvas"
+		for i = 1, levels do
+			local targetDepth = i == levels and "AODepth" or ("AODepth" .. i)
+			local targetNormal = i == levels and "AONormal" or ("AONormal" .. i)
+			local levelWidth = i == levels and aoWidth or math.max(aoWidth, width * ssaa / 2 ^ i)
+			local levelHeight = i == levels and aoHeight or math.max(aoHeight, height * ssaa / 2 ^ i)
+			AOGraph:create(targetDepth, levelWidth, levelHeight, "r32f", "nearest")
+			AOGraph:create(targetNormal, levelWidth, levelHeight, "normal", "nearest")
+			local depthName, normalName = sourceDepth, sourceNormal
+			AOGraph:addPass("downsample " .. i, {depthName, normalName}, {targetDepth, targetNormal}, function(scene)
+				passAODownsample(scene, depthName, normalName, targetDepth)
+			end)
+			sourceDepth, sourceNormal = targetDepth, targetNormal
+		end
+	else
+		AOGraph:import("AODepth", self.DepthCanvas)
+		AOGraph:import("AONormal", self.NormalCanvas)
+	end
+
+	local aoEnabled = function(scene) return scene.AOEnabled end
+	AOGraph:addPass("ssao", {"AODepth", "AONormal"}, {"Occlusion"}, passSSAO, aoEnabled)
+	AOGraph:create("Occlusion", aoWidth, aoHeight)
+
+	-- the two history canvases are swapped every frame in Scene3:applyAmbientOcclusion(), so they are owned by the scene instead of the pool
+	for i = 1, #self.AOHistory do
+		self.AOHistory[i]:release()
+		self.AOHistory[i] = nil
+	end
+	self.AOHistoryCamera = nil
+	local blurSource = "Occlusion"
+	if self.AOAccumulate then
+		for i = 1, 2 do
+			self.AOHistory[i] = love.graphics.newCanvas(aoWidth, aoHeight, {["format"] = "rg16f"}) -- r = ambient occlusion, g = linear depth
+		end
+		AOGraph:import("AOHistory", self.AOHistory[1])
+		AOGraph:import("AOHistoryPrevious", self.AOHistory[2])
+		AOGraph:addPass("temporal", {"Occlusion", "AODepth", "AOHistoryPrevious"}, {"AOHistory"}, passAOTemporal)
+		blurSource = "AOHistory"
+	end
+
+	AOGraph:addPass("blur x", {blurSource, "AODepth"}, {"OcclusionBlurX"}, passAOBlurX, aoEnabled) -- the history is imported, so it would not cull this pass on its own
+	AOGraph:addPass("blur y", {"OcclusionBlurX", "AODepth"}, {"OcclusionBlurred"}, passAOBlurY)
+	AOGraph:create("OcclusionBlurX", aoWidth, aoHeight)
+	AOGraph:create("OcclusionBlurred", aoWidth, aoHeight)
+
+	local blended = "OcclusionBlurred"
+	if resolution < 1 then
+		AOGraph:addPass("upsample", {"OcclusionBlurred", "DepthCanvas", "AODepth"}, {"OcclusionUpsampled"}, passAOUpsample)
+		AOGraph:create("OcclusionUpsampled", width, height)
+		blended = "OcclusionUpsampled"
+	end
+
+	AOGraph:addPass("blend", {blended, "RenderCanvas", "NormalCanvas"}, {"OcclusionResult"}, passAOBlend)
+	AOGraph:addPass("copy", {"OcclusionResult"}, {"RenderCanvas"}, passAOCopy)
+	AOGraph:create("OcclusionResult", width * ssaa, height * ssaa, "srgba8")
+	self.AOGraph = AOGraph
+end
+
+
+
+-- builds the render graph for post-processing. It shares one canvas pool with the ambient occlusion graph, so canvases that are only needed for part of
+-- the frame (like the ambient occlusion canvases) are reused by later passes instead of each pass owning its own canvases
+local function newRenderGraphs(self)
+	self.CanvasPool = rendergraph.newPool()
+
+	local PostGraph = rendergraph.new(self.CanvasPool)
+	-- levels past Scene3.BloomLevels are culled, and so are the upsample passes that read from them
+	PostGraph:addPass("bloom down 1", {"BloomCanvas"}, {"BloomMip1"}, function(scene)
+		passBloomDownsample(scene, scene.BloomCanvas, scene.BloomQuality / scene.SSAA)
+	end, hasBloom)
+	for i = 2, MAX_BLOOM_LEVELS do
+		local source = "BloomMip" .. (i - 1)
+		PostGraph:addPass("bloom down " .. i, {source}, {"BloomMip" .. i}, function(scene)
+			passBloomDownsample(scene, scene.PostGraph:get(source), 0.5)
+		end, function(scene) return scene.BloomLevels >= i end)
+	end
+	for i = MAX_BLOOM_LEVELS - 1, 1, -1 do
+		local source = "BloomMip" .. (i + 1)
+		PostGraph:addPass("bloom up " .. i, {source, "BloomMip" .. i}, {"BloomMip" .. i}, function(scene)
+			passBloomUpsample(scene, scene.PostGraph:get(source), 2)
+		end)
+	end
+	PostGraph:addPass("bloom", {"BloomMip1"}, {"RenderCanvas"}, passBloom)
+	PostGraph:addPass("vfx", {}, {"RenderCanvas", ["depthstencil"] = "DepthCanvas"}, passVFX, function(scene) return hasVFX(scene, false) end)
+	PostGraph:addPass("vfx blend", {}, {"VFXColor", "VFXCount", ["depthstencil"] = "DepthCanvas"}, passVFXBlend, function(scene) return hasVFX(scene, true) end)
+	PostGraph:addPass("vfx mix", {"VFXColor", "VFXCount"}, {"RenderCanvas"}, passVFXMix)
+	PostGraph:addPass("fxaa", {"RenderCanvas"}, {"AntiAliased"}, passFXAA, function(scene) return scene.FXAA end)
+	self.PostGraph = PostGraph
+end
+
+
+
+-- the bloom canvases depend on the bloom quality, and the number of them that is used depends on the size of the bloom as well
+local function declareBloomCanvases(self)
+	local width, height = self.RenderCanvas:getWidth() / self.SSAA * self.BloomQuality, self.RenderCanvas:getHeight() / self.SSAA * self.BloomQuality
+
+	-- every level doubles the radius of the blur, which starts at roughly one pixel of the first (bloom quality sized) canvas
+	local levels = math.floor(math.log(math.max(1, self.BloomStrength * self.BloomQuality)) / math.log(2) + 0.5)
+	levels = math.max(1, math.min(levels, MAX_BLOOM_LEVELS))
+	while levels > 1 and math.min(width, height) / 2 ^ (levels - 1) < MIN_BLOOM_SIZE do
+		levels = levels - 1
+	end
+	self.BloomLevels = levels
+
+	for i = 1, MAX_BLOOM_LEVELS do
+		local scale = 2 ^ (i - 1)
+		self.PostGraph:create("BloomMip" .. i, math.max(1, math.ceil(width / scale)), math.max(1, math.ceil(height / scale)), "rgba16f")
+	end
+end
+
+
+
+-- points the render graphs at the new canvases and sizes after Scene3:rescaleCanvas()
+local function updateRenderGraphs(self, width, height, ssaa)
+	self.CanvasPool:clear()
+	self.PostGraph:import("RenderCanvas", self.RenderCanvas)
+	self.PostGraph:import("DepthCanvas", self.DepthCanvas)
+	self.PostGraph:import("NormalCanvas", self.NormalCanvas)
+	self.PostGraph:import("BloomCanvas", self.BloomCanvas)
+
+	-- ambient occlusion is calculated at the scene's size without SSAA, times the resolution from Scene3:setAOResolution()
+	buildAOGraph(self, width, height)
+
+	declareBloomCanvases(self)
+	self.PostGraph:create("VFXColor", width * ssaa, height * ssaa, "rgba32f") -- stores sum of colors in r, g and b. Alpha unused! (because it works uniquely with blend modes)
+	self.PostGraph:create("VFXCount", width * ssaa, height * ssaa, "rgba32f") -- stores in the 'r' channel the sum of fragments on that pixel and the 'g' channel is the alpha summed
+	self.PostGraph:create("AntiAliased", width * ssaa, height * ssaa, "srgba8")
+	self.PostGraph:setOutput("AntiAliased") -- stays alive until the end of Scene3:draw(), since billboards are drawn on top of it
+end
+
+
+
+----------------------------------------------------[[ == FUNCTIONS == ]]----------------------------------------------------
+
+-- check if an object is a scene
+local function isScene3(t)
+	return getmetatable(t) == Scene3
+end
+
+
+
+-- stores the camera's axes, position and field-of-view so that bounding spheres can be tested against the view frustum
+function Scene3:updateFrustum()
+	local m = self.Camera3.Matrix
+	local f = self.Frustum
+	local aspectRatio = self.RenderCanvas:getWidth() / self.RenderCanvas:getHeight()
+	f.px, f.py, f.pz = m[13], m[14], m[15]
+	f.rx, f.ry, f.rz = m[1], m[2], m[3]
+	f.ux, f.uy, f.uz = m[5], m[6], m[7]
+	f.bx, f.by, f.bz = m[9], m[10], m[11]
+	f.tanY = math.tan(self.Camera3.FieldOfView / 2)
+	f.tanX = f.tanY * aspectRatio
+	f.secY = math.sqrt(1 + f.tanY^2)
+	f.secX = math.sqrt(1 + f.tanX^2)
+	f.near = 0.1
+	f.far = 1000
+end
+
+
+
+-- fits each shadow cascade around a slice of the camera's view. A cascade is the bounding sphere of its slice, so its size stays the same when the camera turns
+-- and it only moves in whole texels of the shadow canvas (or bigger steps with the shadow cache) to keep shadow edges from shimmering while the camera moves
+function Scene3:updateShadowCascades()
+	local Cascades = self.ShadowCascades
+	local Cache = self.ShadowCache
+	local sun = Cascades.SunMatrix
+	local m = self.Camera3.Matrix
+	local tanY = math.tan(self.Camera3.FieldOfView / 2)
+	local tanX = tanY * self.RenderCanvas:getWidth() / self.RenderCanvas:getHeight()
+	local k = tanX * tanX + tanY * tanY
+	local count, near, far, lambda = Cascades.Count, 0.1, Cascades.Distance, Cascades.Lambda
+	local tileWidth = Cascades.CanvasSize.x
+
+	local changed = false
+	local minX, maxX, minY, maxY, minZ, maxZ = math.huge, -math.huge, math.huge, -math.huge, math.huge, -math.huge
+	local splitNear = near
+	for i = 1, count do
+		-- blend between logarithmic and evenly spaced splits, so close cascades get most of the resolution without far cascades getting too long
+		local t = i / count
+		local splitFar = lambda * near * (far / near) ^ t + (1 - lambda) * (near + (far - near) * t)
+		local depth = math.min((splitNear + splitFar) * (1 + k) / 2, splitFar) -- center of the smallest sphere around the slice
+		local radius = math.sqrt((splitFar - depth) ^ 2 + splitFar * splitFar * k)
+
+		-- the cascade is made slightly bigger than the sphere so that the slice is still covered after snapping its center to the grid
+		local halfSize, step
+		if Cache ~= nil then
+			halfSize = radius * (1 + SHADOW_CACHE_STEP / 2)
+			local texel = 2 * halfSize / tileWidth
+			step = texel * math.max(1, math.floor(radius * SHADOW_CACHE_STEP / texel))
+		else
+			halfSize = radius * tileWidth / (tileWidth - 1)
+			step = 2 * halfSize / tileWidth
+		end
+		local cx, cy, cz = m[13] - m[9] * depth, m[14] - m[10] * depth, m[15] - m[11] * depth -- the camera looks along its negative z-axis
+		local x = math.floor((cx * sun[1] + cy * sun[2] + cz * sun[3]) / step + 0.5) * step
+		local y = math.floor((cx * sun[5] + cy * sun[6] + cz * sun[7]) / step + 0.5) * step
+		local z = math.floor((cx * sun[9] + cy * sun[10] + cz * sun[11]) / step + 0.5) * step + SHADOW_CASTER_DEPTH
+		local depthRange = SHADOW_CASTER_DEPTH + halfSize
+
+		local Cascade = Cascades.List[i]
+		if Cascade.X ~= x or Cascade.Y ~= y or Cascade.Z ~= z or Cascade.HalfSize ~= halfSize or Cascade.Split ~= splitFar then
+			Cascade.X, Cascade.Y, Cascade.Z, Cascade.HalfSize, Cascade.Split = x, y, z, halfSize, splitFar
+			setShadowBox(Cascade, sun, x, y, z, halfSize, halfSize, 0, depthRange)
+			Cascade.Matrix = getCascadeMatrix(x, y, z, halfSize, halfSize, 0, depthRange, 0, 1)
+			Cascade.AtlasMatrix = getCascadeMatrix(x, y, z, halfSize, halfSize, 0, depthRange, i - 1, count)
+			if Cache ~= nil then
+				Cache.Valid[i] = false
+			end
+			changed = true
+		end
+
+		minX, maxX = math.min(minX, x - halfSize), math.max(maxX, x + halfSize)
+		minY, maxY = math.min(minY, y - halfSize), math.max(maxY, y + halfSize)
+		minZ, maxZ = math.min(minZ, z - depthRange), math.max(maxZ, z)
+		splitNear = splitFar
+	end
+
+	-- shadow casters are culled against a box around all cascades
+	if changed then
+		setShadowBox(self.ShadowFrustum, sun, (minX + maxX) / 2, (minY + maxY) / 2, maxZ, (maxX - minX) / 2, (maxY - minY) / 2, 0, maxZ - minZ)
+		sendShadowCascades(self)
+	end
+end
+
+
+
+-- fills the Visible and ShadowCasters arrays with the objects that should be drawn this frame
+function Scene3:cullObjects()
+	local Visible = self.Visible
+	local ShadowCasters = self.ShadowCasters
+	local RenderQueue = self.RenderQueue
+	local Batches = self.StaticBatches
+
+	-- upload the instances that were edited since the last frame, one ranged upload per group
+	-- a group that was in the shadow cache leaves its old shadow behind once it is edited
+	for i = 1, #self.InstancedMeshes do
+		if self.InstancedMeshes[i].DirtyFrom ~= nil then
+			self.InstancedMeshes[i]:flushInstances()
+			if shadowCached[self.InstancedMeshes[i]] then
+				shadowCached[self.InstancedMeshes[i]] = nil
+				self:invalidateShadowCache()
+			end
+		end
+	end
+	for i = 1, #self.InstancedTrip3 do
+		if self.InstancedTrip3[i].DirtyFrom ~= nil then
+			self.InstancedTrip3[i]:flushInstances()
+			if shadowCached[self.InstancedTrip3[i]] then
+				shadowCached[self.InstancedTrip3[i]] = nil
+				self:invalidateShadowCache()
+			end
+		end
+	end
+
+	if self.StaticDirty then
+		self.StaticDirty = false
+		self:bakeStatic()
+	end
+
+	if not self.FrustumCulling then
+		for key in pairs(Visible) do
+			Visible[key] = RenderQueue[key] or self[key]
+		end
+		for key in pairs(ShadowCasters) do
+			ShadowCasters[key] = RenderQueue[key] or self[key]
+		end
+		-- the static batches are added to the basic meshes below, so those need a copy of the queue. The copies are kept by the scene and reused
+		if #Batches > 0 then
+			Visible.BasicMeshes = cullArray(RenderQueue.BasicMeshes, self.UnculledCopies.Visible, alwaysTrue, nil, false)
+			ShadowCasters.BasicMeshes = cullArray(RenderQueue.BasicMeshes, self.UnculledCopies.ShadowCasters, alwaysTrue, nil, true)
+		end
+	else
+		self:updateFrustum()
+		for key, arr in pairs(Visible) do
+			local source = RenderQueue[key] or self[key] -- cull from the render queue if there is one, so that the results stay sorted by material
+			if arr == source then -- culling was disabled before, so stop writing into the scene's own arrays
+				arr = {}
+			end
+			if self.Octree ~= nil and (key == "BasicMeshes" or key == "BasicTrip3") then
+				Visible[key] = arr -- filled below
+			else
+				Visible[key] = cullArray(source, arr, sphereInFrustum, self.Frustum, false)
+			end
+		end
+		if self.Octree ~= nil then
+			cullOctree(self.Octree, Visible.BasicMeshes, Visible.BasicTrip3, sphereInFrustum, self.Frustum, false)
+		end
+
+		if self.ShadowCanvas ~= nil then
+			for key, arr in pairs(ShadowCasters) do
+				local source = RenderQueue[key] or self[key]
+				if arr == source then
+					arr = {}
+				end
+				if self.Octree ~= nil and (key == "BasicMeshes" or key == "BasicTrip3") then
+					ShadowCasters[key] = arr
+				else
+					ShadowCasters[key] = cullArray(source, arr, sphereInBox, self.ShadowFrustum, true)
+				end
+			end
+			if self.Octree ~= nil then
+				cullOctree(self.Octree, ShadowCasters.BasicMeshes, ShadowCasters.BasicTrip3, sphereInBox, self.ShadowFrustum, true)
+			end
+		end
+	end
+
+	-- static batches are drawn in the same passes as basic meshes
+	for i = 1, #Batches do
+		local x, y, z, r = getWorldBounds(Batches[i])
+		if not self.FrustumCulling or sphereInFrustum(self.Frustum, x, y, z, r) then
+			Visible.BasicMeshes[#Visible.BasicMeshes + 1] = Batches[i]
+		end
+		if Batches[i].CastShadow and self.ShadowCanvas ~= nil and (not self.FrustumCulling or sphereInBox(self.ShadowFrustum, x, y, z, r)) then
+			ShadowCasters.BasicMeshes[#ShadowCasters.BasicMeshes + 1] = Batches[i]
+		end
+	end
+
+	-- pick up any material changes of meshes that are about to be drawn
+	local fromOctree = self.FrustumCulling and self.Octree ~= nil
+	for key, queue in pairs(RenderQueue) do
+		local unordered = (fromOctree and key ~= "SpriteMeshes") or (key == "BasicMeshes" and #Batches > 0)
+		sortByMaterial(Visible[key], queue, unordered)
+		if ShadowCasters[key] ~= nil and self.ShadowCanvas ~= nil then
+			sortByMaterial(ShadowCasters[key], queue, unordered)
+		end
+	end
+
+	-- levels of detail are picked by the distance to the camera, also for shadow casters so their shadows match what is drawn
+	local m = self.Camera3.Matrix
+	updateLODs(Visible, m[13], m[14], m[15])
+	if self.ShadowCanvas ~= nil then
+		updateLODs(ShadowCasters, m[13], m[14], m[15])
+	end
+end
+
+
+
+-- bins all lights that are in view into the clusters they touch and uploads the result, so that each fragment only has to loop over
+-- the lights near it. The cluster a fragment is in is found the same way in getLightCluster() in the shaders
+function Scene3:updateLightClusters()
+	self:updateFrustum()
+	local f = self.Frustum
+	local Clusters = self.LightClusters
+	local LightData, ClusterData, IndexData = Clusters.LightData, Clusters.ClusterData, Clusters.IndexData
+	local Lights = self.Lights
+	local sliceScale = CLUSTER_Z / math.log(f.far / f.near)
+	local tilesXY = CLUSTER_X * CLUSTER_Y
+
+	-- the clusters and the camera uniforms only depend on the camera and the lights, so there is nothing to do if neither changed
+	if not lightClustersChanged(Clusters, f, Lights) then
+		return
+	end
+
+	-- first pass: find the clusters each light in view touches and count the lights in each cluster
+	local count = 0
+	for i = 1, #Lights do
+		local light = Lights[i]
+		local x, y, z, r = light.Position.x, light.Position.y, light.Position.z, light.Range
+		if count < MAX_LIGHTS and light.Strength ~= 0 and sphereInFrustum(f, x, y, z, r) then
+			local dx, dy, dz = x - f.px, y - f.py, z - f.pz
+			local depth = -(dx * f.bx + dy * f.by + dz * f.bz)
+			local vx = dx * f.rx + dy * f.ry + dz * f.rz
+			local vy = dx * f.ux + dy * f.uy + dz * f.uz
+			local dMin = math.max(depth - r, f.near)
+			local dMax = math.max(math.min(depth + r, f.far), dMin)
+
+			count = count + 1
+			local tiles = lightTiles[count]
+			if tiles == nil then
+				tiles = {}
+				lightTiles[count] = tiles
+			end
+			tiles[1], tiles[2] = getTileRange(vx - r, vx + r, dMin, dMax, f.tanX, CLUSTER_X)
+			tiles[3], tiles[4] = getTileRange(vy - r, vy + r, dMin, dMax, f.tanY, CLUSTER_Y)
+			tiles[5] = math.max(0, math.min(CLUSTER_Z - 1, math.floor(math.log(dMin / f.near) * sliceScale)))
+			tiles[6] = math.max(0, math.min(CLUSTER_Z - 1, math.floor(math.log(dMax / f.near) * sliceScale)))
+			for cz = tiles[5], tiles[6] do
+				for cy = tiles[3], tiles[4] do
+					local base = cz * tilesXY + cy * CLUSTER_X + 1
+					for cx = tiles[1], tiles[2] do
+						clusterCounts[base + cx] = clusterCounts[base + cx] + 1
+					end
+				end
+			end
+
+			LightData:setPixel(count - 1, 0, x, y, z, r)
+			LightData:setPixel(count - 1, 1, light.Color.r, light.Color.g, light.Color.b, light.Strength)
+		end
+	end
+
+	-- assign each cluster its own range in the light indices texture. Clusters that no longer fit are cut short
+	local capacity = LIGHT_INDICES_WIDTH * LIGHT_INDICES_HEIGHT
+	local offset = 0
+	local overflow = false
+	for i = 1, tilesXY * CLUSTER_Z do
+		local n = clusterCounts[i]
+		if offset + n > capacity then
+			n = capacity - offset
+			overflow = true
+		end
+		ClusterData:setPixel((i - 1) % tilesXY, math.floor((i - 1) / tilesXY), offset, n, 0, 0)
+		clusterOffsets[i] = offset
+		clusterCounts[i] = offset + n -- the end of the cluster's range, so the counts are reset for the next frame in the second pass
+		offset = offset + n
+	end
+
+	-- second pass: write the light indices into the ranges of the clusters
+	for l = 1, count do
+		local tiles = lightTiles[l]
+		for cz = tiles[5], tiles[6] do
+			for cy = tiles[3], tiles[4] do
+				local base = cz * tilesXY + cy * CLUSTER_X + 1
+				for cx = tiles[1], tiles[2] do
+					local c = base + cx
+					local index = clusterOffsets[c]
+					if index < clusterCounts[c] then
+						IndexData:setPixel(index % LIGHT_INDICES_WIDTH, math.floor(index / LIGHT_INDICES_WIDTH), l - 1, 0, 0, 0)
+						clusterOffsets[c] = index + 1
+					end
+				end
+			end
+		end
+	end
+	for i = 1, tilesXY * CLUSTER_Z do
+		clusterCounts[i] = 0
+	end
+
+	Clusters.Count = count
+	Clusters.Overflow = overflow
+	Clusters.LightDataImage:replacePixels(LightData)
+	Clusters.ClusterImage:replacePixels(ClusterData)
+	if offset > 0 then
+		Clusters.IndexImage:replacePixels(IndexData)
+	end
+
+	for i = 1, #Clusters.Shaders do
+		local shader = Clusters.Shaders[i]
+		sendVector(shader, "clusterCameraPosition", f.px, f.py, f.pz)
+		sendVector(shader, "clusterCameraRight", f.rx, f.ry, f.rz)
+		sendVector(shader, "clusterCameraUp", f.ux, f.uy, f.uz)
+		sendVector(shader, "clusterCameraBack", f.bx, f.by, f.bz)
+		sendVector(shader, "clusterTan", f.tanX, f.tanY)
+		sendVector(shader, "clusterDepth", f.near, sliceScale)
+	end
+end
+
+
+
+-- enables a loose octree that holds all attached mesh3 and trip3 instances. This speeds up culling in scenes with many static props
+-- and is needed for Scene3:getMeshesInRange() and Scene3:getMeshesOnRay(). Meshes far outside of the octree's region still work, but are slower to query
+function Scene3:setOctree(state, position, size, maxDepth)
+	assert(position == nil or vector3.isVector3(position), "Scene3:setOctree(state, position, size, maxDepth) requires argument 'position' to be nil or a vector3.")
+	if not state then
+		self.Octree = nil
+		return
+	end
+
+	self.Octree = octree.new(position ~= nil and position or vector3(0, 0, 0), size ~= nil and size or 2048, maxDepth)
+	for i = 1, #self.BasicMeshes do
+		if bakedInto[self.BasicMeshes[i]] == nil then -- baked meshes are drawn through their batch instead
+			self.Octree:insert(self.BasicMeshes[i], getWorldBounds(self.BasicMeshes[i]))
+		end
+	end
+	for i = 1, #self.BasicTrip3 do
+		self.Octree:insert(self.BasicTrip3[i], getWorldBounds(self.BasicTrip3[i]))
+	end
+end
+
+
+
+-- called by mesh3 and trip3 whenever their matrix is rebuilt, so that they are moved to the right place in the octree
+function Scene3:updateMeshBounds(mesh)
+	-- a static mesh that moves leaves its old shadow behind in the shadow cache
+	if mesh.Static then
+		self:invalidateShadowCache()
+	end
+	-- moving a baked mesh breaks up its batch. The mesh is no longer treated as static, but the rest of the batch is baked again next frame
+	if bakedInto[mesh] ~= nil and bakedInto[mesh].Scene3 == self then
+		mesh.Static = false
+		self:unbakeStatic(bakedInto[mesh])
+		self.StaticDirty = true
+	end
+	if self.Octree ~= nil then
+		self.Octree:update(mesh, getWorldBounds(mesh))
+	end
+end
+
+
+
+-- merges the given mesh3 instances into a few big meshes with the vertices already transformed to world space, grouped by material and by cell of
+-- 'cellSize' world units (STATIC_CELL_SIZE by default), so that a batch never spans the whole level and frustum, octree and occlusion culling still work
+-- if 'meshes' is nil, all attached mesh3 instances with Static set to true that are not baked yet are used
+-- baked meshes are flagged Static. If a baked mesh is moved or detached, its batch is broken up again. Changing the material of a baked mesh requires calling Scene3:unbakeStatic() and baking it again
+function Scene3:bakeStatic(meshes, cellSize)
+	assert(cellSize == nil or (type(cellSize) == "number" and cellSize > 0), "Scene3:bakeStatic(meshes, cellSize) requires argument 'cellSize' to be nil or a positive number.")
+	cellSize = cellSize or STATIC_CELL_SIZE
+	if meshes == nil then
+		meshes = {}
+		for i = 1, #self.BasicMeshes do
+			if self.BasicMeshes[i].Static and bakedInto[self.BasicMeshes[i]] == nil then
+				meshes[#meshes + 1] = self.BasicMeshes[i]
+			end
+		end
+	end
+
+	-- group meshes with the exact same material in the same cell together. Semi-transparent meshes and meshes with silhouettes are kept as they are
+	local groups = {}
+	local groupKeys = {}
+	local castersChanged = false -- meshes that become static move from the dynamic shadow pass into the shadow cache
+	for i = 1, #meshes do
+		local Mesh = meshes[i]
+		assert(mesh3.isMesh3(Mesh) and Mesh.Scene == self, "Scene3:bakeStatic(meshes) requires argument 'meshes' to be nil or an array of mesh3 instances that are attached to the scene.")
+		if not Mesh.Static then
+			castersChanged = true
+		end
+		Mesh.Static = true
+		if bakedInto[Mesh] == nil and Mesh.Transparency == 0 and not Mesh.Silhouette and #Mesh.LODs == 0 and Mesh.Mesh:getDrawMode() == "triangles" and Mesh.Mesh:getVertexCount() <= MAX_BATCH_VERTICES then
+			local x, y, z = getWorldBounds(Mesh)
+			local key = getBatchKey(Mesh) .. "|" .. math.floor(x / cellSize) .. "," .. math.floor(y / cellSize) .. "," .. math.floor(z / cellSize)
+			if groups[key] == nil then
+				groups[key] = {}
+				groupKeys[#groupKeys + 1] = key
+			end
+			table.insert(groups[key], Mesh)
+		end
+	end
+
+	local batches = {}
+	for g = 1, #groupKeys do
+		local group = groups[groupKeys[g]]
+		local index = 1
+		while index <= #group do
+			-- fill up a batch until it would exceed the vertex limit
+			local members = {}
+			local vertexCount = 0
+			while index <= #group and vertexCount + group[index].Mesh:getVertexCount() <= MAX_BATCH_VERTICES do
+				members[#members + 1] = group[index]
+				vertexCount = vertexCount + group[index].Mesh:getVertexCount()
+				index = index + 1
+			end
+
+			local vertices = {}
+			local vertexMap = nil
+			for i = 1, #members do
+				local firstVertex = #vertices
+				local map = members[i].Mesh:getVertexMap()
+				if map ~= nil and vertexMap == nil then
+					-- from here on a vertex map is needed, so add one for all vertices merged so far
+					vertexMap = {}
+					for k = 1, firstVertex do
+						vertexMap[k] = k
+					end
+				end
+				appendTransformedVertices(members[i], vertices)
+				if vertexMap ~= nil then
+					if map ~= nil then
+						for k = 1, #map do
+							vertexMap[#vertexMap + 1] = map[k] + firstVertex
+						end
+					else
+						for k = firstVertex + 1, #vertices do
+							vertexMap[#vertexMap + 1] = k
+						end
+					end
+				end
+			end
+
+			local merged = love.graphics.newMesh(members[1].Mesh:getVertexFormat(), vertices, "triangles", "static")
+			if vertexMap ~= nil then
+				merged:setVertexMap(vertexMap)
+			end
+
+			-- the batch is a regular mesh3 (so it can go through all the same passes), with the material copied from its members
+			local First = members[1]
+			local Batch = mesh3.new(merged, nil, nil, nil, First.Color, First.ColorShadow)
+			Batch.Texture = First.Texture
+			Batch.NormalMap = First.NormalMap
+			Batch.Brightness = First.Brightness
+			Batch.Reflectance = First.Reflectance
+			Batch.Bloom = First.Bloom
+			Batch.FresnelColor = color(First.FresnelColor)
+			Batch.FresnelStrength = First.FresnelStrength
+			Batch.FresnelPower = First.FresnelPower
+			Batch.Masked = First.Masked
+			Batch.UVVelocity = vector2(First.UVVelocity)
+			Batch.CastShadow = First.CastShadow
+			Batch.Static = true -- keeps the batch in the shadow cache, see Scene3:setShadowCache()
+			Batch.Members = members
+			Batch.Scene3 = self -- not 'Scene' since the batch itself is never attached
+			materialKeys[Batch] = getMaterialKey(Batch)
+
+			for i = 1, #members do
+				bakedInto[members[i]] = Batch
+				removeFromRenderQueue(self, members[i])
+				if self.Octree ~= nil then
+					self.Octree:remove(members[i])
+				end
+			end
+			self.StaticBatches[#self.StaticBatches + 1] = Batch
+			batches[#batches + 1] = Batch
+		end
+	end
+
+	-- the batches replace their members in the shadow cache
+	if castersChanged or #batches > 0 then
+		self:invalidateShadowCache()
+	end
+
+	return batches
+end
+
+
+
+-- breaks up a batch created by Scene3:bakeStatic(), or all batches if 'batch' is nil. The meshes in it are drawn individually again
+function Scene3:unbakeStatic(batch)
+	if batch == nil then
+		while #self.StaticBatches > 0 do
+			self:unbakeStatic(self.StaticBatches[#self.StaticBatches])
+		end
+		return
+	end
+
+	for i = 1, #self.StaticBatches do
+		if self.StaticBatches[i] == batch then
+			table.remove(self.StaticBatches, i)
+			break
+		end
+	end
+	for i = 1, #batch.Members do
+		local Mesh = batch.Members[i]
+		bakedInto[Mesh] = nil
+		addToRenderQueue(self, Mesh)
+		if self.Octree ~= nil then
+			self.Octree:insert(Mesh, getWorldBounds(Mesh))
+		end
+	end
+	batch.Members = {}
+	batch.Mesh:release()
+	self:invalidateShadowCache() -- the members replace the batch in the shadow cache
+end
+
+
+
+-- returns an array of the mesh3 and trip3 instances whose bounds overlap the given sphere
+function Scene3:getMeshesInRange(position, radius)
+	assert(self.Octree ~= nil, "Scene3:getMeshesInRange(position, radius) requires the scene to have an octree. Call Scene3:setOctree(true) first.")
+	return self.Octree:getInRange(position, radius)
+end
+
+
+
+-- returns an array of the mesh3 and trip3 instances whose bounds are hit by the given line3 (extended into a ray), sorted from closest to furthest
+-- use together with Camera3:screenToRay() to find which meshes may be under the cursor, then check their triangles with line3:intersectTriangle()
+function Scene3:getMeshesOnRay(line, maxDistance)
+	assert(self.Octree ~= nil, "Scene3:getMeshesOnRay(line, maxDistance) requires the scene to have an octree. Call Scene3:setOctree(true) first.")
+	return self.Octree:atRay(line, maxDistance)
+end
+
+
+
+-- draws ambient occlusion onto the geometry drawn so far (which excludes semi-transparent meshes, sprite meshes & foliage)
+-- the passes are culled by the render graph when ambient occlusion is disabled, see newRenderGraphs()
+function Scene3:applyAmbientOcclusion()
+	if self.AOAccumulate then
+		-- last frame's result becomes the history that this frame is blended with
+		self.AOHistory[1], self.AOHistory[2] = self.AOHistory[2], self.AOHistory[1]
+		self.AOGraph:import("AOHistory", self.AOHistory[1])
+		self.AOGraph:import("AOHistoryPrevious", self.AOHistory[2])
+		if not self.AOEnabled then
+			self.AOHistoryCamera = nil -- the history is outdated by the time ambient occlusion is enabled again
+		end
+	end
+	if self.AOGraph:execute(self) > 0 then
+		-- revert canvas state
+		useShader(self, self.Shader)
+		setGeometryCanvas(self)
+	end
+end
+
+
+
+-- adds the contribution of all lights in view onto the opaque geometry drawn so far. Each light is drawn as one quad covering its range
+-- on the screen, which reads the depth, shading normal and albedo canvases to light the geometry behind it
+function Scene3:applyDeferredLights()
+	local Clusters = self.LightClusters
+	if Clusters.Count > 0 then
+		local blendMode, alphaMode = love.graphics.getBlendMode()
+		love.graphics.setCanvas(self.RenderCanvas)
+		love.graphics.setDepthMode("always", false)
+		love.graphics.setMeshCullMode("none")
+		love.graphics.setBlendMode("add", "premultiplied")
+		useShader(self, self.DeferredLightShader) -- the light data and diffuse strength are scene constants
+		sendUniform(self.DeferredLightShader, "depthTexture", self.DepthCanvas)
+		sendUniform(self.DeferredLightShader, "shadingNormalTexture", self.ShadingNormalCanvas)
+		sendUniform(self.DeferredLightShader, "albedoTexture", self.AlbedoCanvas)
+		love.graphics.drawInstanced(lightQuad, Clusters.Count)
+		love.graphics.setBlendMode(blendMode, alphaMode)
+	end
+
+	-- anything drawn after this pass (sprite meshes and transparent meshes) is lit by the forward lights again
+	sendUniform(self.Shader, "lightsDeferred", false)
+	sendUniform(self.TriplanarShader, "lightsDeferred", false)
+
+	-- revert canvas state
+	useShader(self, self.Shader)
+	love.graphics.setCanvas({self.RenderCanvas, self.NormalCanvas, self.BloomCanvas, ["depthstencil"] = self.DepthCanvas})
+	love.graphics.setDepthMode("lequal", true)
+	love.graphics.setMeshCullMode("back")
+end
+
+
+
+-- removes meshes and groups that are completely hidden behind the geometry from the depth pre-pass from the Visible arrays
+-- the depth canvas is reduced on the GPU to a small buffer that stores the furthest depth of each block. Reading that buffer back right away would
+-- make the CPU wait for the GPU to finish everything drawn so far, so the buffer of HIZ_LATENCY frames ago is read back instead, and objects are
+-- tested with the camera of that frame. Objects that come into view from behind an occluder can therefore show up HIZ_LATENCY frames late
+-- shadow casters are not affected, since an object that is hidden from the camera can still cast a shadow onto something in view
+function Scene3:cullOccluded()
+	local HiZ = self.HiZ
+	local sourceWidth, sourceHeight = self.DepthCanvas:getDimensions()
+	if HiZ.SourceWidth ~= sourceWidth or HiZ.SourceHeight ~= sourceHeight then
+		releaseHiZ(HiZ)
+		local width, height = sourceWidth, sourceHeight
+		local levels = 0
+		repeat
+			width, height = math.ceil(width / 4), math.ceil(height / 4)
+			levels = levels + 1
+			if width > HIZ_MAX_WIDTH then
+				local level = love.graphics.newCanvas(width, height, {["format"] = "r32f"})
+				level:setFilter("nearest", "nearest")
+				HiZ.Levels[#HiZ.Levels + 1] = level
+			end
+		until width <= HIZ_MAX_WIDTH
+		-- the last level is read back a few frames after it is drawn, so each frame in flight gets its own canvas and a copy of the camera it was drawn with
+		for i = 1, HIZ_LATENCY + 1 do
+			local canvas = love.graphics.newCanvas(width, height, {["format"] = "r32f"})
+			canvas:setFilter("nearest", "nearest")
+			HiZ.Readbacks[i] = {["Canvas"] = canvas; ["Frustum"] = {}; ["Written"] = false}
+		end
+		HiZ.SourceWidth, HiZ.SourceHeight = sourceWidth, sourceHeight
+		HiZ.SpanX, HiZ.SpanY = sourceWidth / 4^levels, sourceHeight / 4^levels
+	end
+
+	-- reduce the depth canvas one level at a time
+	local Readbacks = HiZ.Readbacks
+	local written = Readbacks[HiZ.Frame % #Readbacks + 1]
+	HiZ.Frame = HiZ.Frame + 1
+	local blendMode, alphaMode = love.graphics.getBlendMode()
+	love.graphics.setBlendMode("replace", "premultiplied")
+	love.graphics.setDepthMode("always", false)
+	love.graphics.setShader(self.HiZShader)
+	local source = self.DepthCanvas
+	for i = 1, #HiZ.Levels + 1 do
+		local level = HiZ.Levels[i] or written.Canvas
+		love.graphics.setCanvas(level)
+		sendUniform(self.HiZShader, "sourceDepth", source)
+		sendVector(self.HiZShader, "sourceSize", source:getWidth(), source:getHeight())
+		love.graphics.rectangle("fill", 0, 0, level:getWidth(), level:getHeight())
+		source = level
+	end
+	love.graphics.setCanvas()
+	love.graphics.setBlendMode(blendMode, alphaMode)
+	local f = self.Frustum
+	for k, v in pairs(f) do
+		written.Frustum[k] = v
+	end
+	written.Written = true
+
+	-- the oldest buffer is the one that is drawn to again next frame
+	local readback = Readbacks[HiZ.Frame % #Readbacks + 1]
+	self.BackgroundCovered = false
+	if not readback.Written then
+		self.OcclusionStats.Tested = 0
+		self.OcclusionStats.Culled = 0
+		love.graphics.setCanvas({["depthstencil"] = self.DepthCanvas})
+		love.graphics.setDepthMode("lequal", true)
+		return
+	end
+
+	-- test the bounds of each object against the read back depths, as seen from the camera they were drawn with
+	local depthData = readback.Canvas:newImageData()
+	local width, height = depthData:getDimensions()
+	local spanX, spanY = HiZ.SpanX, HiZ.SpanY
+	local old = readback.Frustum
+	local Visible = self.Visible
+	local tested, culled = 0, 0
+	for _, key in ipairs(OCCLUDABLE_KEYS) do
+		local arr = Visible[key]
+		local target = arr
+		if arr == self.RenderQueue[key] or arr == self[key] then -- frustum culling is disabled, so don't remove anything from the scene's own arrays
+			target = HiZ.Results[key]
+			Visible[key] = target
+		end
+		local count = #arr
+		local n = 0
+		for i = 1, count do
+			local Object = arr[i]
+			local x, y, z, r = getWorldBounds(Object)
+			-- silhouettes are drawn exactly where an object is hidden, so objects with one are never culled
+			if Object.Silhouette or not sphereOccluded(old, depthData, width, height, spanX, spanY, x, y, z, r) then
+				n = n + 1
+				target[n] = Object
+			end
+		end
+		for i = n + 1, #target do
+			target[i] = nil
+		end
+		tested = tested + count
+		culled = culled + count - n
+	end
+
+	-- the background only shows where the depth pre-pass left the far plane, which shows up as a block whose furthest depth is 1
+	-- this is only known for the camera the buffer was drawn with, so the background is always drawn while the camera moves
+	local covered = old.px == f.px and old.py == f.py and old.pz == f.pz and old.rx == f.rx and old.ry == f.ry and old.rz == f.rz
+		and old.ux == f.ux and old.uy == f.uy and old.uz == f.uz and old.tanY == f.tanY and old.tanX == f.tanX
+	for y = 0, height - 1 do
+		if not covered then
+			break
+		end
+		for x = 0, width - 1 do
+			if depthData:getPixel(x, y) >= 1 then
+				covered = false
+				break
+			end
+		end
+	end
+	self.BackgroundCovered = covered
+
+	depthData:release()
+	self.OcclusionStats.Tested = tested
+	self.OcclusionStats.Culled = culled
+
+	-- revert to the state the depth pre-pass left things in
+	love.graphics.setCanvas({["depthstencil"] = self.DepthCanvas})
+	love.graphics.setDepthMode("lequal", true)
+end
+
+
+
+-- semi-transparent meshes are normally sorted from far to near and drawn in that order. With order-independent transparency they are drawn in material
+-- order instead, summed into two extra canvases with weights that favor closer fragments, and then resolved onto the render canvas in one draw
+-- this is cheaper and handles intersecting meshes, but is an approximation: layers of similar depth are averaged rather than strictly layered
+function Scene3:setOrderIndependentTransparency(state)
+	assert(type(state) == "boolean", "Scene3:setOrderIndependentTransparency(state) requires argument 'state' to be a boolean.")
+	self.OrderIndependent = state
+end
+
+
+
+-- enables occlusion culling, which skips drawing meshes and groups that are hidden behind other geometry. It costs a few small extra
+-- passes and a read back from the GPU each frame, so it is only worth it in scenes where large meshes hide much of the scene
+-- meshes and groups with Silhouette set are never culled this way, since their silhouette is drawn exactly where they are hidden
+function Scene3:setOcclusionCulling(state)
+	assert(type(state) == "boolean", "Scene3:setOcclusionCulling(state) requires argument 'state' to be a boolean.")
+	self.OcclusionCulling = state
+	if not state then
+		releaseHiZ(self.HiZ)
+		self.OcclusionStats.Tested = 0
+		self.OcclusionStats.Culled = 0
+	end
+end
+
+
+
+-- applies bloom, draws particles & trails and applies FXAA. These are passes in the post-processing render graph, which culls the
+-- passes that have nothing to draw, see newRenderGraphs()
+function Scene3:applyPostProcessing()
+	simulateParticles(self)
+	local comp, write = love.graphics.getDepthMode()
+	love.graphics.setDepthMode("always", false)
+	self.PostGraph:execute(self)
+	love.graphics.setDepthMode(comp, write)
+end
+
+
+
+
+function Scene3:updateShadowMap(firstPass)
+	-- prepare for drawing
+	love.graphics.setMeshCullMode("none") -- "front" can be used to fix peter-panning, but prevents the backfaces from having any shadows!! that's why we set to "none"
+	love.graphics.setDepthMode("lequal", true)
+
+	-- only draw casters that fall within the sun's view. These arrays get filled in Scene3:cullObjects()
+	local Casters = self.ShadowCasters
+	local Cascades = self.ShadowCascades
+	local Cache = self.ShadowCache
+	local tileWidth, tileHeight = Cascades.CanvasSize.x, Cascades.CanvasSize.y
+	local sx, sy, sw, sh = love.graphics.getScissor()
+
+	if firstPass then -- first pass, which excludes foliage
+
+		if Cache ~= nil then
+			-- static casters are drawn into the cache only for cascades that moved or got invalidated, the rest of the time the cached depth is copied over
+			local width, height = self.ShadowDepthCanvas:getDimensions()
+			if Cache.Canvas == nil or Cache.Canvas:getWidth() ~= width or Cache.Canvas:getHeight() ~= height then
+				Cache.Canvas = love.graphics.newCanvas(width, height,
+					{
+						["type"] = "2d";
+						["format"] = "depth24";
+						["readable"] = true;
+					}
+				)
+				self:invalidateShadowCache()
+			end
+
+			love.graphics.setCanvas({["depthstencil"] = Cache.Canvas})
+			for i = 1, Cascades.Count do
+				if not Cache.Valid[i] then
+					profiler:pushLabel(CASCADE_LABELS[i])
+					love.graphics.setScissor((i - 1) * tileWidth, 0, tileWidth, tileHeight)
+					love.graphics.clear()
+					drawShadowCasters(self, Cascades.List[i], true)
+					Cache.Valid[i] = true
+					profiler:popLabel()
+				end
+			end
+			love.graphics.setScissor(sx, sy, sw, sh)
+
+			profiler:pushLabel("copy cache")
+			love.graphics.setCanvas({["depthstencil"] = self.ShadowDepthCanvas})
+			love.graphics.setDepthMode("always", true)
+			love.graphics.setShader(self.ShadowCopyShader)
+			self.ShadowCopyShader:send("cachedDepth", Cache.Canvas)
+			love.graphics.rectangle("fill", 0, 0, width, height)
+			love.graphics.setDepthMode("lequal", true)
+			profiler:popLabel()
+		else
+			love.graphics.setCanvas({["depthstencil"] = self.ShadowDepthCanvas})
+			profiler:pushLabel("clear")
+			love.graphics.clear() -- we should clear since if you remove an object, the shadow in that area won't get overwritten
+			profiler:popLabel()
+		end
+
+		-- render all meshes and instanced meshes that have shadows enabled to the shadow canvas, one cascade at a time
+		for i = 1, Cascades.Count do
+			profiler:pushLabel(CASCADE_LABELS[i])
+			if Cascades.Count > 1 then
+				love.graphics.setScissor((i - 1) * tileWidth, 0, tileWidth, tileHeight)
+			end
+			if Cache ~= nil then
+				drawShadowCasters(self, Cascades.List[i], false)
+			else
+				drawShadowCasters(self, Cascades.List[i])
+			end
+			profiler:popLabel()
+		end
+		love.graphics.setScissor(sx, sy, sw, sh)
+
+	else -- second pass, which includes foliage
+
+		love.graphics.setCanvas({["depthstencil"] = self.ShadowDepthCanvas})
+		local Shader = useShader(self, self.ShadowMapShader, VARIANT_INSTANCED) -- foliage is always instanced
+
+		if #Casters.Foliage > 0 then
+			profiler:pushLabel("foliage")
+			local Mesh
+			for i = 1, Cascades.Count do
+				local Cascade = Cascades.List[i]
+				if Cascades.Count > 1 then
+					love.graphics.setScissor((i - 1) * tileWidth, 0, tileWidth, tileHeight)
+				end
+				sendMatrix(Shader, "orthoMatrix", Cascade.AtlasMatrix)
+				for j = 1, #Casters.Foliage do -- foliage is always instanced
+					Mesh = Casters.Foliage[j]
+					if Mesh.CastShadow and sphereInBox(Cascade, getWorldBounds(Mesh)) then
+						sendUniform(Shader, "meshTexture", Mesh.Texture or blankImage) -- foliage will have alpha clipping, so sending over image is important
+						love.graphics.drawInstanced(Mesh.Mesh, Mesh.Count)
+					end
+				end
+			end
+			love.graphics.setScissor(sx, sy, sw, sh)
+			profiler:popLabel()
+		end
+
+	end
+
+	-- revert peter-panning
+	love.graphics.setMeshCullMode("back")
+end
+
+
+
+
+
+
+function Scene3:draw(renderTarget, x, y) -- nil or a canvas
+	if x == nil then x = 0 end
+	if y == nil then y = 0 end
+	-- get some graphics settings so they can be reverted later
+	local prevCanvas = love.graphics.getCanvas()
+	local prevDepthMode, prevWrite = love.graphics.getDepthMode()
+
+	profiler:pushLabel("scene3")
 	
 	-- no camera? don't draw anything!
 	if self.Camera3 == nil then
 		return
 	end
 
-	local TransMeshes = {} -- create new array to put all basic meshes in that have a Transparency > 0. Their rendering is postponed. They will be sorted later
+	local sentBefore, skippedBefore = uniformsSent, uniformsSkipped
+	setConstant(self, "currentTime", love.timer.getTime())
+
+	-- frustum culling, anything that is not in view of the camera (or the sun) won't be part of the arrays in Visible (or ShadowCasters)
+	profiler:pushLabel("culling")
+	if self.ShadowCanvas ~= nil and self.ShadowCascades.Count > 1 then
+		self:updateShadowCascades()
+	end
+	self:cullObjects()
+	local Visible = self.Visible
+	profiler:popLabel()
+
 	local Silhouettes = {} -- array where any meshes that have silhouettes are stored. They get evaluated later on and drawn on top if the mesh is occluded
 
-	-- blur shaders do sampling in 'pixel' coordinates while shaders work with normalized device coordinates
-	-- that means that if you resize your screen, blurs will need to be adjusted as well to compensate for the different canvas size
-	-- sending over shader variables every frame is unnecessary, so instead check if the canvas size has changed since last drawing operation
-	local width, height
-	if renderTarget ~= nil then
-		width, height = renderTarget:getDimensions()
-	else
-		width, height = love.graphics.getDimensions()
-	end
-	if self.LastDrawSize.x ~= width or self.LastDrawSize.y ~= height then
-		self.LastDrawSize = vector2(width, height)
-		self.AOBlurShader:send("screenSize", {width, height})
-		self.BloomBlurShader:send("screenSize", {width, height})
-	end
-
 
 	profiler:pushLabel("upd light")
 
 	-- update lights
-	local lightsInfo = {}
-	if self.LightsDirty then
-		for _, light in ipairs(self.Lights) do -- {posX, posY, posZ, range}, {colR, colG, colB, strength}
-			table.insert(lightsInfo, {light.Position.x, light.Position.y, light.Position.z, light.Range})
-			table.insert(lightsInfo, {light.Color.r, light.Color.g, light.Color.b, light.Strength})
-		end
-		self.LightsDirty = false
-	end
-	
-	if #lightsInfo > 0 then
-		self.Shader:send("lightsInfo", unpack(lightsInfo))
-		self.TriplanarShader:send("lightsInfo", unpack(lightsInfo))
-		self.FoliageShader:send("lightsInfo", unpack(lightsInfo))
-		self.PlantShader:send("lightsInfo", unpack(lightsInfo))
-		self.ParticlesShader:send("lightsInfo", unpack(lightsInfo))
-	end
+	self:updateLightClusters()
 
 	-- update blob shadows
 	local blobsInfo = {}
@@ -554,10 +2936,7 @@ function Scene3:draw(renderTarget, x, y) -- nil or a canvas
 		self.BlobsDirty = false
 	end
 	if #blobsInfo > 0 then
-		self.Shader:send("blobShadows", unpack(blobsInfo))
-		self.TriplanarShader:send("blobShadows", unpack(blobsInfo))
-		self.FoliageShader:send("blobShadows", unpack(blobsInfo))
-		self.PlantShader:send("blobShadows", unpack(blobsInfo))
+		setConstant(self, "blobShadows", unpack(blobsInfo))
 	end
 
 	profiler:popLabel()
@@ -567,7 +2946,7 @@ function Scene3:draw(renderTarget, x, y) -- nil or a canvas
 	-- set render canvas as target and clear it so a normal image can be drawn to it
 	--love.graphics.setCanvas({self.RenderCanvas, self.NormalCanvas, ["depthstencil"] = self.DepthCanvas}) -- set the main canvas so it can be cleared
 	profiler:pushLabel("clear")
-	love.graphics.setCanvas({self.RenderCanvas, self.BloomCanvas, ["depthstencil"] = self.DepthCanvas})
+	love.graphics.setCanvas({self.RenderCanvas, self.BloomCanvas, self.AlbedoCanvas, ["depthstencil"] = self.DepthCanvas})
 	love.graphics.clear()
 	--love.graphics.clear()
 	--love.graphics.setCanvas(self.BloomCanvas)
@@ -584,51 +2963,71 @@ function Scene3:draw(renderTarget, x, y) -- nil or a canvas
 	love.graphics.setDepthMode("lequal", true)
 	love.graphics.setCanvas({["depthstencil"] = self.DepthCanvas})
 
-	love.graphics.setShader(self.DepthShader)
-	self.DepthShader:send("isInstanced", true)
-	for i = 1, #self.InstancedMeshes do
-		love.graphics.drawInstanced(self.InstancedMeshes[i].Mesh, self.InstancedMeshes[i].Count)
+	-- masks go into the stencil buffer first, so that masked meshes leave holes in the depth as well
+	if #self.Masks > 0 then
+		profiler:pushLabel("masks")
+		love.graphics.setDepthMode("always", false)
+		drawMasks(self)
+		love.graphics.setDepthMode("lequal", true)
+		profiler:popLabel()
 	end
-	for i = 1, #self.InstancedTrip3 do
-		love.graphics.drawInstanced(self.InstancedTrip3[i].Mesh, self.InstancedTrip3[i].Count)
+
+	local DepthShader = useShader(self, self.DepthShader, VARIANT_INSTANCED)
+	for i = 1, #Visible.InstancedMeshes do
+		setMasked(Visible.InstancedMeshes[i].Masked)
+		drawInstancedGroup(Visible.InstancedMeshes[i])
 	end
-	self.DepthShader:send("isInstanced", false)
-	for i = 1, #self.BasicMeshes do
-		if self.BasicMeshes[i].Transparency == 0 then
-			local c1, c2, c3, c4 = self.BasicMeshes[i].Matrix:columns()
-			self.DepthShader:send("meshMatrix", {c1, c2, c3, c4})
-			love.graphics.draw(self.BasicMeshes[i].Mesh)
+	for i = 1, #Visible.InstancedTrip3 do
+		setMasked(Visible.InstancedTrip3[i].Masked)
+		drawInstancedGroup(Visible.InstancedTrip3[i])
+	end
+	DepthShader = useShader(self, self.DepthShader)
+	-- meshes that are cross-fading between two levels of detail are skipped, since either level alone would hide parts of the other
+	for i = 1, #Visible.BasicMeshes do
+		if Visible.BasicMeshes[i].Transparency == 0 and Visible.BasicMeshes[i].LODFadeMesh == nil then
+			setMasked(Visible.BasicMeshes[i].Masked)
+			sendMatrix(DepthShader, "meshMatrix", Visible.BasicMeshes[i].Matrix)
+			love.graphics.draw(Visible.BasicMeshes[i].LODMesh or Visible.BasicMeshes[i].Mesh)
 		end
 	end
-	for i = 1, #self.BasicTrip3 do
-		if self.BasicTrip3[i].Transparency == 0 then
-			local c1, c2, c3, c4 = self.BasicTrip3[i].Matrix:columns()
-			self.DepthShader:send("meshMatrix", {c1, c2, c3, c4})
-			love.graphics.draw(self.BasicTrip3[i].Mesh)
+	for i = 1, #Visible.BasicTrip3 do
+		if Visible.BasicTrip3[i].Transparency == 0 and Visible.BasicTrip3[i].LODFadeMesh == nil then
+			setMasked(Visible.BasicTrip3[i].Masked)
+			sendMatrix(DepthShader, "meshMatrix", Visible.BasicTrip3[i].Matrix)
+			love.graphics.draw(Visible.BasicTrip3[i].LODMesh or Visible.BasicTrip3[i].Mesh)
 		end
 	end
+	setMasked(false)
 
 	--[[
 	love.graphics.setShader(self.TriplanarDepthShader)
 	self.TriplanarDepthShader:send("isInstanced", true)
-	for i = 1, #self.InstancedTrip3 do
-		love.graphics.drawInstanced(self.InstancedTrip3[i].Mesh, self.InstancedTrip3[i].Count)
+	for i = 1, #Visible.InstancedTrip3 do
+		love.graphics.drawInstanced(Visible.InstancedTrip3[i].Mesh, Visible.InstancedTrip3[i].Count)
 	end
 	self.TriplanarDepthShader:send("isInstanced", false)
-	for i = 1, #self.BasicTrip3 do
-		if self.BasicTrip3[i].Transparency == 0 then
-			--self.TriplanarDepthShader:send("meshPosition", self.BasicTrip3[i].Position:array())
-			--self.TriplanarDepthShader:send("meshRotation", self.BasicTrip3[i].Rotation:array())
-			--self.TriplanarDepthShader:send("meshScale", self.BasicTrip3[i].Scale:array())
-			local c1, c2, c3, c4 = self.BasicTrip3[i].Matrix:columns()
+	for i = 1, #Visible.BasicTrip3 do
+		if Visible.BasicTrip3[i].Transparency == 0 then
+			--self.TriplanarDepthShader:send("meshPosition", Visible.BasicTrip3[i].Position:array())
+			--self.TriplanarDepthShader:send("meshRotation", Visible.BasicTrip3[i].Rotation:array())
+			--self.TriplanarDepthShader:send("meshScale", Visible.BasicTrip3[i].Scale:array())
+			local c1, c2, c3, c4 = Visible.BasicTrip3[i].Matrix:columns()
 			self.TriplanarDepthShader:send("meshMatrix", {c1, c2, c3, c4})
-			love.graphics.draw(self.BasicTrip3[i].Mesh)
+			love.graphics.draw(Visible.BasicTrip3[i].Mesh)
 		end
 	end
 	]]
 
 	profiler:popLabel()
 
+	-- skip anything that ended up hidden behind the geometry of the depth pre-pass
+	self.BackgroundCovered = false
+	if self.OcclusionCulling then
+		profiler:pushLabel("occlusion culling")
+		self:cullOccluded()
+		profiler:popLabel()
+	end
+
 
 
 
@@ -643,56 +3042,14 @@ function Scene3:draw(renderTarget, x, y) -- nil or a canvas
 
 	local renderWidth, renderHeight = self.RenderCanvas:getDimensions()
 
-	-- draw the background
-	-- TODO: move this to after geometry is drawn and do depth == 0 test so that you draw fewer pixels
-	if self.Background then
-		profiler:pushLabel("background")
-		love.graphics.setCanvas({self.RenderCanvas})
-		love.graphics.setDepthMode("always", false)
-		if self.Background:getTextureType() == "2d" then -- regular image
-			love.graphics.setShader() -- needs to be reset because shadow map might be enabled
-			local imgWidth, imgHeight = self.Background:getDimensions()
-			love.graphics.draw(self.Background, 0, 0, 0, renderWidth / imgWidth, renderHeight / imgHeight)
-		else -- cubemap image (render a skybox!)
-			love.graphics.setShader(self.SkyboxShader)
-			self.SkyboxShader:send("skyboxImage", self.Background)-- TODO: eliminate this uniform being sent every frame
-			love.graphics.draw(cubeMesh)
-		end
-		profiler:popLabel()
-	end
-
-
 	local blendMode = love.graphics.getBlendMode()
 
 
-	-- draw masks using 'lighten' blend mode because it stores the highest value for each channel
-	-- masks are drawn here because it just kinda works out well with minimizing canvas switches and masks need to be drawn very very early on
-
-	-- TODO: replace this with stencils? Should be a lot faster and give the same result right?
-	
-	if #self.Masks > 0 then
-		profiler:pushLabel("masks")
-		love.graphics.setMeshCullMode("back")
-		love.graphics.setShader(self.MaskShader)
-
-		-- draw the masks to the texture
-		love.graphics.setCanvas({self.MaskCanvas})
-		love.graphics.clear() -- clears to 0's
-		love.graphics.setBlendMode("lighten", "premultiplied") -- lighten only works with premultiplied
-		for i = 1, #self.Masks do
-			self.MaskShader:send("worldPosition", self.Masks[i].Position:array())
-			self.MaskShader:send("innerRadius", self.Masks[i].InnerRadius)
-			self.MaskShader:send("outerRadius", self.Masks[i].OuterRadius)
-			love.graphics.draw(self.Masks[i].Mesh)
-		end
-
-		profiler:popLabel()
-	end
 	
 
 
 	-- prep render settings
-	love.graphics.setCanvas({self.RenderCanvas, self.NormalCanvas, self.BloomCanvas, ["depthstencil"] = self.DepthCanvas}) -- set the main canvas with proper maps for geometry being drawn
+	setGeometryCanvas(self) -- set the main canvas with proper maps for geometry being drawn
 	love.graphics.setDepthMode("lequal", true)
 	love.graphics.setMeshCullMode("back")
 
@@ -702,20 +3059,25 @@ function Scene3:draw(renderTarget, x, y) -- nil or a canvas
 	-- that's why we need this blend mode trick to mask it from AO being applied during the ambient occlusion step. This does not apply to other vegetation types
 	love.graphics.setBlendMode("replace", "premultiplied")
 
+	-- with deferred lights, opaque geometry skips the point lights since they are added in Scene3:applyDeferredLights()
+	sendUniform(self.Shader, "lightsDeferred", self.DeferredLights)
+	sendUniform(self.TriplanarShader, "lightsDeferred", self.DeferredLights)
+	sendUniform(self.FoliageShader, "lightsDeferred", self.DeferredLights)
+
 	-- foliage is drawn first thing after the first shadowmap pass to prevent foliage from having self-shadows
-	if #self.Foliage > 0 then
+	if #Visible.Foliage > 0 then
 		profiler:pushLabel("foliage")
-		love.graphics.setShader(self.FoliageShader)
+		useShader(self, self.FoliageShader)
 		local Mesh = nil
-		for i = 1, #self.Foliage do
-			Mesh = self.Foliage[i]
-			self.FoliageShader:send("meshTexture", Mesh.Texture or blankImage)
-			self.FoliageShader:send("normalMap", Mesh.NormalMap or normalImage)
-			self.FoliageShader:send("meshBrightness", Mesh.Brightness)
-			self.FoliageShader:send("masked", Mesh.Masked and 1 or 0)
-			self.FoliageShader:send("currentTime", love.timer.getTime())
+		for i = 1, #Visible.Foliage do
+			Mesh = Visible.Foliage[i]
+			sendUniform(self.FoliageShader, "meshTexture", Mesh.Texture or blankImage)
+			sendUniform(self.FoliageShader, "normalMap", Mesh.NormalMap or normalImage)
+			sendUniform(self.FoliageShader, "meshBrightness", Mesh.Brightness)
+			setMasked(Mesh.Masked)
 			love.graphics.drawInstanced(Mesh.Mesh, Mesh.Count)
 		end
+		setMasked(false)
 		profiler:popLabel()
 	end
 	
@@ -727,167 +3089,170 @@ function Scene3:draw(renderTarget, x, y) -- nil or a canvas
 	if self.ShadowCanvas ~= nil then
 		profiler:pushLabel("shadow 2")
 		self:updateShadowMap(false)
-		love.graphics.setCanvas({self.RenderCanvas, self.NormalCanvas, self.BloomCanvas, ["depthstencil"] = self.DepthCanvas}) -- call setcanvas as updateShadowMap changes it
+		setGeometryCanvas(self) -- call setcanvas as updateShadowMap changes it
 		profiler:popLabel()
 	end
 
 
-	love.graphics.setShader(self.Shader)
-
-	self.Shader:send("currentTime", love.timer.getTime())
-
 	-- draw instanced (basic) meshes
-	if #self.InstancedMeshes > 0 then
+	if #Visible.InstancedMeshes > 0 then
 		profiler:pushLabel("inst")
 		local Mesh = nil
-		self.Shader:send("uvVelocity", {0, 0})
-		self.Shader:send("meshTransparency", 0)
-		self.Shader:send("isInstanced", true) -- tell the shader to use the attributes to calculate the model matrices
-		for i = 1, #self.InstancedMeshes do
-			Mesh = self.InstancedMeshes[i]
-			self.Shader:send("meshTexture", Mesh.Texture or blankImage)
-			self.Shader:send("normalMap", Mesh.NormalMap or normalImage)
-			self.Shader:send("meshBrightness", Mesh.Brightness)
-			self.Shader:send("meshReflectance", Mesh.Reflectance)
-			self.Shader:send("meshBloom", Mesh.Bloom)
-			self.Shader:send("meshFresnel", {Mesh.FresnelStrength, Mesh.FresnelPower})
-			self.Shader:send("meshFresnelColor", {Mesh.FresnelColor.r, Mesh.FresnelColor.g, Mesh.FresnelColor.b})
-			self.Shader:send("masked", Mesh.Masked and 1 or 0)
+		local Shader = useShader(self, self.Shader, VARIANT_INSTANCED) -- uses the attributes to calculate the model matrices
+		sendVector(Shader, "uvVelocity", 0, 0)
+		sendUniform(Shader, "meshTransparency", 0)
+		for i = 1, #Visible.InstancedMeshes do
+			Mesh = Visible.InstancedMeshes[i]
+			sendUniform(Shader, "meshTexture", Mesh.Texture or blankImage)
+			sendUniform(Shader, "normalMap", Mesh.NormalMap or normalImage)
+			sendUniform(Shader, "meshBrightness", Mesh.Brightness)
+			sendUniform(Shader, "meshReflectance", Mesh.Reflectance)
+			sendUniform(Shader, "meshBloom", Mesh.Bloom)
+			sendVector(Shader, "meshFresnel", Mesh.FresnelStrength, Mesh.FresnelPower)
+			sendVector(Shader, "meshFresnelColor", Mesh.FresnelColor.r, Mesh.FresnelColor.g, Mesh.FresnelColor.b)
+			setMasked(Mesh.Masked)
 			--self.Shader:send("triplanarScale", Mesh.IsTriplanar and Mesh.TextureScale or 0)
-			love.graphics.drawInstanced(Mesh.Mesh, Mesh.Count)
+			drawInstancedGroup(Mesh)
 			if Mesh.Silhouette then
 				table.insert(Silhouettes, Mesh)
 			end
 		end
+		setMasked(false)
 		profiler:popLabel()
 	end
 
 	-- then draw all *opaque* basic meshes
-	if #self.BasicMeshes > 0 then
+	if #Visible.BasicMeshes > 0 then
 		profiler:pushLabel("mesh")
 		local Mesh = nil
-		self.Shader:send("meshTransparency", 0) -- >0 transparency meshes are postponed until later
-		self.Shader:send("isInstanced", false) -- tell the shader to use the meshPosition, meshRotation, meshScale and meshColor uniforms to calculate the model matrices
-		for i = 1, #self.BasicMeshes do
-			Mesh = self.BasicMeshes[i]
+		local Shader = useShader(self, self.Shader) -- uses the meshMatrix and meshColor uniforms
+		sendUniform(Shader, "meshTransparency", 0) -- >0 transparency meshes are postponed until later
+		local lastKey = nil
+		for i = 1, #Visible.BasicMeshes do -- these are sorted by material, so textures only have to be rebound when the material key changes
+			Mesh = Visible.BasicMeshes[i]
 			if Mesh.Transparency == 0 then
-				self.Shader:send("normalMap", Mesh.NormalMap or normalImage)
-				self.Shader:send("uvVelocity", Mesh.UVVelocity:array())
-				self.Shader:send("meshTexture", Mesh.Texture or blankImage)
+				if materialKeys[Mesh] ~= lastKey then
+					lastKey = materialKeys[Mesh]
+					sendUniform(Shader, "normalMap", Mesh.NormalMap or normalImage)
+					sendUniform(Shader, "meshTexture", Mesh.Texture or blankImage)
+					setMasked(Mesh.Masked)
+				end
+				sendVector(Shader, "uvVelocity", Mesh.UVVelocity.x, Mesh.UVVelocity.y)
 				--self.Shader:send("meshPosition", Mesh.Position:array())
 				--self.Shader:send("meshRotation", Mesh.Rotation:array())
 				--self.Shader:send("meshScale", Mesh.Scale:array())
-				local c1, c2, c3, c4 = Mesh.Matrix:columns()
-				self.Shader:send("meshMatrix", {c1, c2, c3, c4})
-
-				self.Shader:send("meshColor", Mesh.Color:array())
-				self.Shader:send("meshColorShadow", Mesh.ColorShadow:array())
-				self.Shader:send("meshBrightness", Mesh.Brightness)
-				self.Shader:send("meshReflectance", Mesh.Reflectance)
-				self.Shader:send("meshBloom", Mesh.Bloom)
-				self.Shader:send("meshFresnel", {Mesh.FresnelStrength, Mesh.FresnelPower})
-				self.Shader:send("meshFresnelColor", {Mesh.FresnelColor.r, Mesh.FresnelColor.g, Mesh.FresnelColor.b})
-				self.Shader:send("masked", Mesh.Masked and 1 or 0)
+				sendMatrix(Shader, "meshMatrix", Mesh.Matrix)
+
+				sendVector(Shader, "meshColor", Mesh.Color.r, Mesh.Color.g, Mesh.Color.b)
+				sendVector(Shader, "meshColorShadow", Mesh.ColorShadow.r, Mesh.ColorShadow.g, Mesh.ColorShadow.b)
+				sendUniform(Shader, "meshBrightness", Mesh.Brightness)
+				sendUniform(Shader, "meshReflectance", Mesh.Reflectance)
+				sendUniform(Shader, "meshBloom", Mesh.Bloom)
+				sendVector(Shader, "meshFresnel", Mesh.FresnelStrength, Mesh.FresnelPower)
+				sendVector(Shader, "meshFresnelColor", Mesh.FresnelColor.r, Mesh.FresnelColor.g, Mesh.FresnelColor.b)
 				--self.Shader:send("triplanarScale", Mesh.IsTriplanar and Mesh.TextureScale or 0)
-				love.graphics.draw(Mesh.Mesh)
+				drawLOD(Shader, Mesh)
 			elseif Mesh.Transparency < 1 or Mesh.FresnelStrength > 0 then -- ignore meshes with transparency == 1 (unless they have fresnel)
-				table.insert(TransMeshes, Mesh)
+				queueTransparent(self, Mesh) -- meshes that have a Transparency > 0 are postponed, and drawn back to front later
 			end
 			if Mesh.Silhouette then
 				table.insert(Silhouettes, Mesh)
 			end
 		end
+		setMasked(false)
 		profiler:popLabel()
 	end
 
 
 	-- draw triplanar meshes here (and postpone trip3 meshes that are semi-transparent, or fully transparent with fresnel)
-	if #self.InstancedTrip3 > 0 then
+	if #Visible.InstancedTrip3 > 0 then
 		profiler:pushLabel("inst trip3")
-		love.graphics.setShader(self.TriplanarShader)
+		local Shader = useShader(self, self.TriplanarShader, VARIANT_INSTANCED) -- uses the attributes to calculate the model matrices
 		local Mesh = nil
 		--self.TriplanarShader:send("currentTime", love.timer.getTime())
 		--self.TriplanarShader:send("uvVelocity", {0, 0})
-		self.TriplanarShader:send("meshTransparency", 0)
-		self.TriplanarShader:send("isInstanced", true) -- tell the shader to use the attributes to calculate the model matrices
-		for i = 1, #self.InstancedTrip3 do
-			Mesh = self.InstancedTrip3[i]
-			self.TriplanarShader:send("meshTexture", Mesh.Texture or blankImage)
-			self.TriplanarShader:send("normalMap", Mesh.NormalMap or normalImage)
-			self.TriplanarShader:send("meshBrightness", Mesh.Brightness)
-			self.TriplanarShader:send("meshReflectance", Mesh.Reflectance)
-			self.TriplanarShader:send("meshBloom", Mesh.Bloom)
-			self.TriplanarShader:send("meshFresnel", {Mesh.FresnelStrength, Mesh.FresnelPower})
-			self.TriplanarShader:send("meshFresnelColor", {Mesh.FresnelColor.r, Mesh.FresnelColor.g, Mesh.FresnelColor.b})
-			self.TriplanarShader:send("triplanarScale", Mesh.TextureScale)
-			self.TriplanarShader:send("masked", Mesh.Masked and 1 or 0)
-			love.graphics.drawInstanced(Mesh.Mesh, Mesh.Count)
+		sendUniform(Shader, "meshTransparency", 0)
+		for i = 1, #Visible.InstancedTrip3 do
+			Mesh = Visible.InstancedTrip3[i]
+			sendUniform(Shader, "meshTexture", Mesh.Texture or blankImage)
+			sendUniform(Shader, "normalMap", Mesh.NormalMap or normalImage)
+			sendUniform(Shader, "meshBrightness", Mesh.Brightness)
+			sendUniform(Shader, "meshReflectance", Mesh.Reflectance)
+			sendUniform(Shader, "meshBloom", Mesh.Bloom)
+			sendVector(Shader, "meshFresnel", Mesh.FresnelStrength, Mesh.FresnelPower)
+			sendVector(Shader, "meshFresnelColor", Mesh.FresnelColor.r, Mesh.FresnelColor.g, Mesh.FresnelColor.b)
+			sendUniform(Shader, "triplanarScale", Mesh.TextureScale)
+			setMasked(Mesh.Masked)
+			drawInstancedGroup(Mesh)
 		end
+		setMasked(false)
 		profiler:popLabel()
 	end
 
 
 	-- then draw all *opaque* triplanar meshes
-	if #self.BasicTrip3 > 0 then
+	if #Visible.BasicTrip3 > 0 then
 		profiler:pushLabel("basic trip3")
 		local Mesh = nil
-		self.TriplanarShader:send("meshTransparency", 0) -- >0 transparency meshes are postponed until later
-		self.TriplanarShader:send("isInstanced", false) -- tell the shader to use the meshPosition, meshRotation, meshScale and meshColor uniforms to calculate the model matrices
-		for i = 1, #self.BasicTrip3 do
-			Mesh = self.BasicTrip3[i]
+		local Shader = useShader(self, self.TriplanarShader) -- uses the meshMatrix and meshColor uniforms
+		sendUniform(Shader, "meshTransparency", 0) -- >0 transparency meshes are postponed until later
+		local lastKey = nil
+		for i = 1, #Visible.BasicTrip3 do -- sorted by material, same as the basic meshes
+			Mesh = Visible.BasicTrip3[i]
 			if Mesh.Transparency == 0 then
-				self.TriplanarShader:send("normalMap", Mesh.NormalMap or normalImage)
-				self.TriplanarShader:send("meshTexture", Mesh.Texture or blankImage)
+				if materialKeys[Mesh] ~= lastKey then
+					lastKey = materialKeys[Mesh]
+					sendUniform(Shader, "normalMap", Mesh.NormalMap or normalImage)
+					sendUniform(Shader, "meshTexture", Mesh.Texture or blankImage)
+					setMasked(Mesh.Masked)
+				end
 				--self.TriplanarShader:send("meshPosition", Mesh.Position:array())
 				--self.TriplanarShader:send("meshRotation", Mesh.Rotation:array())
 				--self.TriplanarShader:send("meshScale", Mesh.Scale:array())
-				local c1, c2, c3, c4 = Mesh.Matrix:columns()
-				self.TriplanarShader:send("meshMatrix", {c1, c2, c3, c4})
-
-				self.TriplanarShader:send("meshColor", Mesh.Color:array())
-				self.TriplanarShader:send("meshColorShadow", Mesh.ColorShadow:array())
-				self.TriplanarShader:send("meshBrightness", Mesh.Brightness)
-				self.TriplanarShader:send("meshReflectance", Mesh.Reflectance)
-				self.TriplanarShader:send("meshBloom", Mesh.Bloom)
-				self.TriplanarShader:send("meshFresnel", {Mesh.FresnelStrength, Mesh.FresnelPower})
-				self.TriplanarShader:send("meshFresnelColor", {Mesh.FresnelColor.r, Mesh.FresnelColor.g, Mesh.FresnelColor.b})
-				self.TriplanarShader:send("triplanarScale", Mesh.TextureScale)
-				self.TriplanarShader:send("masked", Mesh.Masked and 1 or 0)
-				love.graphics.draw(Mesh.Mesh)
+				sendMatrix(Shader, "meshMatrix", Mesh.Matrix)
+
+				sendVector(Shader, "meshColor", Mesh.Color.r, Mesh.Color.g, Mesh.Color.b)
+				sendVector(Shader, "meshColorShadow", Mesh.ColorShadow.r, Mesh.ColorShadow.g, Mesh.ColorShadow.b)
+				sendUniform(Shader, "meshBrightness", Mesh.Brightness)
+				sendUniform(Shader, "meshReflectance", Mesh.Reflectance)
+				sendUniform(Shader, "meshBloom", Mesh.Bloom)
+				sendVector(Shader, "meshFresnel", Mesh.FresnelStrength, Mesh.FresnelPower)
+				sendVector(Shader, "meshFresnelColor", Mesh.FresnelColor.r, Mesh.FresnelColor.g, Mesh.FresnelColor.b)
+				sendUniform(Shader, "triplanarScale", Mesh.TextureScale)
+				drawLOD(Shader, Mesh)
 			elseif Mesh.Transparency < 1 or Mesh.FresnelStrength > 0 then -- ignore meshes with transparency == 1 (unless they have fresnel)
-				table.insert(TransMeshes, Mesh)
+				queueTransparent(self, Mesh) -- meshes that have a Transparency > 0 are postponed, and drawn back to front later
 			end
 		end
+		setMasked(false)
 		profiler:popLabel()
 	end
 
 	
 	
-	if #self.RippleMeshes > 0 then
+	if #Visible.RippleMeshes > 0 then
 		profiler:pushLabel("ripple meshes")
-		love.graphics.setShader(self.RippleShader)
-		self.RippleShader:send("currentTime", love.timer.getTime())
-		for i = 1, #self.RippleMeshes do
-			local RMesh = self.RippleMeshes[i]
-			self.RippleShader:send("meshTexture", RMesh.Texture or blankImage)
+		useShader(self, self.RippleShader)
+		for i = 1, #Visible.RippleMeshes do
+			local RMesh = Visible.RippleMeshes[i]
+			sendUniform(self.RippleShader, "meshTexture", RMesh.Texture or blankImage)
 			--self.RippleShader:send("meshPosition", RMesh.Position:array())
 			--self.RippleShader:send("meshRotation", RMesh.Rotation:array())
 			--self.RippleShader:send("meshScale", RMesh.Scale:array())
-			local c1, c2, c3, c4 = RMesh.Matrix:columns()
-			self.RippleShader:send("meshMatrix", {c1, c2, c3, c4})
-
-			self.RippleShader:send("meshColor", {RMesh.Color.r, RMesh.Color.g, RMesh.Color.b})
-			self.RippleShader:send("meshColorShadow", {RMesh.ColorShadow.r, RMesh.ColorShadow.g, RMesh.ColorShadow.b})
-			self.RippleShader:send("meshBrightness", RMesh.Brightness)
-			self.RippleShader:send("meshBloom", RMesh.Bloom)
-			self.RippleShader:send("meshFresnel", {RMesh.FresnelStrength, RMesh.FresnelPower})
-			self.RippleShader:send("meshFresnelColor", {RMesh.FresnelColor.r, RMesh.FresnelColor.g, RMesh.FresnelColor.b})
-			self.RippleShader:send("dataMap", RMesh.DataMap or dataImage)
-			self.RippleShader:send("foamInShadow", RMesh.FoamInShadow)
-			self.RippleShader:send("foamColor", {RMesh.FoamColor.r, RMesh.FoamColor.g, RMesh.FoamColor.b})
-			self.RippleShader:send("foamColorShadow", {RMesh.FoamColorShadow.r, RMesh.FoamColorShadow.g, RMesh.FoamColorShadow.b})
-			self.RippleShader:send("waterVelocity", RMesh.WaterVelocity:array())
-			self.RippleShader:send("foamVelocity", RMesh.FoamVelocity:array())
+			sendMatrix(self.RippleShader, "meshMatrix", RMesh.Matrix)
+
+			sendVector(self.RippleShader, "meshColor", RMesh.Color.r, RMesh.Color.g, RMesh.Color.b)
+			sendVector(self.RippleShader, "meshColorShadow", RMesh.ColorShadow.r, RMesh.ColorShadow.g, RMesh.ColorShadow.b)
+			sendUniform(self.RippleShader, "meshBrightness", RMesh.Brightness)
+			sendUniform(self.RippleShader, "meshBloom", RMesh.Bloom)
+			sendVector(self.RippleShader, "meshFresnel", RMesh.FresnelStrength, RMesh.FresnelPower)
+			sendVector(self.RippleShader, "meshFresnelColor", RMesh.FresnelColor.r, RMesh.FresnelColor.g, RMesh.FresnelColor.b)
+			sendUniform(self.RippleShader, "dataMap", RMesh.DataMap or dataImage)
+			sendUniform(self.RippleShader, "foamInShadow", RMesh.FoamInShadow)
+			sendVector(self.RippleShader, "foamColor", RMesh.FoamColor.r, RMesh.FoamColor.g, RMesh.FoamColor.b)
+			sendVector(self.RippleShader, "foamColorShadow", RMesh.FoamColorShadow.r, RMesh.FoamColorShadow.g, RMesh.FoamColorShadow.b)
+			sendVector(self.RippleShader, "waterVelocity", RMesh.WaterVelocity.x, RMesh.WaterVelocity.y, RMesh.WaterVelocity.z, RMesh.WaterVelocity.w)
+			sendVector(self.RippleShader, "foamVelocity", RMesh.FoamVelocity.x, RMesh.FoamVelocity.y, RMesh.FoamVelocity.z, RMesh.FoamVelocity.w)
 			love.graphics.draw(RMesh.Mesh)
 		end
 		profiler:popLabel()
@@ -895,27 +3260,33 @@ function Scene3:draw(renderTarget, x, y) -- nil or a canvas
 
 
 
-	-- apply ambient occlusion to geometry so far (which excludes semi-transparent meshes, sprite meshes & foliage)
-	if self.AOEnabled then
-		profiler:pushLabel("ambient occlusion")
-		love.graphics.setDepthMode("always", false)
-		self:applyAmbientOcclusion()
-		love.graphics.setDepthMode("lequal", true)
+	-- add point lights onto everything drawn so far. This happens before plants and sprite meshes, since those don't write to the albedo canvas
+	-- and before ambient occlusion, so the light that is added is occluded the same way the forward lights are
+	if self.DeferredLights then
+		profiler:pushLabel("deferred lights")
+		self:applyDeferredLights()
 		profiler:popLabel()
 	end
 
 
+	-- apply ambient occlusion to geometry so far (which excludes semi-transparent meshes, sprite meshes & foliage)
+	profiler:pushLabel("ambient occlusion")
+	love.graphics.setDepthMode("always", false)
+	self:applyAmbientOcclusion()
+	love.graphics.setDepthMode("lequal", true)
+	profiler:popLabel()
+
+
 	-- TODO: implement & plant3 stuff here
 	-- yep, plants turn out to be extremely low on properties lol
-	if #self.Plants > 0 then
+	if #Visible.Plants > 0 then
 		profiler:pushLabel("plants")
-		love.graphics.setShader(self.PlantShader)
+		useShader(self, self.PlantShader)
 		local Mesh = nil
-		for i = 1, #self.Plants do
-			Mesh = self.Plants[i]
-			self.PlantShader:send("meshTexture", Mesh.Texture or blankImage)
-			self.PlantShader:send("meshBloom", Mesh.Bloom)
-			self.PlantShader:send("currentTime", love.timer.getTime())
+		for i = 1, #Visible.Plants do
+			Mesh = Visible.Plants[i]
+			sendUniform(self.PlantShader, "meshTexture", Mesh.Texture or blankImage)
+			sendUniform(self.PlantShader, "meshBloom", Mesh.Bloom)
 			love.graphics.drawInstanced(Mesh.Mesh, Mesh.Count)
 		end
 		profiler:popLabel()
@@ -924,42 +3295,61 @@ function Scene3:draw(renderTarget, x, y) -- nil or a canvas
 
 
 
-	-- TODO: perhaps isolate spritemeshes into a different shader?
-	love.graphics.setShader(self.Shader)
-
 	-- repeat the mesh drawing process, but for *opaque* spritemeshes
-	if #self.SpriteMeshes > 0 then
+	if #Visible.SpriteMeshes > 0 then
 		profiler:pushLabel("sprite meshes")
 		local Mesh = nil
-		self.Shader:send("uvVelocity", {0, 0}) -- sprite meshes have no uv scrolling
-		self.Shader:send("meshFresnel", {0, 1}) -- no need to update fresnelColor since fresnel strength == 0 disables it already
-		self.Shader:send("isSpriteSheet", true) -- but they do need isSpriteSheet set to true for correct texture mapping
-		self.Shader:send("masked", 0)
-		for i = 1, #self.SpriteMeshes do
-			Mesh = self.SpriteMeshes[i]
+		local Shader = useShader(self, self.Shader, VARIANT_SPRITESHEET) -- maps texture coordinates onto the sprite sheet, sprite meshes have no uv scrolling
+		sendVector(Shader, "meshFresnel", 0, 1) -- no need to update fresnelColor since fresnel strength == 0 disables it already
+		sendUniform(Shader, "meshTransparency", 0)
+		local lastKey = nil
+		for i = 1, #Visible.SpriteMeshes do -- sorted by material, so sprites sharing a sheet are drawn back-to-back
+			Mesh = Visible.SpriteMeshes[i]
 			if Mesh.Transparency == 0 then
-				self.Shader:send("meshTexture", Mesh.Texture or blankImage)
+				if materialKeys[Mesh] ~= lastKey then
+					lastKey = materialKeys[Mesh]
+					sendUniform(Shader, "meshTexture", Mesh.Texture or blankImage)
+				end
 				--self.Shader:send("meshPosition", Mesh.Position:array())
 				--self.Shader:send("meshRotation", Mesh.Rotation:array())
 				--self.Shader:send("meshScale", Mesh.Scale:array())
-				local c1, c2, c3, c4 = Mesh.Matrix:columns()
-				self.Shader:send("meshMatrix", {c1, c2, c3, c4})
-
-				self.Shader:send("meshColor", Mesh.Color:array())
-				self.Shader:send("meshColorShadow", Mesh.ColorShadow:array())
-				self.Shader:send("meshBrightness", Mesh.Brightness)
-				self.Shader:send("meshBloom", Mesh.Bloom)
-				self.Shader:send("spritePosition", {Mesh.SpritePosition.x - 1, Mesh.SpritePosition.y - 1})
-				self.Shader:send("spriteSheetSize", Mesh.SheetSize:array())
+				sendMatrix(Shader, "meshMatrix", Mesh.Matrix)
+
+				sendVector(Shader, "meshColor", Mesh.Color.r, Mesh.Color.g, Mesh.Color.b)
+				sendVector(Shader, "meshColorShadow", Mesh.ColorShadow.r, Mesh.ColorShadow.g, Mesh.ColorShadow.b)
+				sendUniform(Shader, "meshBrightness", Mesh.Brightness)
+				sendUniform(Shader, "meshBloom", Mesh.Bloom)
+				sendVector(Shader, "spritePosition", Mesh.SpritePosition.x - 1, Mesh.SpritePosition.y - 1)
+				sendVector(Shader, "spriteSheetSize", Mesh.SheetSize.x, Mesh.SheetSize.y)
 				love.graphics.draw(Mesh.Mesh)
 			elseif Mesh.Transparency < 1 then -- ignore meshes with transparency == 1
-				table.insert(TransMeshes, Mesh)
+				queueTransparent(self, Mesh) -- meshes that have a Transparency > 0 are postponed, and drawn back to front later
 			end
 			if Mesh.Silhouette then
 				table.insert(Silhouettes, Mesh)
 			end
 		end
-		self.Shader:send("isSpriteSheet", false)
+		profiler:popLabel()
+	end
+
+
+	-- draw the background after all opaque geometry, at the far plane and without writing depth, so only pixels that nothing was drawn to are shaded
+	-- transparent meshes are drawn after this so that they blend with the background. Skipped when the depth pre-pass covered the whole screen
+	if self.Background and not self.BackgroundCovered then
+		profiler:pushLabel("background")
+		love.graphics.setCanvas({self.RenderCanvas, ["depthstencil"] = self.DepthCanvas})
+		love.graphics.setDepthMode("lequal", false)
+		if self.Background:getTextureType() == "2d" then -- regular image
+			useShader(self, self.BackgroundShader)
+			local imgWidth, imgHeight = self.Background:getDimensions()
+			love.graphics.draw(self.Background, 0, 0, 0, renderWidth / imgWidth, renderHeight / imgHeight)
+		else -- cubemap image (render a skybox!)
+			useShader(self, self.SkyboxShader)
+			sendUniform(self.SkyboxShader, "skyboxImage", self.Background)
+			love.graphics.draw(cubeMesh)
+		end
+		setGeometryCanvas(self)
+		love.graphics.setDepthMode("lequal", true)
 		profiler:popLabel()
 	end
 
@@ -967,17 +3357,93 @@ function Scene3:draw(renderTarget, x, y) -- nil or a canvas
 
 
 	-- now sort, then draw all basic/sprite meshes that were postponed
-	local cameraPosition = self.Camera3.Position
-	table.sort(
-		TransMeshes,
-		function(meshA, meshB)
-			return (meshA.Position.x - cameraPosition.x)^2 + (meshA.Position.y - cameraPosition.y)^2 + (meshA.Position.z - cameraPosition.z)^2
-				> (meshB.Position.x - cameraPosition.x)^2 + (meshB.Position.y - cameraPosition.y)^2 + (meshB.Position.z - cameraPosition.z)^2
+	local TransMeshes = sortTransparent(self)
+
+
+	-- since both basic meshes and sprite meshes need to be drawn in the right order, this loop gets a bit complicated
+	if #TransMeshes > 0 then
+		profiler:pushLabel("transparency")
+
+		-- with order-independent transparency the meshes are summed into two canvases in any order, which are resolved onto the render canvas afterwards
+		local oit = self.OrderIndependent
+		local accumCanvas, weightCanvas, blendMode, alphaMode
+		if oit then
+			accumCanvas = self.CanvasPool:acquire(renderWidth, renderHeight, "rgba16f")
+			weightCanvas = self.CanvasPool:acquire(renderWidth, renderHeight, "rgba16f")
+			love.graphics.setCanvas(accumCanvas, weightCanvas)
+			love.graphics.clear(0, 0, 0, 0)
+			love.graphics.setCanvas({accumCanvas, weightCanvas, self.BloomCanvas, ["depthstencil"] = self.DepthCanvas})
+			love.graphics.setDepthMode("less", false)
+			blendMode, alphaMode = love.graphics.getBlendMode()
+			love.graphics.setBlendMode("add", "premultiplied")
 		end
-	)
+
+		local Mesh = nil
+		local Shader = nil
+		for i = 1, #TransMeshes do
+
+			Mesh = TransMeshes[i]
+
+			-- pick the shader variant based on mesh type, only switching shaders when the variant changes
+			local Set, mask = self.Shader, oit and VARIANT_OIT or 0
+			if spritemesh3.isSpritemesh3(Mesh) then
+				mask = mask + VARIANT_SPRITESHEET
+			elseif not mesh3.isMesh3(Mesh) then
+				Set = self.TriplanarShader
+			end
+			if Set:get(mask) ~= Shader then
+				Shader = useShader(self, Set, mask)
+			end
+
+			-- basic meshes, sprite meshes and triplanar meshes have somewhat different properties
+			if mesh3.isMesh3(Mesh) then
+				sendUniform(Shader, "normalMap", Mesh.NormalMap or normalImage)
+				sendVector(Shader, "uvVelocity", Mesh.UVVelocity.x, Mesh.UVVelocity.y)
+			elseif spritemesh3.isSpritemesh3(Mesh) then
+				sendVector(Shader, "spritePosition", Mesh.SpritePosition.x - 1, Mesh.SpritePosition.y - 1)
+				sendVector(Shader, "spriteSheetSize", Mesh.SheetSize.x, Mesh.SheetSize.y)
+			else
+				sendUniform(Shader, "normalMap", Mesh.NormalMap or normalImage)
+				sendUniform(Shader, "triplanarScale", Mesh.TextureScale)
+			end
+
+			sendUniform(Shader, "meshTexture", Mesh.Texture or blankImage)
+			--Shader:send("meshPosition", Mesh.Position:array())
+			--Shader:send("meshRotation", Mesh.Rotation:array())
+			--Shader:send("meshScale", Mesh.Scale:array())
+			sendMatrix(Shader, "meshMatrix", Mesh.Matrix)
+
+			sendVector(Shader, "meshColor", Mesh.Color.r, Mesh.Color.g, Mesh.Color.b)
+			sendVector(Shader, "meshColorShadow", Mesh.ColorShadow.r, Mesh.ColorShadow.g, Mesh.ColorShadow.b)
+			sendUniform(Shader, "meshBrightness", Mesh.Brightness)
+			sendUniform(Shader, "meshReflectance", Mesh.Reflectance)
+			sendUniform(Shader, "meshBloom", Mesh.Bloom)
+			sendVector(Shader, "meshFresnel", Mesh.FresnelStrength, Mesh.FresnelPower)
+			sendVector(Shader, "meshFresnelColor", Mesh.FresnelColor.r, Mesh.FresnelColor.g, Mesh.FresnelColor.b)
+			sendUniform(Shader, "meshTransparency", Mesh.Transparency) -- now we can finally include transparency since these meshes are drawn in painter's algorithm order
+			setMasked(Mesh.Masked)
+
+			love.graphics.draw(Mesh.LODMesh or Mesh.Mesh)
+		end
+		setMasked(false)
+
+		if oit then
+			love.graphics.setBlendMode(blendMode, alphaMode)
+			love.graphics.setCanvas(self.RenderCanvas)
+			love.graphics.setShader(self.OITResolveShader)
+			sendUniform(self.OITResolveShader, "weightCanvas", weightCanvas)
+			love.graphics.draw(accumCanvas)
+			self.CanvasPool:release(accumCanvas)
+			self.CanvasPool:release(weightCanvas)
+			love.graphics.setDepthMode("lequal", true)
+		end
+		profiler:popLabel()
+	end
 
 
-	-- draw silhouettes (if any)
+
+	-- draw silhouettes (if any). This happens after the semi-transparent meshes, since silhouettes overwrite the mask values in the stencil buffer
+	-- and masked semi-transparent meshes would otherwise be drawn through the masks wherever a silhouette was drawn
 	if #Silhouettes > 0 then
 
 		-- TODO: eventually split off spritesheets and meshes into two separate shaders
@@ -985,37 +3451,39 @@ function Scene3:draw(renderTarget, x, y) -- nil or a canvas
 
 		profiler:pushLabel("silhouettes")
 		love.graphics.setCanvas({self.RenderCanvas, ["depthstencil"] = self.DepthCanvas}) -- depth 32 stencil 8
-		love.graphics.setShader(self.SilhouetteShader)
+		local Shader = nil
 
 		-- enable stencil to ensure you don't overwrite silhouettes a second time
 		love.graphics.setDepthMode("greater", false)
-		love.graphics.setStencilTest("less", 1)
+		love.graphics.setStencilTest("less", SILHOUETTE_STENCIL)
 
 		-- draw all of this inside a stencil function
 		for i = 1, #Silhouettes do
 			local Mesh = Silhouettes[i]
+			local mask = 0
 			if spritemesh3.isSpritemesh3(Mesh) then
-				self.SilhouetteShader:send("isSpriteSheet", true)
-				self.SilhouetteShader:send("spritePosition", {Mesh.SpritePosition.x - 1, Mesh.SpritePosition.y - 1})
-				self.SilhouetteShader:send("spriteSheetSize", Mesh.SheetSize:array())
-			else
-				self.SilhouetteShader:send("isSpriteSheet", false)
-				if mesh3group.isMesh3Group(Mesh) then
-					self.SilhouetteShader:send("isInstanced", true)
-				else
-					self.SilhouetteShader:send("isInstanced", false)
-					--self.SilhouetteShader:send("meshPosition", Mesh.Position:array())
-					--self.SilhouetteShader:send("meshRotation", Mesh.Rotation:array())
-					--self.SilhouetteShader:send("meshScale", Mesh.Scale:array())
-					local c1, c2, c3, c4 = Mesh.Matrix:columns()
-					self.SilhouetteShader:send("meshMatrix", {c1, c2, c3, c4})
-				end
+				mask = VARIANT_SPRITESHEET
+			elseif mesh3group.isMesh3Group(Mesh) then
+				mask = VARIANT_INSTANCED
+			end
+			if self.SilhouetteShader:get(mask) ~= Shader then
+				Shader = useShader(self, self.SilhouetteShader, mask)
+			end
+			if spritemesh3.isSpritemesh3(Mesh) then
+				sendVector(Shader, "spritePosition", Mesh.SpritePosition.x - 1, Mesh.SpritePosition.y - 1)
+				sendVector(Shader, "spriteSheetSize", Mesh.SheetSize.x, Mesh.SheetSize.y)
 			end
-			love.graphics.draw(Mesh.Mesh) -- draw mesh
+			if not mesh3group.isMesh3Group(Mesh) then
+				--self.SilhouetteShader:send("meshPosition", Mesh.Position:array())
+				--self.SilhouetteShader:send("meshRotation", Mesh.Rotation:array())
+				--self.SilhouetteShader:send("meshScale", Mesh.Scale:array())
+				sendMatrix(Shader, "meshMatrix", Mesh.Matrix)
+			end
+			love.graphics.draw(Mesh.LODMesh or Mesh.Mesh) -- draw mesh
 			love.graphics.stencil(
 				function()
-					love.graphics.draw(Mesh.Mesh) -- draw mesh again, but now to the stencil specifically
-				end, "replace", 1, false -- stencil already gets cleared earlier on in the frame
+					love.graphics.draw(Mesh.LODMesh or Mesh.Mesh) -- draw mesh again, but now to the stencil specifically
+				end, "replace", SILHOUETTE_STENCIL, true -- stencil already gets cleared earlier on in the frame
 			)
 		end
 
@@ -1027,112 +3495,25 @@ function Scene3:draw(renderTarget, x, y) -- nil or a canvas
 
 	end
 
-
-
-	-- since both basic meshes and sprite meshes need to be drawn in the right order, this loop gets a bit complicated
-	if #TransMeshes > 0 then
-		profiler:pushLabel("transparency")
-		local Mesh = nil
-		local Shader = nil
-		for i = 1, #TransMeshes do
-
-			Mesh = TransMeshes[i]
-
-			-- smartly switch shader based on mesh type, trying to avoid unnecessary switches whenever possible
-			if (mesh3.isMesh3(Mesh) or spritemesh3.isSpritemesh3(Mesh)) and Shader ~= self.Shader then
-				Shader = self.Shader
-				love.graphics.setShader(Shader)
-
-				-- need to add a small check here to distinguish between basic meshes and sprite meshes since they have somewhat different properties
-				if mesh3.isMesh3(Mesh) then
-					Shader:send("normalMap", Mesh.NormalMap or normalImage)
-					Shader:send("isSpriteSheet", false)
-					Shader:send("uvVelocity", Mesh.UVVelocity:array())
-				else
-					Shader:send("isSpriteSheet", true)
-					Shader:send("uvVelocity", {0, 0})
-					Shader:send("spritePosition", {Mesh.SpritePosition.x - 1, Mesh.SpritePosition.y - 1})
-					Shader:send("spriteSheetSize", Mesh.SheetSize:array())
-				end
-
-			elseif (trip3.isTrip3(Mesh)) and Shader ~= self.TriplanarShader then
-				Shader = self.TriplanarShader
-				love.graphics.setShader(Shader)
-
-				Shader:send("normalMap", Mesh.NormalMap or normalImage)
-				Shader:send("triplanarScale", Mesh.TextureScale)
-			end
-
-			Shader:send("meshTexture", Mesh.Texture or blankImage)
-			--Shader:send("meshPosition", Mesh.Position:array())
-			--Shader:send("meshRotation", Mesh.Rotation:array())
-			--Shader:send("meshScale", Mesh.Scale:array())
-			local c1, c2, c3, c4 = Mesh.Matrix:columns()
-			Shader:send("meshMatrix", {c1, c2, c3, c4})
-
-			Shader:send("meshColor", Mesh.Color:array())
-			Shader:send("meshColorShadow", Mesh.ColorShadow:array())
-			Shader:send("meshBrightness", Mesh.Brightness)
-			Shader:send("meshReflectance", Mesh.Reflectance)
-			Shader:send("meshBloom", Mesh.Bloom)
-			Shader:send("meshFresnel", {Mesh.FresnelStrength, Mesh.FresnelPower})
-			Shader:send("meshFresnelColor", {Mesh.FresnelColor.r, Mesh.FresnelColor.g, Mesh.FresnelColor.b})
-			Shader:send("meshTransparency", Mesh.Transparency) -- now we can finally include transparency since these meshes are drawn in painter's algorithm order
-			Shader:send("masked", Mesh.Masked and 1 or 0)
-
-			love.graphics.draw(Mesh.Mesh)
-		end
-		profiler:popLabel()
-	end
-
-
 	
 
-	if self.BloomStrength > 0 then
-		profiler:pushLabel("bloom")
-		love.graphics.setDepthMode("always", false)
-		self:applyBloom()
-		love.graphics.setDepthMode("lequal", true)
-		profiler:popLabel()
-	end
-
 	-- disable culling for particles & trails so they can be seen from both sides
 	love.graphics.setMeshCullMode("none")
 
+	-- bloom, particles & trails and FXAA
+	profiler:pushLabel("post-processing")
+	self:applyPostProcessing()
+	profiler:popLabel()
 
-	-- particles & trails together in one function call because they'll be sharing a canvas for blending them together
-	self:drawVFX()
-
-
-	-- if FXAA is enabled, now is the time to apply it
-	-- FXAA needs to draw the scene to a different texture, so we also kinda have to set a new pointer that tells us where the 'result' is stored
-	local presentCanvas = self.RenderCanvas
-	if self.FXAA == true then
-		presentCanvas = self.PrepareCanvas
-		love.graphics.setShader(self.FXAAShader)
-		love.graphics.setCanvas(self.PrepareCanvas)
-		self.FXAAShader:send("inverseScreenSize", {1 / self.PrepareCanvas:getWidth(), 1 / self.PrepareCanvas:getHeight()}) -- TODO: don't send every frame!
-		love.graphics.draw(self.RenderCanvas)
-	end
+	-- FXAA draws the scene to a different canvas, so that is where the 'result' is stored if it was applied
+	local presentCanvas = self.PostGraph:get("AntiAliased") or self.RenderCanvas
 
 
 	-- draw billboards all the way at the end because that way it's easier to support billboards that are always drawn in front
-	if #self.Billboards > 0 then
+	if #self.Billboards > 0 or #self.BillboardBatches > 0 then
 		profiler:pushLabel("billboard")
 		love.graphics.setCanvas({presentCanvas, ["depthstencil"] = self.DepthCanvas})
-		love.graphics.setShader(self.BillboardShader)
-		local Object = nil
-		for i = 1, #self.Billboards do
-			Object = self.Billboards[i]
-			love.graphics.setDepthMode(Object.InFront and "always" or "less", not Object.InFront)
-			self.BillboardShader:send("rotation", Object.Rotation)
-			self.BillboardShader:send("worldPosition", Object.Position:array())
-			self.BillboardShader:send("center", Object.Center:array())
-			self.BillboardShader:send("worldSize", Object.WorldSize:array())
-			self.BillboardShader:send("pixelSize", Object.PixelSize:array())
-
-			love.graphics.draw(Object.Mesh)
-		end
+		drawBillboards(self)
 		-- no need to reset shader
 		profiler:popLabel()
 	end
@@ -1145,6 +3526,7 @@ function Scene3:draw(renderTarget, x, y) -- nil or a canvas
 	-- draw the foreground
 	if self.Foreground then
 		profiler:pushLabel("fg")
+		love.graphics.setCanvas(presentCanvas)
 		love.graphics.setDepthMode("always", false)
 		local imgWidth, imgHeight = self.Foreground:getDimensions()
 		love.graphics.draw(self.Foreground, 0, 0, 0, renderWidth / imgWidth, renderHeight / imgHeight)
@@ -1178,6 +3560,14 @@ function Scene3:draw(renderTarget, x, y) -- nil or a canvas
 	love.graphics.setCanvas(prevCanvas)
 	love.graphics.setDepthMode(prevDepthMode, prevWrite)
 
+	-- hand the transient canvases back to the pool, and free the ones that have not been used in a while
+	self.PostGraph:finish()
+	self.CanvasPool:nextFrame(CANVAS_IDLE_FRAMES)
+
+	-- keep track of how effective the uniform cache was this frame
+	self.UniformStats.Sent = uniformsSent - sentBefore
+	self.UniformStats.Skipped = uniformsSkipped - skippedBefore
+
 	profiler:popLabel()
 end
 
@@ -1199,6 +3589,15 @@ end
 
 
 
+-- sets a uniform that is shared by all of the scene's shaders, like the camera matrix. The value is only sent to shaders that use it once they are drawn with
+-- takes the same arguments as Shader:send(), but a matrix4 may also be passed directly
+function Scene3:setSceneConstant(name, ...)
+	assert(type(name) == "string", "Scene3:setSceneConstant(name, ...) requires argument 'name' to be a string.")
+	setConstant(self, name, ...)
+end
+
+
+
 function Scene3:setFXAA(state)
 	if state == true then
 		self.FXAA = true
@@ -1208,6 +3607,11 @@ function Scene3:setFXAA(state)
 end
 
 
+function Scene3:setFrustumCulling(state)
+	self.FrustumCulling = (state == true)
+end
+
+
 function Scene3:setBackground(bgImage)
 	if bgImage == nil then bgImage = whiteCubeMap end
 	self.Background = bgImage
@@ -1252,98 +3656,34 @@ function Scene3:rescaleCanvas(width, height, ssaa)
 	)
 	depthCanvas:setFilter("nearest")
 	local normalCanvas = love.graphics.newCanvas(width * ssaa, height * ssaa)
-	local prepareCanvas = love.graphics.newCanvas(width * ssaa, height * ssaa, {["format"] = "srgba8"})
-	--prepareCanvas:setFilter("nearest") -- TODO: check if this is still necessary
 	local bloomCanvas = love.graphics.newCanvas(width * ssaa, height * ssaa)
 	bloomCanvas:setFilter("nearest")
-	local vfxCanvas1 = love.graphics.newCanvas( -- sums up colors and alpha
-		width * ssaa,
-		height * ssaa,
-		{
-			["format"] = "rgba32f";
-			["readable"] = true;
-		}
-	)
-	local vfxCanvas2 = love.graphics.newCanvas( -- keeps track of particle count per pixel
-		width * ssaa,
-		height * ssaa,
-		{
-			["format"] = "rgba32f"; -- red stores particle count, green stores sum alpha
-			["readable"] = true;
-		}
-	)
-
-	local reuseCanvas1 = love.graphics.newCanvas(width, height)
-	local reuseCanvas2 = love.graphics.newCanvas(width, height)
-	local reuseCanvas3 = love.graphics.newCanvas(width * 0.5, height * 0.5)
-	local reuseCanvas4 = love.graphics.newCanvas(width * 0.5, height * 0.5)
-	local reuseCanvas5 = love.graphics.newCanvas(width * 0.25, height * 0.25)
-	local reuseCanvas6 = love.graphics.newCanvas(width * 0.25, height * 0.25)
-
-	local maskCanvas = love.graphics.newCanvas(
-		width * 0.5,
-		height * 0.5,
-		{
-			["type"] = "2d";
-			["format"] = "r16";
-			["readable"] = true;
-		}
-	)
-
-	-- update ambient occlusion canvas references
-	self.AOBlurShader:send("depthTexture", depthCanvas)
-	self.SSAOShader:send("normalTexture", normalCanvas)
-	self.SSAOBlendShader:send("aoTexture", reuseCanvas1) -- pingCanvas
 
 	self.RenderCanvas = renderCanvas
 	self.DepthCanvas = depthCanvas
 	self.NormalCanvas = normalCanvas
-	self.PrepareCanvas = prepareCanvas
 	self.BloomCanvas = bloomCanvas
-	self.VFXCanvas1 = vfxCanvas1
-	self.VFXCanvas2 = vfxCanvas2
-	self.MaskCanvas = maskCanvas
-	self.ReuseCanvas1 = reuseCanvas1
-	self.ReuseCanvas2 = reuseCanvas2
-	self.ReuseCanvas3 = reuseCanvas3
-	self.ReuseCanvas4 = reuseCanvas4
-	self.ReuseCanvas5 = reuseCanvas5
-	self.ReuseCanvas6 = reuseCanvas6
+	if self.DeferredLights then
+		self.AlbedoCanvas = love.graphics.newCanvas(width * ssaa, height * ssaa, {["format"] = "srgba8"})
+		self.ShadingNormalCanvas = love.graphics.newCanvas(width * ssaa, height * ssaa, {["format"] = "rgb10a2"})
+	end
+
+	-- any other canvases are only taken from the canvas pool by the passes that use them
+	updateRenderGraphs(self, width, height, ssaa)
 
 	-- update aspect ratio of the scene
 	local aspectRatio = width / height
-	self.Shader:send("aspectRatio", aspectRatio)
-	self.DepthShader:send("aspectRatio", aspectRatio)
-	self.TriplanarShader:send("aspectRatio", aspectRatio)
-	--self.TriplanarDepthShader:send("aspectRatio", aspectRatio)
-	self.RippleShader:send("aspectRatio", aspectRatio)
-	self.FoliageShader:send("aspectRatio", aspectRatio)
-	self.PlantShader:send("aspectRatio", aspectRatio)
-	self.ParticlesShader:send("aspectRatio", aspectRatio)
-	self.TrailShader:send("aspectRatio", aspectRatio)
-	self.BillboardShader:send("aspectRatio", aspectRatio)
-	self.MaskShader:send("aspectRatio", aspectRatio)
-	self.SilhouetteShader:send("aspectRatio", aspectRatio)
-	self.SkyboxShader:send("aspectRatio", aspectRatio)
-
-	-- calculate perspective matrix for the SSAO shader
+	setConstant(self, "aspectRatio", aspectRatio)
+
+	-- calculate perspective matrix for the ambient occlusion shaders
 	if self.Camera3 ~= nil then
 		local persp = matrix4.perspective(aspectRatio, self.Camera3.FieldOfView, 1000, 0.1)
-		local c1, c2, c3, c4 = persp:columns()
-		self.SSAOShader:send("perspectiveMatrix", {c1, c2, c3, c4})
-		local invPersp = persp:inverse()
-		local c1, c2, c3, c4 = invPersp:columns()
-		self.SSAOShader:send("invPerspectiveMatrix", {c1, c2, c3, c4})
+		setConstant(self, "perspectiveMatrix", persp)
+		setConstant(self, "invPerspectiveMatrix", persp:inverse())
 	end
 
 	-- misc
-	self.VFXMixShader:send("countCanvas", vfxCanvas2)
 	self.SSAOBlendShader:send("normalTexture", normalCanvas) -- needed to sample alpha channel to check if ambient occlusion should be applied
-
-	-- send mask to mesh shaders
-	self.Shader:send("maskCanvas", maskCanvas)
-	self.TriplanarShader:send("maskCanvas", maskCanvas)
-	self.FoliageShader:send("maskCanvas", maskCanvas)
 end
 
 
@@ -1354,20 +3694,14 @@ end
 -- sway is the maximum swaying angle in radians. Velocity is the wind direction and how fast it travels (how the oscillation travels)
 function Scene3:setWind(a, b)
 	if vector3.isVector3(a) then
-		local arr = a:array()
-		self.FoliageShader:send("windVelocity", arr)
-		self.PlantShader:send("windVelocity", arr)
+		setConstant(self, "windVelocity", a:array())
 		if type(b) == "number" then
-			self.FoliageShader:send("windStrength", b)
-			self.PlantShader:send("windStrength", b)
+			setConstant(self, "windStrength", b)
 		end
 	elseif type(a) == "number" then
-		self.FoliageShader:send("windStrength", a)
-		self.PlantShader:send("windStrength", a)
+		setConstant(self, "windStrength", a)
 		if vector3.isVector3(b) then
-			local arr = b:array()
-			self.FoliageShader:send("windVelocity", arr)
-			self.PlantShader:send("windVelocity", arr)
+			setConstant(self, "windVelocity", b:array())
 		end
 	end
 end
@@ -1375,14 +3709,7 @@ end
 
 
 function Scene3:setAmbient(col, occlusionColor, silhouetteColor)
-	local arr = {col.r, col.g, col.b}
-	self.Shader:send("ambientColor", arr)
-	self.TriplanarShader:send("ambientColor", arr)
-	self.ParticlesShader:send("ambientColor", arr)
-	self.RippleShader:send("ambientColor", arr)
-	self.FoliageShader:send("ambientColor", arr)
-	self.PlantShader:send("ambientColor", arr)
-	self.TrailShader:send("ambientColor", arr)
+	setConstant(self, "ambientColor", {col.r, col.g, col.b})
 	if occlusionColor ~= nil then
 		self.SSAOBlendShader:send("occlusionColor", {occlusionColor.r, occlusionColor.g, occlusionColor.b})
 	end
@@ -1410,47 +3737,71 @@ end
 
 function Scene3:setAOQuality(quality)
 	assert(quality == 1 or quality == 0.5 or quality == 0.25, "Scene3:setAOQuality(quality) requires argument 'quality' to be 1, 0.5 or 0.25.")
-	self.AOQuality = quality
-	self.SSAOShader:send("samples", quality == 1 and 24 or (quality == 0.5 and 16 or 8))
+	self.AOQuality = quality -- the number of samples is sent in passSSAO()
+end
+
+
+
+-- calculates ambient occlusion at a fraction of the scene's resolution, which is then upsampled with an edge-preserving filter
+-- with 'accumulate' set to true, half the samples are taken each frame and blended with the results of earlier frames
+function Scene3:setAOResolution(resolution, accumulate)
+	assert(resolution == 1 or resolution == 0.5 or resolution == 0.25, "Scene3:setAOResolution(resolution, accumulate) requires argument 'resolution' to be 1, 0.5 or 0.25.")
+	self.AOResolution = resolution
+	self.AOAccumulate = (accumulate == true)
+	if self.RenderCanvas ~= nil then
+		buildAOGraph(self, self.RenderCanvas:getWidth() / self.SSAA, self.RenderCanvas:getHeight() / self.SSAA)
+	end
 end
 
 
 
 function Scene3:setDiffuse(strength)
-	self.Shader:send("diffuseStrength", strength)
-	self.TriplanarShader:send("diffuseStrength", strength)
-	self.FoliageShader:send("diffuseStrength", strength)
-	self.PlantShader:send("diffuseStrength", strength)
+	self.DiffuseStrength = strength
+	setConstant(self, "diffuseStrength", strength)
+end
+
+
+
+-- when enabled, lights are drawn onto the opaque geometry in a separate pass, so their cost scales with the number of pixels they cover
+-- instead of every mesh pixel looping over the lights near it. Plants, sprite meshes, particles and transparent meshes still use forward lighting
+function Scene3:setDeferredLights(state)
+	assert(type(state) == "boolean", "Scene3:setDeferredLights(state) requires argument 'state' to be a boolean.")
+	self.DeferredLights = state
+	if state then
+		if self.AlbedoCanvas == nil then
+			self.AlbedoCanvas = love.graphics.newCanvas(self.RenderCanvas:getWidth(), self.RenderCanvas:getHeight(), {["format"] = "srgba8"})
+			self.ShadingNormalCanvas = love.graphics.newCanvas(self.RenderCanvas:getWidth(), self.RenderCanvas:getHeight(), {["format"] = "rgb10a2"})
+		end
+	elseif self.AlbedoCanvas ~= nil then
+		self.AlbedoCanvas:release()
+		self.AlbedoCanvas = nil
+		self.ShadingNormalCanvas:release()
+		self.ShadingNormalCanvas = nil
+	end
 end
 
 
 function Scene3:setBlobColor(col)
-	local arr = {col.r, col.g, col.b}
-	self.Shader:send("blobShadowColor", arr)
-	self.TriplanarShader:send("blobShadowColor", arr)
-	self.FoliageShader:send("blobShadowColor", arr)
-	self.PlantShader:send("blobShadowColor", arr)
+	setConstant(self, "blobShadowColor", {col.r, col.g, col.b})
 end
 
 function Scene3:setBlobStrength(strength)
-	self.Shader:send("blobShadowStrength", strength)
-	self.TriplanarShader:send("blobShadowStrength", strength)
-	self.FoliageShader:send("blobShadowStrength", strength)
-	self.PlantShader:send("blobShadowStrength", strength)
+	setConstant(self, "blobShadowStrength", strength)
 end
 
 
 -- the size parameter is how big the bloom blur will be in pixels. A size of 0 disables blur
+-- the size picks how many times the bloom canvas is halved, so it is rounded to the nearest power of two
 function Scene3:setBloom(size)
 	assert(type(size) == "number", "Scene3:setBloom(size) only accepts a number as the argument.")
 	self.BloomStrength = size
-	self.BloomBlurShader:send("blurSize", size)
+	declareBloomCanvases(self)
 end
 
 function Scene3:setBloomQuality(quality)
 	assert(quality == 1 or quality == 0.5 or quality == 0.25, "Scene3:setBloomQuality(quality) requires argument 'quality' to be 1, 0.5 or 0.25.")
 	self.BloomQuality = quality
-	--self.BloomBlurShader:send("bloomQuality", quality)
+	declareBloomCanvases(self)
 end
 
 
@@ -1470,12 +3821,10 @@ function Scene3:setShadowMap(position, direction, size, canvasSize, shadowStreng
 	if position == nil then
 		self.ShadowCanvas = nil
 		self.ShadowDepthCanvas = nil
-		self.Shader:send("shadowsEnabled", false)
-		self.TriplanarShader:send("shadowsEnabled", false)
-		self.RippleShader:send("shadowsEnabled", false)
-		self.FoliageShader:send("shadowsEnabled", false)
-		self.PlantShader:send("shadowsEnabled", false)
-		self.ParticlesShader:send("shadowsEnabled", false)
+		if self.ShadowCache ~= nil then
+			self.ShadowCache.Canvas = nil
+		end
+		setConstant(self, "shadowsEnabled", false)
 	else
 		assert(vector3.isVector3(position), "Scene3:setShadowMap(position, direction, size, canvasSize, shadowStrength) requires argument 'position' to be a vector3.")
 		assert(vector3.isVector3(direction), "Scene3:setShadowMap(position, direction, size, canvasSize, shadowStrength) requires argument 'direction' to be a vector3.")
@@ -1484,86 +3833,83 @@ function Scene3:setShadowMap(position, direction, size, canvasSize, shadowStreng
 		assert(shadowStrength == nil or type(shadowStrength) == "number",
 			"Scene3:setShadowMap(position, direction, size, canvasSize, shadowStrength) requires argument 'shadowStrength' to be a number or nil.")
 
-		self.Shader:send("shadowsEnabled", true)
-		self.TriplanarShader:send("shadowsEnabled", true)
-		self.RippleShader:send("shadowsEnabled", true)
-		self.FoliageShader:send("shadowsEnabled", true)
-		self.PlantShader:send("shadowsEnabled", true)
-		self.ParticlesShader:send("shadowsEnabled", true)
-
-		local shStrength = shadowStrength ~= nil and shadowStrength or 0.5
-		self.Shader:send("shadowStrength", shStrength)
-		self.TriplanarShader:send("shadowStrength", shStrength)
-		self.RippleShader:send("shadowStrength", shStrength)
-		self.FoliageShader:send("shadowStrength", shStrength)
-		self.PlantShader:send("shadowStrength", shStrength)
-		self.ParticlesShader:send("shadowStrength", shStrength)
+		setConstant(self, "shadowsEnabled", true)
+		setConstant(self, "shadowStrength", shadowStrength ~= nil and shadowStrength or 0.5)
 
 		direction = direction:clone():norm()
-		local dirTable = {direction.x, direction.y, direction.z}
-		self.Shader:send("sunDirection", dirTable)
-		self.TriplanarShader:send("sunDirection", dirTable)
-		self.RippleShader:send("sunDirection", dirTable)
-		self.FoliageShader:send("sunDirection", dirTable)
-		self.PlantShader:send("sunDirection", dirTable)
-		self.ParticlesShader:send("sunDirection", dirTable)
-
-		-- create new canvases (but only if their sizes are different from the current ones)
-		-- this will make it possible to potentially move the shadowmap around every frame
-		if self.ShadowCanvas == nil or self.ShadowCanvas:getWidth() ~= canvasSize.x or self.ShadowCanvas:getHeight() ~= canvasSize.y then
-			local shadowCanvas = love.graphics.newCanvas(canvasSize.x, canvasSize.y)
-			self.ShadowCanvas = shadowCanvas
-			local shadowDepthCanvas = love.graphics.newCanvas(canvasSize.x, canvasSize.y,
-				{
-					["type"] = "2d";
-					["format"] = "depth24";
-					["readable"] = true;
-				}
-			)
-			self.ShadowDepthCanvas = shadowDepthCanvas
-			shadowDepthCanvas:setDepthSampleMode("less")
-
-			self.Shader:send("shadowCanvas", self.ShadowDepthCanvas)
-			self.TriplanarShader:send("shadowCanvas", self.ShadowDepthCanvas)
-			self.RippleShader:send("shadowCanvas", self.ShadowDepthCanvas)
-			self.FoliageShader:send("shadowCanvas", self.ShadowDepthCanvas)
-			self.PlantShader:send("shadowCanvas", self.ShadowDepthCanvas)
-			self.ParticlesShader:send("shadowCanvas", self.ShadowDepthCanvas) -- particleshader only needs depth canvas, not size, since we only need 1 sample
-
-			local cSize = {canvasSize.x, canvasSize.y}
-			self.Shader:send("shadowCanvasSize", cSize)
-			self.TriplanarShader:send("shadowCanvasSize", cSize)
-			self.RippleShader:send("shadowCanvasSize", cSize)
-			self.FoliageShader:send("shadowCanvasSize", cSize)
-			self.PlantShader:send("shadowCanvasSize", cSize)
-		end
-
-		self.ShadowMapShader:send("isInstanced", true)
-
-		-- send over orthographic camera matrix
-		local orthoMatrix = matrix4.orthographic(-size.x / 2, size.x / 2, size.y / 2, -size.y / 2, 100, 0.1) -- perspective correction matrix
-		local c1, c2, c3, c4 = orthoMatrix:columns()
-		local oMat = {c1, c2, c3, c4}
-		self.ShadowMapShader:send("orthoMatrix", oMat)
-		self.Shader:send("orthoMatrix", oMat) -- also send to main shader so we know how to sample shadow map
-		self.TriplanarShader:send("orthoMatrix", oMat)
-		self.RippleShader:send("orthoMatrix", oMat)
-		self.FoliageShader:send("orthoMatrix", oMat)
-		self.PlantShader:send("orthoMatrix", oMat)
-		self.ParticlesShader:send("orthoMatrix", oMat)
-		
-		-- send over sun matrix
-		local sunWorldMatrix = matrix4.lookAtWorld(position, direction) -- matrix of where the sun is
-		local c1, c2, c3, c4 = sunWorldMatrix:columns()
-		local sMat = {c1, c2, c3, c4}
-		self.ShadowMapShader:send("sunWorldMatrix", sMat)
-		self.Shader:send("sunWorldMatrix", sMat) -- also send to main shader so we know how to sample shadow map
-		self.TriplanarShader:send("sunWorldMatrix", sMat)
-		self.RippleShader:send("sunWorldMatrix", sMat)
-		self.FoliageShader:send("sunWorldMatrix", sMat)
-		self.PlantShader:send("sunWorldMatrix", sMat)
-		self.ParticlesShader:send("sunWorldMatrix", sMat)
+		setConstant(self, "sunDirection", {direction.x, direction.y, direction.z})
+
+		-- the cascades (or the single shadow map) are placed relative to the sun, see placeShadowMap() and Scene3:updateShadowCascades()
+		local Cascades = self.ShadowCascades
+		Cascades.Position = position:clone()
+		Cascades.Direction = direction
+		Cascades.Size = size:clone()
+		Cascades.CanvasSize = canvasSize:clone()
+		createShadowCanvases(self)
+		placeShadowMap(self)
+
+	end
+end
+
+
+
+-- splits the shadow map into 'count' cascades that follow the camera, each covering a slice of the view up to 'distance' away from the camera
+-- 'lambda' blends between evenly spaced slices (0) and logarithmic slices (1). The position and size given to Scene3:setShadowMap() are ignored with more than 1 cascade
+function Scene3:setShadowCascades(count, distance, lambda)
+	if count == nil then count = 1 end
+	if distance == nil then distance = 100 end
+	if lambda == nil then lambda = 0.5 end
+	assert(type(count) == "number" and count >= 1 and count <= MAX_SHADOW_CASCADES and count % 1 == 0,
+		"Scene3:setShadowCascades(count, distance, lambda) requires argument 'count' to be a whole number from 1 to " .. MAX_SHADOW_CASCADES .. ".")
+	assert(type(distance) == "number" and distance > 0.1, "Scene3:setShadowCascades(count, distance, lambda) requires argument 'distance' to be a number larger than 0.1.")
+	assert(type(lambda) == "number" and lambda >= 0 and lambda <= 1, "Scene3:setShadowCascades(count, distance, lambda) requires argument 'lambda' to be a number between 0 and 1.")
+
+	local Cascades = self.ShadowCascades
+	Cascades.Count = count
+	Cascades.Distance = distance
+	Cascades.Lambda = lambda
+	for i = 1, count do
+		Cascades.List[i] = {}
+	end
+	for i = count + 1, #Cascades.List do
+		Cascades.List[i] = nil
+	end
+
+	if self.ShadowCanvas ~= nil then
+		createShadowCanvases(self)
+		placeShadowMap(self)
+	end
+end
+
+
+
+-- keeps the depth of static shadow casters in a separate canvas that is only redrawn when a cascade moves or a static caster changes, so that each frame
+-- only the moving casters need to be drawn. Static casters are mesh3 and trip3 instances with Static set to true and instanced groups that were never edited
+function Scene3:setShadowCache(state)
+	if state then
+		if self.ShadowCache == nil then
+			self.ShadowCache = {
+				["Canvas"] = nil; -- created in Scene3:updateShadowMap() with the same size as the shadow canvas
+				["Valid"] = {}; -- [cascade index] = true if the canvas holds the static casters of that cascade
+			}
+		end
+	else
+		self.ShadowCache = nil
+	end
+	-- cascades snap to a coarser grid with the cache, so force them to be placed again
+	for i = 1, #self.ShadowCascades.List do
+		self.ShadowCascades.List[i].X = nil
+	end
+end
+
 
+
+-- redraws the static casters into the shadow cache on the next frame. Called automatically when static casters are moved, attached or detached
+function Scene3:invalidateShadowCache()
+	if self.ShadowCache ~= nil then
+		for i = 1, MAX_SHADOW_CASCADES do
+			self.ShadowCache.Valid[i] = false
+		end
 	end
 end
 
@@ -1609,6 +3955,22 @@ function Scene3:attachMesh(mesh)
 	end
 	mesh.Scene = self
 
+	-- insert into the render queue at the position of its material
+	addToRenderQueue(self, mesh)
+
+	-- static meshes get merged with other static meshes right before the next frame is drawn
+	if mesh3.isMesh3(mesh) and mesh.Static then
+		self.StaticDirty = true
+	end
+
+	if isCachedCaster(mesh) then
+		self:invalidateShadowCache()
+	end
+
+	if self.Octree ~= nil and (mesh3.isMesh3(mesh) or trip3.isTrip3(mesh)) then
+		self.Octree:insert(mesh, getWorldBounds(mesh))
+	end
+
 	if self.Events.MeshAttached then
 		connection.doEvents(self.Events.MeshAttached, mesh)
 	end
@@ -1619,6 +3981,12 @@ end
 
 
 function Scene3:detachMesh(mesh) -- basic mesh or sprite mesh
+	-- a baked mesh is put back into the render queue and octree first, so that it can be removed from them like any other mesh
+	if bakedInto[mesh] ~= nil and bakedInto[mesh].Scene3 == self then
+		self:unbakeStatic(bakedInto[mesh])
+		self.StaticDirty = true -- re-bake the other meshes of the batch
+	end
+
 	local slot
 	local Item = nil
 	if mesh3.isMesh3(mesh) then
@@ -1652,6 +4020,17 @@ function Scene3:detachMesh(mesh) -- basic mesh or sprite mesh
 	if Item ~= nil then
 		Item.Scene = nil
 
+		if self.Octree ~= nil then
+			self.Octree:remove(Item)
+		end
+
+		removeFromRenderQueue(self, Item)
+
+		if isCachedCaster(Item) or shadowCached[Item] then
+			shadowCached[Item] = nil
+			self:invalidateShadowCache()
+		end
+
 		if self.Events.MeshDetached then
 			connection.doEvents(self.Events.MeshDetached, Item)
 		end
@@ -1743,23 +4122,14 @@ function Scene3:attachLight(light)
 	table.insert(self.Lights, index, light)
 	light.Scene = self
 
-	local lightCount = math.min(#self.Lights, 16)
-	self.Shader:send("lightCount", lightCount)
-	self.TriplanarShader:send("lightCount", lightCount)
-	self.FoliageShader:send("lightCount", lightCount)
-	self.PlantShader:send("lightCount", lightCount)
-	self.ParticlesShader:send("lightCount", lightCount)
-
-	if #self.Lights > lightCount then
-		print("Scene3:attachLight(light) added a light that will not display as there are already 16 or more lights in the scene.")
+	if #self.Lights > MAX_LIGHTS then
+		print("Scene3:attachLight(light) added a light that will not display as there are already " .. MAX_LIGHTS .. " or more lights in the scene.")
 	end
 
 	if self.Events.LightAttached then
 		connection.doEvents(self.Events.LightAttached, light)
 	end
 
-	self.LightsDirty = true
-
 	return light
 end
 
@@ -1774,19 +4144,10 @@ function Scene3:detachLight(lightOrSlot)
 	if Item ~= nil then
 		Item.Scene = nil
 
-		local lightCount = math.min(#self.Lights, 16)
-		self.Shader:send("lightCount", lightCount)
-		self.TriplanarShader:send("lightCount", lightCount)
-		self.FoliageShader:send("lightCount", lightCount)
-		self.PlantShader:send("lightCount", lightCount)
-		self.ParticlesShader:send("lightCount", lightCount)
-
 		if self.Events.LightDetached then
 			connection.doEvents(self.Events.LightDetached, Item)
 		end
 
-		self.LightsDirty = true
-
 		return true
 	end
 	return false
@@ -1806,10 +4167,7 @@ function Scene3:attachBlob(blob)
 	blob.Scene = self
 
 	local blobCount = math.min(#self.Blobs, 16)
-	self.Shader:send("blobShadowCount", blobCount)
-	self.TriplanarShader:send("blobShadowCount", blobCount)
-	self.FoliageShader:send("blobShadowCount", blobCount)
-	self.PlantShader:send("blobShadowCount", blobCount)
+	setConstant(self, "blobShadowCount", blobCount)
 
 	if #self.Lights > blobCount then
 		print("Scene3:attachBlob(blob) added a blob3 that will not display as there are already 16 or more blobs in the scene.")
@@ -1836,10 +4194,7 @@ function Scene3:detachBlob(blobOrSlot)
 		Item.Scene = nil
 
 		local blobCount = math.min(#self.Blobs, 16)
-		self.Shader:send("blobShadowCount", blobCount)
-		self.TriplanarShader:send("blobShadowCount", blobCount)
-		self.FoliageShader:send("blobShadowCount", blobCount)
-		self.PlantShader:send("blobShadowCount", blobCount)
+		setConstant(self, "blobShadowCount", blobCount)
 
 		if self.Events.BlobDetached then
 			connection.doEvents(self.Events.BlobDetached, Item)
@@ -1903,6 +4258,7 @@ function Scene3:attachTrail(trail)
 	local index = findOrderedInsertLocation(self.Trails, trail)
 	table.insert(self.Trails, index, trail)
 	trail.Scene = self
+	placeTrailPath(self, trail)
 
 	if self.Events.TrailAttached then
 		connection.doEvents(self.Events.TrailAttached, trail)
@@ -1920,6 +4276,7 @@ function Scene3:detachTrail(partOrSlot)
 	local Item = table.remove(self.Trails, partOrSlot)
 	if Item ~= nil then
 		Item.Scene = nil
+		freeTrailPath(self, Item)
 
 		if self.Events.TrailDetached then
 			connection.doEvents(self.Events.TrailDetached, Item)
@@ -1964,64 +4321,83 @@ local function newScene3(sceneCamera, bgImage, fgImage, ssaa) -- TODO: delete fg
 	local Object = {
 		["Id"] = module.TotalCreated;
 
-		["Shader"] = love.graphics.newShader(SHADER_VERTEX_PATH, SHADER_FRAGMENT_PATH); -- SHADER_PATH
+		["Shader"] = shadervariants.new(SHADER_VERTEX_PATH, SHADER_FRAGMENT_PATH, MESH_FEATURES); -- shader variants, pick one with Scene3.Shader:get()
 		["RippleShader"] = love.graphics.newShader(SHADER_VERTEX_PATH, SHADER_RIPPLE_PATH); -- same vertex shader, but special fragment shader
 		["FoliageShader"] = love.graphics.newShader(SHADER_FOLIVERT_PATH, SHADER_FOLIFRAG_PATH);
 		["PlantShader"] = love.graphics.newShader(SHADER_PLANTVERT_PATH, SHADER_PLANTFRAG_PATH);
-		["TriplanarShader"] = love.graphics.newShader(SHADER_TRIVERT_PATH, SHADER_TRIFRAG_PATH);
-		["ParticlesShader"] = love.graphics.newShader(SHADER_PARTICLES_VERT, SHADER_PARTICLES_FRAG);
+		["TriplanarShader"] = shadervariants.new(SHADER_TRIVERT_PATH, SHADER_TRIFRAG_PATH, MESH_FEATURES);
+		["ParticlesShader"] = shadervariants.new(SHADER_PARTICLES_VERT, SHADER_PARTICLES_FRAG, VFX_FEATURES);
 		["VFXMixShader"] = vfxMixShader;
-		["TrailShader"] = love.graphics.newShader(SHADER_TRAIL_VERT, SHADER_TRAIL_FRAG);
+		["OITResolveShader"] = oitResolveShader;
+		["TrailShader"] = shadervariants.new(SHADER_TRAIL_VERT, SHADER_TRAIL_FRAG, VFX_FEATURES);
+		["ParticleSimShader"] = shadervariants.new(SHADER_PARTICLE_SIM_PATH, nil, PARTICLE_SIM_FEATURES);
 		["SSAOShader"] = love.graphics.newShader(SHADER_SSAO_PATH); -- screen-space ambient occlusion shader
 		["SSAOBlendShader"] = love.graphics.newShader(SHADER_SSAOBLEND_PATH); -- blend shader to blend ambient occlusion with the rendered scene
 		["AOBlurShader"] = love.graphics.newShader(SHADER_AOBLUR_PATH);
-		["BloomBlurShader"] = love.graphics.newShader(SHADER_BLOOMBLUR_PATH);
-		["ShadowMapShader"] = love.graphics.newShader(SHADER_SHADOWMAP_PATH);
+		["AODownsampleShader"] = love.graphics.newShader(SHADER_AODOWNSAMPLE_PATH); -- builds the depth & normal pyramid for lower resolution ambient occlusion
+		["AOUpsampleShader"] = love.graphics.newShader(SHADER_AOUPSAMPLE_PATH);
+		["AOTemporalShader"] = love.graphics.newShader(SHADER_AOTEMPORAL_PATH); -- blends ambient occlusion with that of earlier frames
+		["BloomDownsampleShader"] = love.graphics.newShader(SHADER_BLOOMDOWN_PATH); -- halves the bloom canvas, see Scene3:setBloom()
+		["BloomUpsampleShader"] = love.graphics.newShader(SHADER_BLOOMUP_PATH);
+		["ShadowMapShader"] = shadervariants.new(SHADER_SHADOWMAP_PATH, nil, MESH_FEATURES);
 		["BillboardShader"] = love.graphics.newShader(SHADER_BILLBOARD_PATH);
 		["MaskShader"] = love.graphics.newShader(SHADER_MASK_PATH);
-		["SilhouetteShader"] = love.graphics.newShader(SHADER_SILHOUETTE_PATH);
+		["SilhouetteShader"] = shadervariants.new(SHADER_SILHOUETTE_PATH, nil, MESH_FEATURES);
 		["FXAAShader"] = love.graphics.newShader(SHADER_FXAA_PATH);
 		["SkyboxShader"] = love.graphics.newShader(SHADER_SKYBOX_PATH);
+		["BackgroundShader"] = love.graphics.newShader(BACKGROUND_VERT); -- draws 2d backgrounds behind all geometry
+		["HiZShader"] = love.graphics.newShader(SHADER_HIZ_PATH); -- reduces the depth canvas for occlusion culling
+		["ShadowCopyShader"] = love.graphics.newShader(SHADER_SHADOWCOPY_PATH); -- copies the shadow cache into the shadow canvas
+		["DeferredLightShader"] = love.graphics.newShader(SHADER_DEFERRED_LIGHT_PATH); -- draws lights onto the geometry when deferred lights are enabled
 
 		-- depth pre-pass shaders
-		["DepthShader"] = love.graphics.newShader(SHADER_VERTEX_DEPTH_PATH, DEPTH_PASS_FRAG); -- depth pre-pass for mesh3 and mesh3group
+		["DepthShader"] = shadervariants.new(SHADER_VERTEX_DEPTH_PATH, DEPTH_PASS_FRAG, MESH_FEATURES); -- depth pre-pass for mesh3 and mesh3group
 		--["TriplanarDepthShader"] = love.graphics.newShader(SHADER_VERTEX_DEPTH_PATH, DEPTH_PASS_FRAG); -- depth pre-pass for trip3 and trip3group
 
-		["LastDrawSize"] = vector2(gWidth, gHeight); -- when you suddenly start drawing the scene at a different size, some shader variables need to be updated!
-		["LightsDirty"] = true; -- if true, update lights data in the shaders and set this to false (until a light gets attached/detached)
-		["BlobsDirty"] = true; -- same as above, but for blobs
+		["BlobsDirty"] = true; -- when blobs change, some shader variables need to be updated!
+		["SceneConstants"] = { -- uniforms shared by the scene's shaders, which are sent when a shader is bound, see useShader()
+			["Values"] = {}; -- [name] = array of the arguments to Shader:send(), with the argument count in 'n'
+			["Versions"] = {}; -- [name] = revision in which the constant last changed
+			["Names"] = {}; -- array of all constant names, in the order they were first set
+			["Revision"] = 0; -- increased whenever any constant changes
+			["Registered"] = {}; -- [shader or set of shader variants] = true for the shaders that use constants
+			["Synced"] = setmetatable({}, {__mode = "k"}); -- [shader] = {Revision, Versions} of the constants last sent to the shader
+		};
 
 		-- canvas properties, update whenever you change the render target
 		["RenderCanvas"] = nil;--renderCanvas;
 		["DepthCanvas"] = nil;--depthCanvas;
 		["NormalCanvas"] = nil;--normalCanvas;
-		["PrepareCanvas"] = nil;--prepareCanvas; -- higher resolution canvas for ambient occlusion & bloom, used to draw things to which are then combined with the render canvas
 		["BloomCanvas"] = nil;--bloomCanvas;
-		["VFXCanvas1"] = nil;--particleCanvas1; -- stores sum of colors in r, g and b. Alpha unused! (because it works uniquely with blend modes)
-		["VFXCanvas2"] = nil;--particleCanvas2; -- stores in the 'r' channel the sum of fragments on that pixel and the 'g' channel is the alpha summed
 		["ShadowCanvas"] = nil; -- either nil, or a canvas when shadow map is enabled
 		["ShadowDepthCanvas"] = nil;  -- either nil, or a canvas when shadow map is enabled
-		["MaskCanvas"] = nil; -- single-channel, 0.5x scale, r16, range [0,1]. Stores a value that determines dithering thickness at the given pixel
+		["AlbedoCanvas"] = nil; -- surface colors before lighting, only exists when deferred lights are enabled
+		["ShadingNormalCanvas"] = nil; -- world space normals with normal maps applied, only exists when deferred lights are enabled
 
-		-- when applying SSAO, bloom, etc. you need multiple render passes. For that purpose 'reuse' canvases are created to play ping-pong with each pass
-		-- Considering that SSAO, bloom etc. might want to be downscaled for better FPS, there are canvases for full, half and quarter size
-		["ReuseCanvas1"] = nil;--reuseCanvas1; -- full quality 1
-		["ReuseCanvas2"] = nil;--reuseCanvas2; -- full quality 2
-		["ReuseCanvas3"] = nil;--reuseCanvas3; -- half quality 1
-		["ReuseCanvas4"] = nil;--reuseCanvas4; -- half quality 2
-		["ReuseCanvas5"] = nil;--reuseCanvas5; -- quarter quality 1
-		["ReuseCanvas6"] = nil;--reuseCanvas6; -- quarter quality 2
+		-- when applying SSAO, bloom, etc. you need multiple render passes. Those passes are scheduled by render graphs, which take the canvases they need
+		-- from a shared pool only while they are in use, so that passes that don't overlap can share canvases. See newRenderGraphs()
+		["CanvasPool"] = nil;
+		["AOGraph"] = nil;
+		["PostGraph"] = nil;
 
 		["SSAA"] = ssaa;
 		["FXAA"] = true; -- TODO: add method to enable this
 		["AOEnabled"] = false;
 		["DiffuseStrength"] = 1;
+		["DeferredLights"] = false; -- if true, lights are drawn onto opaque geometry in a separate pass instead of being computed by each mesh, see Scene3:setDeferredLights()
 		["BloomStrength"] = 0;
 		["AOQuality"] = 1; -- 1 = full quality, 0.5 = half quality, 0.25 = quarter quality
+		["AOResolution"] = 1; -- fraction of the scene's size (without SSAA) that ambient occlusion is calculated at, see Scene3:setAOResolution()
+		["AOAccumulate"] = false; -- if true, ambient occlusion is blended with that of earlier frames
+		["AOHistory"] = {}; -- the two canvases that accumulated ambient occlusion is swapped between, only when AOAccumulate is true
+		["AOHistoryCamera"] = nil; -- camera matrix of the frame stored in the history, nil if there is no usable history
+		["AOFrame"] = 0; -- rotates the sampling pattern when accumulating
 		["BloomQuality"] = 1; -- 1 = full quality, 0.5 = half quality, 0.25 = quarter quality
+		["BloomLevels"] = 1; -- how many times the bloom canvas is halved, which follows from the bloom size and quality
 
 		-- render variables
-		["Background"] = nil; -- set separately --bgImage; -- image, drawn first (so they appear in the back)
+		["Background"] = nil; -- set separately --bgImage; -- image, drawn after opaque geometry onto the pixels nothing was drawn to
+		["BackgroundCovered"] = false; -- true if the depth pre-pass covered the whole screen during this frame, so the background is skipped
 		["Foreground"] = fgImage;
 
 		-- scene elements
@@ -2035,11 +4411,126 @@ local function newScene3(sceneCamera, bgImage, fgImage, ssaa) -- TODO: delete fg
 		["Foliage"] = {}; -- foliage3 array (i.e. leaves)
 		["Plants"] = {}; -- plant3 array (grass, ivy, shrubs, etc.) things with no SSAO or shadows, but still affected by foliage shadows
 		["Trails"] = {}; -- trail3 array
+		["TrailPaths"] = { -- the sampled paths of all trails, two rows per trail, see placeTrailPath()
+			["Data"] = nil; -- rgba32f image data
+			["Image"] = nil;
+			["Capacity"] = 0; -- number of trails the image can hold
+			["Used"] = 0; -- number of slots that were ever handed out
+			["Slots"] = {}; -- [trail] = slot
+			["Free"] = {}; -- array of slots of detached trails
+		};
+		["TrailBatches"] = { -- batches of trails that don't blend and trails that do, see drawTrails()
+			{["Lookup"] = {}}; -- [texture] = {[strip mesh] = batch}
+			{["Lookup"] = {}};
+		};
 		["Particles"] = {}; -- array of particle emitter instances. Particle emitters are always instanced for performance reasons
 		["Billboards"] = {}; -- billboard array
-		["Masks"] = {}; -- masks array, which are circular billboard-like meshes that cull geometry with Object.Dithering = true
+		["BillboardBatches"] = { -- array of batches of billboards with the same texture, see drawBillboards()
+			["Lookup"] = {}; -- [texture] = {[InFront] = batch}
+		};
+		["Masks"] = {}; -- masks array, which are circular billboard-like meshes that cull geometry with Object.Masked = true
+		["MaskInstances"] = { -- per-instance position and radii of the masks, which are all drawn to the stencil buffer at once, see drawMasks()
+			["Mesh"] = nil;
+			["Capacity"] = 0;
+			["Vertices"] = {};
+		};
 		["Lights"] = {}; -- array with lights that have a Position, Color, Range and Strength
+		["LightClusters"] = { -- textures used for clustered lighting, filled every frame in Scene3:updateLightClusters()
+			["LightData"] = nil; -- rgba32f, MAX_LIGHTS x 2, position & range and color & strength of each light in view
+			["LightDataImage"] = nil;
+			["ClusterData"] = nil; -- rg32f, one pixel with {offset, count} per cluster
+			["ClusterImage"] = nil;
+			["IndexData"] = nil; -- r32f, the light indices of all clusters packed together
+			["IndexImage"] = nil;
+			["Count"] = 0; -- number of lights that were in view during the last draw
+			["Overflow"] = false; -- true if the light indices texture was full during the last draw, meaning that some lights were skipped
+			["Snapshot"] = {}; -- camera and light values the clusters were last built with, see lightClustersChanged()
+			["Shaders"] = nil; -- the shaders that light with the clusters
+		};
 		["Blobs"] = {}; -- array with blob instances that have a Position and Range (they are blob shadows you should place below spritemeshes)
+		["UniformStats"] = { -- number of uniforms that were sent or skipped by the uniform cache during the last Scene3:draw() call
+			["Sent"] = 0;
+			["Skipped"] = 0;
+		};
+		["TransparentQueue"] = { -- semi-transparent meshes of the last frame ordered from far to near, see sortTransparent()
+			["Meshes"] = {};
+			["Entries"] = setmetatable({}, {__mode = "k"}); -- [mesh] = {Key, Stamp, x, y, z}, the depth key and the position it was computed at
+			["Stamp"] = 0; -- frame counter, a mesh is in the queue this frame if its stamp matches
+			["CameraX"] = nil;
+			["CameraY"] = nil;
+			["CameraZ"] = nil;
+			["Batched"] = {}; -- used instead with order-independent transparency, the meshes queued this frame in material order
+			["Spare"] = {};
+		};
+		["RenderQueue"] = { -- the same meshes as in BasicMeshes, BasicTrip3 and SpriteMeshes, but sorted by material (texture, normal map, masked, transparency) instead of Id
+			["BasicMeshes"] = {};
+			["BasicTrip3"] = {};
+			["SpriteMeshes"] = {};
+		};
+		["StaticBatches"] = {}; -- array of mesh3 instances that each hold a number of baked static meshes, see Scene3:bakeStatic()
+		["UnculledCopies"] = { -- copies of the basic meshes queue that the static batches are added to when frustum culling is disabled, see Scene3:cullObjects()
+			["Visible"] = {};
+			["ShadowCasters"] = {};
+		};
+		["StaticDirty"] = false; -- if true, a static mesh was attached (or a batch was broken up) so static meshes are baked again before the next draw
+		["Octree"] = nil; -- optional loose octree with all mesh3 and trip3 instances, see Scene3:setOctree()
+
+		-- occlusion culling
+		["OrderIndependent"] = false; -- if true, semi-transparent meshes are drawn with weighted blended order-independent transparency, see Scene3:setOrderIndependentTransparency()
+		["OcclusionCulling"] = false; -- if true, meshes and groups hidden behind the depth pre-pass are not drawn, see Scene3:setOcclusionCulling()
+		["OcclusionStats"] = { -- number of objects that were tested and culled by occlusion culling during the last Scene3:draw() call
+			["Tested"] = 0;
+			["Culled"] = 0;
+		};
+		["HiZ"] = { -- reduced depth canvases used for occlusion culling
+			["Levels"] = {}; -- every level except the last
+			["Readbacks"] = {}; -- HIZ_LATENCY + 1 canvases for the last level, drawn to in turns and read back HIZ_LATENCY frames later
+			["Frame"] = 0;
+			["SourceWidth"] = 0;
+			["SourceHeight"] = 0;
+			["SpanX"] = 0; -- number of pixels of the last level that span the view, see sphereOccluded()
+			["SpanY"] = 0;
+			["Results"] = { -- used in place of the Visible arrays when frustum culling is disabled
+				["InstancedMeshes"] = {};
+				["BasicMeshes"] = {};
+				["InstancedTrip3"] = {};
+				["BasicTrip3"] = {};
+			};
+		};
+
+		-- frustum culling
+		["FrustumCulling"] = true; -- if true, meshes outside of the camera's view (or the sun's view for shadows) are skipped when drawing
+		["Frustum"] = {}; -- camera axes & field-of-view, updated every frame in Scene3:updateFrustum()
+		["ShadowFrustum"] = {}; -- sun axes & size of the shadow map, updated in Scene3:setShadowMap()
+		["ShadowCascades"] = { -- see Scene3:setShadowCascades()
+			["Count"] = 1;
+			["Distance"] = 100;
+			["Lambda"] = 0.5;
+			["List"] = {{}}; -- per cascade: the box to cull casters against, its projection (Matrix), its projection into the shadow canvas (AtlasMatrix) and its Split distance
+			["SunMatrix"] = nil;
+			["Position"] = nil; -- the arguments of Scene3:setShadowMap()
+			["Direction"] = nil;
+			["Size"] = nil;
+			["CanvasSize"] = nil;
+		};
+		["ShadowCache"] = nil; -- see Scene3:setShadowCache()
+		["Visible"] = { -- per-frame arrays of objects that are in view of the camera, filled in Scene3:cullObjects()
+			["InstancedMeshes"] = {};
+			["BasicMeshes"] = {};
+			["InstancedTrip3"] = {};
+			["BasicTrip3"] = {};
+			["SpriteMeshes"] = {};
+			["RippleMeshes"] = {};
+			["Foliage"] = {};
+			["Plants"] = {};
+		};
+		["ShadowCasters"] = { -- per-frame arrays of objects that cast shadows and are in view of the sun
+			["InstancedMeshes"] = {};
+			["BasicMeshes"] = {};
+			["InstancedTrip3"] = {};
+			["BasicTrip3"] = {};
+			["Foliage"] = {};
+		};
 
 		-- table with arrays of event functions stored under keys named after the events
 		["Events"] = {};
@@ -2047,74 +4538,52 @@ local function newScene3(sceneCamera, bgImage, fgImage, ssaa) -- TODO: delete fg
 
 	setmetatable(Object, Scene3)
 
+	-- every shader that uses any of the scene constants (camera, sun, shadows, lights, blobs, time, wind, ambient, ...)
+	for _, shader in ipairs({Object.Shader, Object.RippleShader, Object.FoliageShader, Object.PlantShader, Object.TriplanarShader, Object.ParticlesShader,
+		Object.TrailShader, Object.ShadowMapShader, Object.BillboardShader, Object.MaskShader, Object.SilhouetteShader, Object.SkyboxShader,
+		Object.DeferredLightShader, Object.DepthShader, Object.SSAOShader, Object.AOTemporalShader, Object.ParticleSimShader}) do
+		registerShader(Object, shader)
+	end
+
 	Object.Camera3:attach(Object)
 	Object.Camera3:updateCameraMatrices()
 
+	newRenderGraphs(Object)
 	Object:rescaleCanvas(nil, nil, ssaa) -- call to initialize canvas variables
 	Object:setBackground(bgImage)
 
 
 
 	-- non-canvas shader vars initialization
-	Object.Shader:send("fieldOfView", Object.Camera3.FieldOfView)
-	Object.Shader:send("diffuseStrength", 1)
-	Object.Shader:send("lightCount", 0)
-	Object.Shader:send("blobShadowCount", 0)
-	Object.Shader:send("blobShadowColor", {0, 0, 0})
-	Object.Shader:send("blobShadowStrength", 0.5)
-	Object.Shader:send("ambientColor", {1, 1, 1, 1})
-
-	Object.DepthShader:send("fieldOfView", Object.Camera3.FieldOfView)
-
-	Object.TriplanarShader:send("fieldOfView", Object.Camera3.FieldOfView)
-	Object.TriplanarShader:send("diffuseStrength", 1)
-	Object.TriplanarShader:send("lightCount", 0)
-	Object.TriplanarShader:send("blobShadowCount", 0)
-	Object.TriplanarShader:send("blobShadowColor", {0, 0, 0})
-	Object.TriplanarShader:send("blobShadowStrength", 0.5)
-	Object.TriplanarShader:send("ambientColor", {1, 1, 1, 1})
-
-	--Object.TriplanarDepthShader:send("fieldOfView", Object.Camera3.FieldOfView)
-
-	Object.RippleShader:send("fieldOfView", Object.Camera3.FieldOfView)
-
-	Object.FoliageShader:send("fieldOfView", Object.Camera3.FieldOfView)
-	Object.FoliageShader:send("diffuseStrength", 1)
-	Object.FoliageShader:send("windVelocity", {0, 0, 0})
-	Object.FoliageShader:send("windStrength", 0)
-
-	Object.PlantShader:send("fieldOfView", Object.Camera3.FieldOfView)
-	Object.PlantShader:send("diffuseStrength", 1)
-	Object.PlantShader:send("windVelocity", {0, 0, 0})
-	Object.PlantShader:send("windStrength", 0)
-	
-	Object.ParticlesShader:send("fieldOfView", Object.Camera3.FieldOfView)
-	Object.ParticlesShader:send("lightCount", 0)
-	Object.ParticlesShader:send("ambientColor", {1, 1, 1, 1})
-
-	Object.TrailShader:send("fieldOfView", Object.Camera3.FieldOfView)
-	Object.TrailShader:send("ambientColor", {1, 1, 1, 1})
-
-	Object.BillboardShader:send("fieldOfView", Object.Camera3.FieldOfView)
-
-	Object.MaskShader:send("fieldOfView", Object.Camera3.FieldOfView)
-
-	Object.SilhouetteShader:send("fieldOfView", Object.Camera3.FieldOfView)
-
-	Object.SkyboxShader:send("fieldOfView", Object.Camera3.FieldOfView)
+	setConstant(Object, "fieldOfView", Object.Camera3.FieldOfView)
+	setConstant(Object, "diffuseStrength", 1)
+	setConstant(Object, "blobShadowCount", 0)
+	setConstant(Object, "blobShadowColor", {0, 0, 0})
+	setConstant(Object, "blobShadowStrength", 0.5)
+	setConstant(Object, "ambientColor", {1, 1, 1, 1})
+	setConstant(Object, "windVelocity", {0, 0, 0})
+	setConstant(Object, "windStrength", 0)
+	setConstant(Object, "shadowsEnabled", false)
+
+	-- clustered lighting textures. Images are set once, after that only their contents are replaced
+	local Clusters = Object.LightClusters
+	Clusters.LightData, Clusters.LightDataImage = newDataTexture(MAX_LIGHTS, 2, "rgba32f")
+	Clusters.ClusterData, Clusters.ClusterImage = newDataTexture(CLUSTER_X * CLUSTER_Y, CLUSTER_Z, "rg32f")
+	Clusters.IndexData, Clusters.IndexImage = newDataTexture(LIGHT_INDICES_WIDTH, LIGHT_INDICES_HEIGHT, "r32f")
+	setConstant(Object, "lightData", Clusters.LightDataImage)
+	setConstant(Object, "lightClusters", Clusters.ClusterImage)
+	setConstant(Object, "lightIndices", Clusters.IndexImage)
+	setConstant(Object, "clusterCount", {CLUSTER_X, CLUSTER_Y, CLUSTER_Z})
+	Clusters.Shaders = {Object.Shader, Object.TriplanarShader, Object.FoliageShader, Object.PlantShader, Object.ParticlesShader}
+
+	-- level-of-detail cross-fades use the same ordered-dither pattern as masks
+	setConstant(Object, "ditherTexture", mask.DitherTexture)
 
 	Object.SSAOShader:send("aoStrength", 0.5)
 	Object.SSAOShader:send("kernelScalar", 0.85) -- how 'large' ambient occlusion is
-	Object.SSAOShader:send("samples", 24)
 	Object.SSAOShader:send("noiseTexture", noiseImage)
 	Object.SSAOBlendShader:send("occlusionColor", {0, 0, 0})
 
-	-- bloom and AO quality shader vars
-	local gWidth, gHeight = love.graphics.getDimensions()
-	Object.AOBlurShader:send("screenSize", {gWidth, gHeight})
-	Object.BloomBlurShader:send("screenSize", {gWidth, gHeight})
-	
-
 	return Object
 end
 
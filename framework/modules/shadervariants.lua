@@ -0,0 +1,165 @@
+
+local module = {}
+
+--[[
+
+Compiles a shader once for each combination of features that is used, instead of switching features on and off with boolean uniforms.
+
+A set is created from a vertex and a fragment shader (file paths or code, like love.graphics.newShader()) and a list of feature names.
+Each feature is a bit in a mask, in the order of the list: the first feature is 1, the second 2, the third 4 and so on. ShaderVariants:get(mask)
+returns the shader compiled with '#define NAME' for each feature in the mask, compiling it the first time it is asked for. The shader code
+can then check features with '#ifdef NAME', so that each variant only contains the code it needs.
+
+Uniforms that are the same for every variant (like the camera matrix) are sent to the set itself with ShaderVariants:send(). The set sends
+them to every variant that uses the uniform, and remembers them so that variants that are compiled later get the same values.
+
+]]
+
+
+
+----------------------------------------------------[[ == BASE OBJECTS == ]]----------------------------------------------------
+
+local ShaderVariants = {}
+ShaderVariants.__index = ShaderVariants
+
+
+
+----------------------------------------------------[[ == HELPERS == ]]----------------------------------------------------
+
+-- returns the code of a shader, which is either given directly or read from a file
+local function readSource(source)
+	if source ~= nil and love.filesystem.getInfo(source, "file") ~= nil then
+		return love.filesystem.read(source)
+	end
+	return source
+end
+
+
+
+-- inserts '#define' lines right after the '#pragma language' line, which has to stay at the top of the code
+-- a '#line' directive afterwards keeps the line numbers in compile errors the same as in the original file
+local function injectDefines(code, defines)
+	if code == nil or defines == "" then
+		return code
+	end
+	local _, pragmaEnd = code:find("#pragma language[^\n]*\n")
+	if pragmaEnd == nil then
+		return defines .. "#line 1\n" .. code
+	end
+	local _, lines = code:sub(1, pragmaEnd):gsub("\n", "\n")
+	return code:sub(1, pragmaEnd) .. defines .. "#line " .. (lines + 1) .. "\n" .. code:sub(pragmaEnd + 1)
+end
+
+
+
+----------------------------------------------------[[ == OBJECT CREATION == ]]----------------------------------------------------
+
+-- 'fragmentSource' may be nil if 'vertexSource' contains both the vertex and the fragment shader
+local function new(vertexSource, fragmentSource, features)
+	assert(type(features) == "table", "shadervariants.new(vertexSource, fragmentSource, features) requires argument 'features' to be an array of strings.")
+	local Object = {
+		["VertexCode"] = readSource(vertexSource);
+		["FragmentCode"] = readSource(fragmentSource);
+		["Features"] = features;
+		["Variants"] = {}; -- [mask] = shader
+		["Compiled"] = {}; -- array of compiled shaders, in the order they were compiled
+		["Values"] = {}; -- [uniform name] = array of the arguments last passed to ShaderVariants:send(), with the argument count in 'n'
+	}
+	return setmetatable(Object, ShaderVariants)
+end
+
+
+
+----------------------------------------------------[[ == METHODS == ]]----------------------------------------------------
+
+local function isShaderVariants(t)
+	return getmetatable(t) == ShaderVariants
+end
+
+
+
+-- returns the bit of a feature, to build masks with without having to hardcode the order of the features
+function ShaderVariants:getFlag(feature)
+	for i = 1, #self.Features do
+		if self.Features[i] == feature then
+			return 2 ^ (i - 1)
+		end
+	end
+	error("ShaderVariants:getFlag(feature) was given a feature that the set was not created with: " .. tostring(feature))
+end
+
+
+
+-- returns the shader compiled with the features in 'mask' (0 or nil for no features), compiling it if it does not exist yet
+function ShaderVariants:get(mask)
+	mask = mask or 0
+	local shader = self.Variants[mask]
+	if shader ~= nil then
+		return shader
+	end
+
+	local defines = ""
+	local bits = mask
+	for i = 1, #self.Features do
+		if bits % 2 == 1 then
+			defines = defines .. "#define " .. self.Features[i] .. "\n"
+		end
+		bits = math.floor(bits / 2)
+	end
+	if self.FragmentCode ~= nil then
+		shader = love.graphics.newShader(injectDefines(self.VertexCode, defines), injectDefines(self.FragmentCode, defines))
+	else
+		shader = love.graphics.newShader(injectDefines(self.VertexCode, defines))
+	end
+
+	-- catch up on the uniforms that the other variants already received
+	for name, args in pairs(self.Values) do
+		if shader:hasUniform(name) then
+			shader:send(name, unpack(args, 1, args.n))
+		end
+	end
+
+	self.Variants[mask] = shader
+	table.insert(self.Compiled, shader)
+	return shader
+end
+
+
+
+-- sends a uniform to every variant that uses it, now and when they are compiled later on
+function ShaderVariants:send(name, ...)
+	local args = self.Values[name]
+	if args == nil then
+		args = {}
+		self.Values[name] = args
+	end
+	args.n = select("#", ...)
+	for i = 1, args.n do
+		args[i] = select(i, ...)
+	end
+	for i = 1, #self.Compiled do
+		if self.Compiled[i]:hasUniform(name) then
+			self.Compiled[i]:send(name, ...)
+		end
+	end
+end
+
+
+
+-- returns true if any of the compiled variants uses the uniform
+function ShaderVariants:hasUniform(name)
+	for i = 1, #self.Compiled do
+		if self.Compiled[i]:hasUniform(name) then
+			return true
+		end
+	end
+	return false
+end
+
+
+
+----------------------------------------------------[[ == RETURN == ]]----------------------------------------------------
+
+module.new = new
+module.isShaderVariants = isShaderVariants
+return setmetatable(module, {__call = function(_, ...) return new(...) end})
@@ -14,14 +14,11 @@ local Trail3 = {}
 Trail3.__index = Trail3
 Trail3.__tostring = function(tab) return "{Trail3 (" .. tostring(tab.Segments) .. ")}" end
 
--- pre-filled array with points to-be-sent to the shader
--- fill them in right here so that they always have exactly 15 indices because the shader doesn't want me to send only like 4 or 6 points to an array of size 15
-local bezierPoints = {
-	{0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
-	{0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
-	{0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
-	{0, 0, 0}, {0, 0, 0}, {0, 0, 0}
-}
+-- the path of a trail is sampled this many times when it is created, see Trail3.PathData. Same as PATH_SAMPLES in trailvert.c
+local PATH_SAMPLES = 64
+
+-- trails with the same number of segments share the same strip mesh, so that scene3 can draw all trails with the same texture at once
+local stripMeshes = {} -- [segments] = mesh
 
 
 
@@ -34,45 +31,11 @@ end
 
 
 
--- assumes the correct shader is already set - which is done in scene3
--- trails won't draw depth as they're semi-transparent in nature. They're drawn after semi-transparent objects meaning they won't show behind those
--- trails aren't sorted either
--- also don't forget to have disabled backface culling!
-function Trail3:draw(shaderRef)
-	-- update the geometry of the mesh!
-	local age = love.timer.getTime() - self.SpawnedAt
-
-	-- calculate where on the path segments are so we can calculate the range of vertices to draw
-	local x1 = age / self.Duration -- where on the path the front (right) of the trail is, where 0 = start, 1 = end
-	local x0 = (age - self.Length) / self.Duration -- where on the path the back (left) of the trail is, where 0 = start, 1 = end
-
-	-- don't draw if the trail falls fully outside the path
-	if x1 < 0 or x0 > 1 then
-		return
-	end
-
-	
-	-- vertex stuff
-	shaderRef:send("age", age)
-	shaderRef:send("dataTexture", self.DataTexture)
-	shaderRef:send("duration", self.Duration)
-	shaderRef:send("length", self.Length)
-	shaderRef:send("facesCamera", self.FacesCamera)
-	shaderRef:send("pointCount", #self.Path.Points)
-
-	-- replace a subset of the bezierPoints array with the points of the bezier datatype
-	for i = 1, #self.Path.Points do
-		bezierPoints[i] = self.Path.Points[i]:array()
-	end
-	shaderRef:send("bezierPoints", unpack(bezierPoints))
-
-	-- fragment stuff
-	shaderRef:send("meshTexture", self.Texture)
-	shaderRef:send("meshBrightness", self.Brightness)
-	shaderRef:send("meshColor", {self.Color.r, self.Color.g, self.Color.b, self.Color.a})
-
-	love.graphics.draw(self.Mesh)
-
+-- returns how far along the path the front and the back of the trail are right now, where 0 is the start and 1 is the end of the path
+-- the trail is not visible if the front is below 0 or the back is above 1
+function Trail3:getRange(time)
+	local age = (time or love.timer.getTime()) - self.SpawnedAt
+	return (age - self.Length) / self.Duration, age / self.Duration
 end
 
 
@@ -101,7 +64,7 @@ end
 -- create a new trail that follows a bezier curve, has a mesh existing out of a given number of quads, has a texture and a numbercurve describing the width along the path
 local function new(path, segments, img, width)
 	assert(bezier.isBezier(path) and path.Dimensions == 3, "Trail3.newTrail3(path, segments, img, width) failed because 'bezier' is not a 3d bezier.")
-	assert(#path.Points <= 15 and #path.Points >= 2, "Trail.newTrail3(path, segments, img, width) failed because 'bezier' has a number of points that falls outside the range [2,15].")
+	assert(#path.Points >= 2, "Trail.newTrail3(path, segments, img, width) failed because 'bezier' has fewer than 2 points.")
 	assert(type(segments) == "number" and segments >= 1 and segments <= 100, "Trail3.newTrail3(path, segments, img, width) failed because 'segments' is not a number or out of the range 1-100")
 	assert(type(width) == "number" or numbercurve.isNumbercurve(width), "Trail3.newTrail3(path, segments, img, width) failed because 'width' is not a number nor a numbercurve")
 	-- if no image is supplied, just create a white pixel I suppose
@@ -111,36 +74,40 @@ local function new(path, segments, img, width)
 		img = love.graphics.newImage(imgData)
 	end
 
-	-- create image data for width and angle to be sampled in the vertex shader
+	-- sample the path once so that the vertex shader only needs to look up positions instead of solving the curve for each vertex
+	-- the first row holds the position and width of each sample, the second row holds the direction of the path
+	-- scene3 copies these rows into a texture shared by all of its trails when the trail is attached
 	if type(width) == "number" then width = numbercurve(0, width, 1, width) end
-	local trailData = love.image.newImageData(64, 1)
-	local w, normalized, high, low
-	trailData:mapPixel(
-		function(x, ...) -- this feels illegal
-			w = width:getNumber(x / 63) / 64 -- trails can be at most 64 units wide
-			high = math.floor(w * 256) / 256
-			low = w * 256 % 1
-			return high, low, 1, 1 -- two channels unused for now, could store some other property in the future
-		end
-	)
-	local dataImage = love.graphics.newImage(trailData)
+	local pathData = love.image.newImageData(PATH_SAMPLES, 2, "rgba32f")
+	local x, position, direction
+	for i = 0, PATH_SAMPLES - 1 do
+		x = i / (PATH_SAMPLES - 1)
+		position = path:getPoint(x)
+		direction = path:getVelocityAt(x)
+		pathData:setPixel(i, 0, position.x, position.y, position.z, width:getNumber(x))
+		pathData:setPixel(i, 1, direction.x, direction.y, direction.z, 0)
+	end
 
 	-- create mesh data
-	local meshData = {}
-	for i = 0, segments do
-		table.insert(meshData, {i / segments, 0}) -- trails textures are horizontal! (right side is pointing 'forwards')
-		table.insert(meshData, {i / segments, 1})
-	end
+	local mesh = stripMeshes[segments]
+	if mesh == nil then
+		local meshData = {}
+		for i = 0, segments do
+			table.insert(meshData, {i / segments, 0}) -- trails textures are horizontal! (right side is pointing 'forwards')
+			table.insert(meshData, {i / segments, 1})
+		end
 
-	-- don't need normals because we're not doing any fancy lighting
-	local mesh = love.graphics.newMesh(
-		{
-			{"VertexPosition", "float", 2} -- no texture coordinates because they're the same as the vertex coordinates!
-		},
-		meshData,
-		"strip", -- omg first time using strip!!!
-		"stream"
-	)
+		-- don't need normals because we're not doing any fancy lighting
+		mesh = love.graphics.newMesh(
+			{
+				{"VertexPosition", "float", 2} -- no texture coordinates because they're the same as the vertex coordinates!
+			},
+			meshData,
+			"strip", -- omg first time using strip!!!
+			"static"
+		)
+		stripMeshes[segments] = mesh
+	end
 
 
 	module.TotalCreated = module.TotalCreated + 1
@@ -150,7 +117,7 @@ local function new(path, segments, img, width)
 		["Mesh"] = mesh;
 		["Segments"] = segments;
 		["Texture"] = img;
-		["DataTexture"] = dataImage;
+		["PathData"] = pathData;
 		["Path"] = path; -- setting bezier by reference, this should never go wrong since beziers cannot be changed after creation anyway
 		["Duration"] = 1; -- how long it takes to travel from start to finish across the path (in seconds)
 		["Length"] = 0.5; -- how long a section of the path has any piece of the mesh displayed over it (in seconds)
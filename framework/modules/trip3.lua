@@ -63,11 +63,86 @@ function Trip3:clone()
 	Mesh.TextureScale = self.TextureScale
 	Mesh.CastShadow = self.CastShadow
 	Mesh.NormalMap = self.NormalMap
+	Mesh.LODHysteresis = self.LODHysteresis
+	Mesh.LODFade = self.LODFade
+	for i = 1, #self.LODs do
+		Mesh:addLOD(self.LODs[i].Mesh, self.LODs[i].Distance)
+	end
 	-- keep the scene nil
 	return Mesh
 end
 
 
+-- adds a lower detail mesh that is drawn instead of the full mesh once the camera is at least 'distance' away from the mesh's position
+function Trip3:addLOD(meshRef, distance)
+	assert(type(distance) == "number" and distance > 0, "Trip3:addLOD(meshRef, distance) requires argument 'distance' to be a positive number.")
+	local LODs = self.LODs
+	local index = #LODs + 1
+	while index > 1 and LODs[index - 1].Distance > distance do -- keep the levels sorted from most to least detailed
+		index = index - 1
+	end
+	table.insert(LODs, index, {["Mesh"] = meshRef; ["Distance"] = distance;})
+end
+
+
+
+function Trip3:clearLODs()
+	self.LODs = {}
+	self.LODLevel = 0
+	self.LODMesh = nil
+	self.LODFadeMesh = nil
+	self.LODFadeAmount = 0
+end
+
+
+
+-- picks the level of detail to draw for a camera at x, y, z. Level 0 is the mesh itself, level n is LODs[n]. Called by the scene for meshes that are about to be drawn
+-- switching only happens once the distance is LODHysteresis past a switch distance, so meshes that sit right at a switch distance do not flicker between levels
+-- each switch distance has one fade band of width LODFade centered on it. Inside it, LODFadeMesh is set to the other level of that switch and LODFadeAmount
+-- is how much of LODMesh is dithered away. Both branches measure from the near edge of the band, so the fade is continuous wherever hysteresis switches
+function Trip3:updateLOD(x, y, z)
+	local LODs = self.LODs
+	local dx, dy, dz = self.Matrix[13] - x, self.Matrix[14] - y, self.Matrix[15] - z
+	local dist = math.sqrt(dx * dx + dy * dy + dz * dz)
+	local hysteresis = self.LODHysteresis
+
+	local level = math.min(self.LODLevel, #LODs)
+	while level < #LODs and dist >= LODs[level + 1].Distance + hysteresis do
+		level = level + 1
+	end
+	while level > 0 and dist < LODs[level].Distance - hysteresis do
+		level = level - 1
+	end
+	self.LODLevel = level
+	self.LODMesh = level > 0 and LODs[level].Mesh or self.Mesh
+
+	-- 'coarse' is how far into the band of a switch the distance is, which is how much of the coarser level of that switch is shown
+	-- while the hysteresis holds on to a level past the end of its band, the other level is shown fully so that nothing pops when it does switch
+	local fadeMesh, fadeAmount = nil, 0
+	local fade = self.LODFade
+	if fade > 0 then
+		local coarse
+		if level < #LODs then
+			coarse = (dist - (LODs[level + 1].Distance - fade / 2)) / fade
+			if coarse > 0 then
+				fadeMesh = LODs[level + 1].Mesh
+				fadeAmount = coarse -- the coarser level fades in, so the current level fades out by the same amount
+			end
+		end
+		if fadeMesh == nil and level > 0 then
+			coarse = (dist - (LODs[level].Distance - fade / 2)) / fade
+			if coarse < 1 then
+				fadeMesh = level > 1 and LODs[level - 1].Mesh or self.Mesh
+				fadeAmount = 1 - coarse -- the finer level fades in, so the current (coarser) level fades out by the same amount
+			end
+		end
+	end
+	self.LODFadeMesh = fadeMesh
+	self.LODFadeAmount = math.min(fadeAmount, 1)
+end
+
+
+
 function Trip3:attach(scene3d)
 	assert(scene3.isScene3(scene3d), "trip3:attach(scene3) requires argument 'scene3' to be a scene3.")
 	scene3d:attachMesh(self)
@@ -115,6 +190,13 @@ local function new(meshRef, position, rotation, scale, col, scol)
 		["CastShadow"] = false;
 		["TextureScale"] = 1;
 		["NormalMap"] = nil;
+		["LODs"] = {}; -- lower detail meshes, see Trip3:addLOD()
+		["LODHysteresis"] = 0; -- distance past a switch distance before the level of detail changes
+		["LODFade"] = 0; -- width of the dithered cross-fade between two levels of detail in world units, 0 to switch instantly
+		["LODLevel"] = 0;
+		["LODMesh"] = nil; -- mesh that is drawn for the current level of detail, set by Trip3:updateLOD()
+		["LODFadeMesh"] = nil;
+		["LODFadeAmount"] = 0;
 		["Scene"] = nil;
 
 		["Matrix"] = matrix4.fromTransforms(position, rotation, scale);
@@ -144,6 +226,11 @@ function Trip3:__newindex(key, value)
 		rawset(self, "Matrix", matrix4.fromTransforms(self._Position, self._Rotation, value))
 	else
 		rawset(self, key, value)
+		return
+	end
+	-- the matrix changed, so the mesh may have moved to a different part of the scene's octree
+	if self.Scene ~= nil then
+		self.Scene:updateMeshBounds(self)
 	end
 end
 
@@ -0,0 +1,32 @@
+#pragma language glsl3
+
+// one level of the depth & normal pyramid that ambient occlusion is calculated from at half or quarter resolution. Each pixel takes the
+// closest depth of the 2x2 block of source pixels it covers, together with the normal of that same pixel so that both describe the same surface
+// see Scene3:setAOResolution()
+
+uniform Image sourceDepth; // depth canvas for the first level, the previous level after that
+uniform Image sourceNormal; // normal canvas for the first level, the previous level after that
+uniform vec2 sourceSize;
+uniform vec2 targetSize;
+
+
+
+// outputs to two canvases: the depth (r32f) and the normal (rgba8, alpha is whether AO is applied)
+void effect() {
+	ivec2 base = ivec2(floor(love_PixelCoord.xy * sourceSize / targetSize));
+	ivec2 maxCoord = ivec2(sourceSize) - 1;
+	ivec2 closest = min(base, maxCoord);
+	float depth = 1.0;
+	for (int y = 0; y < 2; y++) {
+		for (int x = 0; x < 2; x++) {
+			ivec2 coord = min(base + ivec2(x, y), maxCoord);
+			float sampleDepth = texelFetch(sourceDepth, coord, 0).r;
+			if (sampleDepth < depth) {
+				depth = sampleDepth;
+				closest = coord;
+			}
+		}
+	}
+	love_Canvases[0] = vec4(depth, 0.0, 0.0, 1.0);
+	love_Canvases[1] = texelFetch(sourceNormal, closest, 0);
+}
@@ -0,0 +1,47 @@
+#pragma language glsl3
+
+// blends this frame's ambient occlusion with the result of earlier frames. Each pixel is reprojected into last frame's view to find where
+// it was on the screen, and the history is only used if the depth stored there matches, so that disoccluded pixels don't smear
+// the output stores the ambient occlusion in 'r' and the linear view depth in 'g' so that the next frame can do the same check
+// see Scene3:setAOResolution()
+
+uniform Image historyTexture; // result of last frame
+uniform Image depthTexture; // depth at the resolution of the ambient occlusion
+uniform mat4 perspectiveMatrix;
+uniform mat4 invPerspectiveMatrix;
+uniform mat4 camMatrix; // this frame's camera
+uniform mat4 prevViewMatrix; // inverse of last frame's camera
+uniform float historyWeight; // how much of the history is kept, 0 when there is no history yet
+
+const float depthTolerance = 0.05; // relative difference in depth at which the history is rejected
+
+
+
+vec4 effect(vec4 color, Image tex, vec2 texture_coords, vec2 screen_coords) {
+	float ao = Texel(tex, texture_coords).r;
+	float depth = Texel(depthTexture, texture_coords).r;
+	if (depth == 1.0) {
+		return vec4(ao, 0.0, 0.0, 1.0); // nothing to accumulate in empty space
+	}
+
+	vec4 viewPosition = invPerspectiveMatrix * vec4(texture_coords * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+	viewPosition /= viewPosition.w;
+
+	float weight = 0.0;
+	float history = ao;
+	if (historyWeight > 0.0) { // prevViewMatrix is not set yet on the first frame
+		vec4 prevViewPosition = prevViewMatrix * camMatrix * viewPosition;
+		vec4 prevScreenPosition = perspectiveMatrix * prevViewPosition;
+		vec2 prevCoords = prevScreenPosition.xy / prevScreenPosition.w * 0.5 + 0.5;
+		if (prevCoords.x >= 0.0 && prevCoords.x <= 1.0 && prevCoords.y >= 0.0 && prevCoords.y <= 1.0) {
+			vec2 stored = Texel(historyTexture, prevCoords).rg;
+			float expectedDepth = -prevViewPosition.z;
+			if (abs(stored.g - expectedDepth) < expectedDepth * depthTolerance) {
+				history = stored.r;
+				weight = historyWeight;
+			}
+		}
+	}
+
+	return vec4(mix(ao, history, weight), -viewPosition.z, 0.0, 1.0);
+}
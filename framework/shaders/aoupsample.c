@@ -0,0 +1,45 @@
+#pragma language glsl3
+
+// depth-aware bilateral upsample of ambient occlusion that was calculated at half or quarter resolution
+// each pixel blends the 4 nearest low resolution texels, but texels whose depth differs from the pixel's own depth get (almost) no weight
+// so that occlusion does not bleed across the edges of objects. See Scene3:setAOResolution()
+
+uniform Image depthTexture; // full resolution depth
+uniform Image lowDepthTexture; // depth at the resolution of the ambient occlusion, from the depth pyramid
+uniform vec2 lowSize;
+
+const float zNear = 0.1;
+const float zFar = 1000.0;
+const float depthSensitivity = 20.0; // higher values make edges sharper, but too high values show the blocky low resolution texels
+
+
+
+float linearDepth(float depth) {
+	float ndcDepth = depth * 2.0 - 1.0;
+	return (2.0 * zNear * zFar) / (zFar + zNear - ndcDepth * (zFar - zNear));
+}
+
+
+
+vec4 effect(vec4 color, Image tex, vec2 texture_coords, vec2 screen_coords) {
+	float depth = linearDepth(Texel(depthTexture, texture_coords).r);
+	vec2 lowCoord = texture_coords * lowSize - 0.5;
+	vec2 base = floor(lowCoord);
+	vec2 f = lowCoord - base;
+
+	float sum = 0.0;
+	float totalWeight = 0.0;
+	for (int y = 0; y < 2; y++) {
+		for (int x = 0; x < 2; x++) {
+			vec2 sampleCoords = (base + vec2(x, y) + 0.5) / lowSize;
+			float sampleDepth = linearDepth(Texel(lowDepthTexture, sampleCoords).r);
+			float bilinearWeight = (x == 0 ? 1.0 - f.x : f.x) * (y == 0 ? 1.0 - f.y : f.y);
+			float depthWeight = 1.0 / (0.001 + depthSensitivity * abs(sampleDepth - depth) / depth);
+			float weight = bilinearWeight * depthWeight;
+			sum += Texel(tex, sampleCoords).r * weight;
+			totalWeight += weight;
+		}
+	}
+
+	return vec4(vec3(sum / max(totalWeight, 0.00001)), 1.0);
+}
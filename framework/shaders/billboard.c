@@ -12,12 +12,14 @@ uniform float fieldOfView;
 const float zNear = 0.1;
 const float zFar = 1000.0;
 
-// billboard variables
-uniform float rotation; // rotation (in radians)
-uniform vec3 worldPosition; // position in world coordinates
-uniform vec2 center; // where on the rectangle the center lays
-uniform vec2 worldSize; // size in world coordinates
-uniform vec2 pixelSize; // size in screen pixels
+// billboard variables, one set per instance so that all billboards with the same texture are drawn at once
+attribute vec4 BillboardPosition; // position in world coordinates, rotation (in radians)
+attribute vec4 BillboardSize; // size in world coordinates, size in screen pixels
+attribute vec2 BillboardCenter; // where on the rectangle the center lays
+attribute vec4 BillboardColor;
+attribute vec4 BillboardUV; // offset and size of the part of the texture that is shown
+
+varying vec4 billboardColor;
 
 
 // make sure the mesh looks like this:
@@ -64,7 +66,7 @@ mat2 getRotationMatrix2d(float rot) {
 
 // don't quite understand how this works but the other approach I tried was applying pixel size all the way at the end
 // and doing it all the way at the end was too hard to make work
-vec2 pixelsSizeToWorldSize(mat4 viewMatrix) {
+vec2 pixelsSizeToWorldSize(mat4 viewMatrix, vec3 worldPosition, vec2 pixelSize) {
 	// world to view-space
 	vec4 viewPos = viewMatrix * vec4(worldPosition, 1.0);
 	float depth = abs(viewPos.z);
@@ -78,6 +80,13 @@ vec2 pixelsSizeToWorldSize(mat4 viewMatrix) {
 
 vec4 position(mat4 transform_projection, vec4 vertex_position) {
 	mat4 viewMatrix = inverse(camMatrix);
+	vec3 worldPosition = BillboardPosition.xyz;
+	vec2 worldSize = BillboardSize.xy;
+	vec2 pixelSize = BillboardSize.zw;
+	vec2 center = BillboardCenter;
+
+	billboardColor = BillboardColor;
+	VaryingTexCoord.xy = BillboardUV.xy + VaryingTexCoord.xy * BillboardUV.zw;
 
 	// offsets from center. To be used all the way in the end to apply pixel size!
 	vec2 fracOffset = vertex_position.xy - center;
@@ -88,12 +97,12 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 	// use worldSize to scale the mesh's x and y
 	vec2 newWorldSize = worldSize;
 	if (pixelSize.x != 0.0 || pixelSize.y != 0.0) {
-		newWorldSize = newWorldSize + pixelsSizeToWorldSize(viewMatrix);
+		newWorldSize = newWorldSize + pixelsSizeToWorldSize(viewMatrix, worldPosition, pixelSize);
 	}
 	vertex_position = vertex_position * vec4(newWorldSize.x, newWorldSize.y, 1.0, 1.0);
 
 	// rotate the mesh along the center using unit circle
-	mat2 rotMatrix = getRotationMatrix2d(rotation);
+	mat2 rotMatrix = getRotationMatrix2d(BillboardPosition.w);
 	vec2 rotatedXY = rotMatrix * vertex_position.xy;
 	vertex_position = vec4(rotatedXY.x, rotatedXY.y, vertex_position.z, vertex_position.w);
 
@@ -120,9 +129,11 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 // fragment Shader
 #ifdef PIXEL
 
+varying vec4 billboardColor;
+
 // default fragment shader
 vec4 effect(vec4 color, Image tex, vec2 texture_coords, vec2 screen_coords) {
-	return Texel(tex, texture_coords) * color;
+	return Texel(tex, texture_coords) * color * billboardColor;
 }
 
 #endif
@@ -0,0 +1,34 @@
+#pragma language glsl3
+
+// one step down the bloom mip chain. Uses the 13-tap filter from Call of Duty: Advanced Warfare (Jimenez 2014): five overlapping 4x4 boxes
+// are averaged with weights that favor the center box, which keeps small bright spots from flickering when the camera moves
+// see Scene3:setBloom()
+
+uniform vec2 sourceSize; // size in pixels of the canvas that is drawn
+
+
+
+vec4 effect(vec4 color, Image tex, vec2 texCoord, vec2 screenCoords) {
+	vec2 texel = 1.0 / sourceSize;
+
+	vec3 a = Texel(tex, texCoord + texel * vec2(-2.0, -2.0)).rgb;
+	vec3 b = Texel(tex, texCoord + texel * vec2( 0.0, -2.0)).rgb;
+	vec3 c = Texel(tex, texCoord + texel * vec2( 2.0, -2.0)).rgb;
+	vec3 d = Texel(tex, texCoord + texel * vec2(-2.0,  0.0)).rgb;
+	vec3 e = Texel(tex, texCoord).rgb;
+	vec3 f = Texel(tex, texCoord + texel * vec2( 2.0,  0.0)).rgb;
+	vec3 g = Texel(tex, texCoord + texel * vec2(-2.0,  2.0)).rgb;
+	vec3 h = Texel(tex, texCoord + texel * vec2( 0.0,  2.0)).rgb;
+	vec3 i = Texel(tex, texCoord + texel * vec2( 2.0,  2.0)).rgb;
+	vec3 j = Texel(tex, texCoord + texel * vec2(-1.0, -1.0)).rgb;
+	vec3 k = Texel(tex, texCoord + texel * vec2( 1.0, -1.0)).rgb;
+	vec3 l = Texel(tex, texCoord + texel * vec2(-1.0,  1.0)).rgb;
+	vec3 m = Texel(tex, texCoord + texel * vec2( 1.0,  1.0)).rgb;
+
+	vec3 sum = e * 0.125;
+	sum += (a + c + g + i) * 0.03125;
+	sum += (b + d + f + h) * 0.0625;
+	sum += (j + k + l + m) * 0.125;
+
+	return vec4(sum, 1.0);
+}
@@ -0,0 +1,24 @@
+#pragma language glsl3
+
+// one step up the bloom mip chain. A 3x3 tent filter over the smaller mip, which is added onto the next larger mip using additive blending
+// see Scene3:setBloom()
+
+uniform vec2 sourceSize; // size in pixels of the canvas that is drawn
+
+
+
+vec4 effect(vec4 color, Image tex, vec2 texCoord, vec2 screenCoords) {
+	vec2 texel = 1.0 / sourceSize;
+
+	vec3 sum = Texel(tex, texCoord).rgb * 4.0;
+	sum += Texel(tex, texCoord + texel * vec2( 0.0, -1.0)).rgb * 2.0;
+	sum += Texel(tex, texCoord + texel * vec2(-1.0,  0.0)).rgb * 2.0;
+	sum += Texel(tex, texCoord + texel * vec2( 1.0,  0.0)).rgb * 2.0;
+	sum += Texel(tex, texCoord + texel * vec2( 0.0,  1.0)).rgb * 2.0;
+	sum += Texel(tex, texCoord + texel * vec2(-1.0, -1.0)).rgb;
+	sum += Texel(tex, texCoord + texel * vec2( 1.0, -1.0)).rgb;
+	sum += Texel(tex, texCoord + texel * vec2(-1.0,  1.0)).rgb;
+	sum += Texel(tex, texCoord + texel * vec2( 1.0,  1.0)).rgb;
+
+	return vec4(sum / 16.0, 1.0) * color;
+}
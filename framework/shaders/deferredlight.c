@@ -0,0 +1,111 @@
+#pragma language glsl3
+
+// deferred point lights: each light is drawn as a single camera-facing quad that covers the light's range on the screen
+// the quad reconstructs the position of the geometry behind it from the depth canvas and adds the light's contribution onto the render canvas
+
+varying vec3 viewPosition; // position on the light's quad in camera space, used to get the view ray in the fragment shader
+varying vec4 lightPosRange; // xyz = light position in world space, w = range
+varying vec4 lightColStrength; // xyz = color, w = strength
+
+uniform mat4 camMatrix;
+
+const float zNear = 0.1;
+const float zFar = 1000.0;
+
+
+
+#ifdef VERTEX
+
+uniform float aspectRatio;
+uniform float fieldOfView;
+uniform Image lightData; // same light data texture as the clustered lights use, see Scene3:updateLightClusters()
+
+
+
+// vertical field-of-view is used
+mat4 getPerspectiveMatrix(float fieldOfView, float aspect) {
+	float tanHalfFov = tan(fieldOfView / 2.0);
+
+	mat4 perspectiveMatrix = mat4(0.0);
+	perspectiveMatrix[0][0] = 1.0 / (aspect * tanHalfFov);
+	perspectiveMatrix[1][1] = 1.0 / (tanHalfFov);
+	perspectiveMatrix[2][2] = -(zFar + zNear) / (zFar - zNear);
+	perspectiveMatrix[2][3] = -1.0;
+	perspectiveMatrix[3][2] = -(2.0 * zFar * zNear) / (zFar - zNear);
+
+	return perspectiveMatrix;
+}
+
+
+
+// vertex_position is a corner of a quad going from -1 to 1 on the x and y axis, drawn once per light
+vec4 position(mat4 transform_projection, vec4 vertex_position) {
+	vec4 posRange = texelFetch(lightData, ivec2(love_InstanceID, 0), 0);
+	lightColStrength = texelFetch(lightData, ivec2(love_InstanceID, 1), 0);
+
+	vec3 center = (inverse(camMatrix) * vec4(posRange.xyz, 1.0)).xyz;
+	float range = posRange.w;
+	lightPosRange = posRange;
+
+	float dist = length(center);
+	if (dist < range * 1.5 + zNear) {
+		// the camera is inside of (or very close to) the light's range, so simply cover the whole screen
+		float tanHalfFov = tan(fieldOfView / 2.0);
+		viewPosition = vec3(vertex_position.x * tanHalfFov * aspectRatio, vertex_position.y * tanHalfFov, -1.0);
+		return vec4(vertex_position.xy, 0.0, 1.0);
+	}
+
+	// place the quad in front of the light's sphere, just large enough to cover the sphere's silhouette
+	vec3 dir = center / dist;
+	vec3 right = normalize(cross(dir, abs(dir.y) < 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+	vec3 up = cross(right, dir);
+	float quadDistance = dist - range;
+	float halfSize = quadDistance * range / sqrt(dist * dist - range * range);
+	viewPosition = dir * quadDistance + (right * vertex_position.x + up * vertex_position.y) * halfSize;
+	return getPerspectiveMatrix(fieldOfView, aspectRatio) * vec4(viewPosition, 1.0);
+}
+
+#endif
+
+
+
+#ifdef PIXEL
+
+uniform Image depthTexture;
+uniform Image shadingNormalTexture; // normals in world space with the normal map applied, see Scene3:setDeferredLights()
+uniform Image albedoTexture; // surface color before lighting, already multiplied by 1 - brightness
+uniform float diffuseStrength;
+
+
+
+vec4 effect(vec4 color, Image tex, vec2 texture_coords, vec2 screen_coords) {
+	vec2 screenFraction = vec2(love_PixelCoord.x / love_ScreenSize.x, love_PixelCoord.y / love_ScreenSize.y);
+	float depth = Texel(depthTexture, screenFraction).r;
+	if (depth == 1.0) {
+		discard; // nothing was drawn here
+	}
+
+	// reconstruct the position of the geometry in camera space by walking along the view ray until the linear depth is reached
+	float ndcDepth = depth * 2.0 - 1.0;
+	float linearDepth = (2.0 * zNear * zFar) / (zFar + zNear - ndcDepth * (zFar - zNear));
+	vec3 fragPosition = viewPosition / -viewPosition.z * linearDepth;
+
+	// light in world space like the forward lights do, since that is the space the shading normals are stored in
+	vec3 fragWorldPosition = (camMatrix * vec4(fragPosition, 1.0)).xyz;
+	vec3 toLight = lightPosRange.xyz - fragWorldPosition;
+	float distance = length(toLight);
+	if (distance > lightPosRange.w) {
+		discard;
+	}
+
+	// same falloff and diffuse shading as the forward lights
+	float attenuation = clamp(1.0 - distance / lightPosRange.w, 0.0, 1.0);
+	vec3 normal = normalize(Texel(shadingNormalTexture, screenFraction).rgb * 2.0 - 1.0);
+	float diffuseFactor = max(dot(normal, toLight / distance), 0.0);
+	vec3 lighting = lightColStrength.rgb * lightColStrength.w * attenuation * ((diffuseFactor * diffuseStrength) + (1.0 - diffuseStrength));
+
+	vec3 albedo = Texel(albedoTexture, screenFraction).rgb;
+	return vec4(albedo * lighting, 0.0); // alpha = 0 so the canvas' alpha stays the same when adding
+}
+
+#endif
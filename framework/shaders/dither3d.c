@@ -12,12 +12,11 @@ uniform float fieldOfView;
 const float zNear = 0.1;
 const float zFar = 1000.0;
 
-// mask variables
-uniform vec3 worldPosition; // position in world coordinates
+// mask variables, per instance since all masks are drawn in one call
+attribute vec3 MaskPosition; // position in world coordinates
 // from 0 to inner radius is fully see-through
-uniform float innerRadius; // in world units
 // from inner radius to outer radius linearly becomes thicker dithering effect until it's opaque
-uniform float outerRadius;
+attribute vec2 MaskRadii; // x = inner radius, y = outer radius, in world units
 
 
 attribute float VertexIsInner;
@@ -73,7 +72,7 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 
 	// scale vertex away from center depending on if it's in the inner circle or outer circle. Vertex positions will be laying at a distance of 1 around the center
 	// the one exception is the center vertex, but that one is at 0,0 so no matter the multiplier it'll always remain at the center
-	vec2 position = vertex_position.xy * vec2(VertexIsInner * innerRadius) + vertex_position.xy * vec2((1.0 - VertexIsInner) * outerRadius);
+	vec2 position = vertex_position.xy * vec2(VertexIsInner * MaskRadii.x) + vertex_position.xy * vec2((1.0 - VertexIsInner) * MaskRadii.y);
 
 
 
@@ -83,7 +82,7 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 	// apply billboard behavior (move to world position, then offset using the camera's model axes)
 	vec3 camRight = normalize(camMatrix[0].xyz);
 	vec3 camUp = normalize(camMatrix[1].xyz);
-	vec3 worldPos = worldPosition + (camRight * position.x) + (camUp * position.y);
+	vec3 worldPos = MaskPosition + (camRight * position.x) + (camUp * position.y);
 
 	// transform to clip space
 	mat4 perspectiveMatrix = getPerspectiveMatrix(fieldOfView, aspectRatio);
@@ -107,20 +106,13 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 
 varying float threshold;
 
+// masks are drawn into the stencil buffer, so pixels that should stay visible are discarded to keep them out of it
 vec4 effect(vec4 color, Image tex, vec2 texture_coords, vec2 screen_coords) {
-
-	// TODO: write depth as a color to the canvas
-	// r = 0 if no mask, 1 if mask
-	// g = depth
-
-	//return Texel(tex, texture_coords) * color;
-	//return vec2(1.0, depth);
-	vec2 screen_fraction = vec2(screen_coords.x / 16.0, screen_coords.y / 16.0); // divivde by 16 because that's the resolution of the dithering pattern
-	float value = 1.0;
+	vec2 screen_fraction = screen_coords / 16.0; // divide by 16 because that's the resolution of the dithering pattern, same as the level-of-detail cross-fade
 	if (Texel(tex, screen_fraction).r > threshold) {
-		value = 0.0;
+		discard;
 	}
-	return vec4(value);
+	return vec4(1.0);
 }
 
 #endif
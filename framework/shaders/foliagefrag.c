@@ -17,8 +17,18 @@ struct Light {
 	float strength;
 };
 
-uniform vec4 lightsInfo[16 * 2]; // array where each even index is {posX, posY, posZ, range} and each uneven index is {colR, colG, colB, strength}
-uniform int lightCount;
+uniform Image lightData; // 2 rows, first row is {posX, posY, posZ, range} and second row is {colR, colG, colB, strength} of each light
+uniform Image lightClusters; // {offset, count} into lightIndices for each cluster. x = tile x + tile y * tiles on the x-axis, y = depth slice
+uniform Image lightIndices; // indices into lightData of the lights that touch each cluster, packed together
+uniform vec3 clusterCount; // number of clusters on the x, y and z-axis
+uniform vec3 clusterCameraPosition;
+uniform vec3 clusterCameraRight;
+uniform vec3 clusterCameraUp;
+uniform vec3 clusterCameraBack;
+uniform vec2 clusterTan; // tangent of half the horizontal and vertical field of view
+uniform vec2 clusterDepth; // x = near plane, y = depth slices / log(far / near)
+const int LIGHT_INDICES_WIDTH = 1024; // same as LIGHT_INDICES_WIDTH in scene3.lua
+uniform bool lightsDeferred = false; // if true, point lights are added later in the deferred light pass, see Scene3:applyDeferredLights()
 uniform vec3 ambientColor;
 
 // blob shadows
@@ -38,34 +48,70 @@ uniform float meshBrightness; // if 1, mesh is not affected by diffuse shading a
 varying vec3 instColor;
 varying vec3 instColorShadow;
 
-// masking
-uniform float masked;
-uniform Image maskCanvas; // r16
+// masked meshes are not drawn where a mask wrote to the stencil buffer, which is set up before drawing in scene3.lua
 
 // textures
 uniform Image MainTex; // used to be the 'tex' argument, but is now passed separately in this specific variable name because we switched to multi-canvas shading which has no arguments
 uniform Image meshTexture; // replaces MainTex. Instead of using mesh:setTexture(), they are now passed separately so that a mesh can be reused with different textures on them
 uniform Image normalMap;
 uniform sampler2DShadow shadowCanvas; // use Image when doing 'basic' sampling. Use sampler2DShadow when you want automatic bilinear filtering (but more prone to shadow acne :<)
+uniform mat4 shadowCascadeMatrices[4]; // from the sun's view space to the normalized coordinates of each cascade
+uniform vec4 shadowCascadeSplits; // view depth at which each cascade ends
+uniform int shadowCascadeCount = 1;
 
 // fragment shader
 
 
 Light getLight(int index) {
 	Light light;
-	light.position = lightsInfo[index * 2].xyz;
-	light.range = lightsInfo[index * 2].w;
-	light.color = lightsInfo[index * 2 + 1].xyz;
-	light.strength = lightsInfo[index * 2 + 1].w;
+	vec4 posRange = texelFetch(lightData, ivec2(index, 0), 0);
+	vec4 colStrength = texelFetch(lightData, ivec2(index, 1), 0);
+	light.position = posRange.xyz;
+	light.range = posRange.w;
+	light.color = colStrength.xyz;
+	light.strength = colStrength.w;
 	return light;
 }
 
 
+// returns the {offset, count} of the lights in the cluster that the given world position is in. Must match Scene3:updateLightClusters()
+ivec2 getLightCluster(vec3 worldPosition) {
+	vec3 offset = worldPosition - clusterCameraPosition;
+	float depth = max(-dot(offset, clusterCameraBack), clusterDepth.x);
+	vec2 ndc = vec2(dot(offset, clusterCameraRight), dot(offset, clusterCameraUp)) / (depth * clusterTan);
+	vec3 cluster = vec3((ndc * 0.5 + 0.5) * clusterCount.xy, log(depth / clusterDepth.x) * clusterDepth.y);
+	ivec3 c = ivec3(clamp(floor(cluster), vec3(0.0), clusterCount - 1.0));
+	return ivec2(texelFetch(lightClusters, ivec2(c.x + c.y * int(clusterCount.x), c.z), 0).rg);
+}
+
+
+int getClusterLight(int index) {
+	return int(texelFetch(lightIndices, ivec2(index % LIGHT_INDICES_WIDTH, index / LIGHT_INDICES_WIDTH), 0).r);
+}
+
+
+// cascaded shadows: picks the cascade by the fragment's view depth and returns the fragment's coordinates in the shadow canvas
+// the cascades are placed side by side in the shadow canvas, see Scene3:setShadowCascades()
+vec3 getShadowCoords(vec4 sunViewPosition) {
+	float ndcDepth = gl_FragCoord.z * 2.0 - 1.0;
+	float viewDepth = (2.0 * 0.1 * 1000.0) / (1000.0 + 0.1 - ndcDepth * (1000.0 - 0.1)); // camera near and far plane
+	int cascade = 0;
+	while (cascade < shadowCascadeCount - 1 && viewDepth > shadowCascadeSplits[cascade]) {
+		cascade++;
+	}
+	vec3 projCoords = (shadowCascadeMatrices[cascade] * sunViewPosition).xyz * 0.5 + 0.5;
+	if (projCoords.x >= 0.0 && projCoords.x <= 1.0) {
+		projCoords.x = (projCoords.x + float(cascade)) / float(shadowCascadeCount);
+	}
+	return projCoords;
+}
+
+
+
 // https://learnopengl.com/Advanced-Lighting/Shadows/Shadow-Mapping
 // calculate shadow using sampler2DShadow, which uses bilinear filtering automatically for better shadows, but has bigger problems with shadow acne :<
 float calculateShadow(vec4 fragPosLightSpace, vec3 surfaceNormal) {
-	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-	projCoords = projCoords * 0.5 + 0.5;
+	vec3 projCoords = getShadowCoords(fragPosLightSpace);
 
 	// no shadows when outside the shadow canvas
 	if (projCoords.x < 0.0 || projCoords.x > 1.0 || projCoords.y < 0.0 || projCoords.y > 1.0) {
@@ -99,12 +145,6 @@ float calculateShadow(vec4 fragPosLightSpace, vec3 surfaceNormal) {
 
 
 void effect() {
-	// apply masking
-	vec2 screen_fraction = vec2(love_PixelCoord.x / love_ScreenSize.x, love_PixelCoord.y / love_ScreenSize.y);
-	if (Texel(maskCanvas, screen_fraction).r > 1.0 - masked) {
-		discard;
-	}
-
 	vec4 color = VaryingColor; // argument 'color' doesn't exist when using multiple canvases, so use built-in VaryingColor
 	vec4 shadowColor = VaryingColor;
 	color = vec4(color.x * instColor.x, color.y * instColor.y, color.z * instColor.z, color.w);
@@ -151,8 +191,10 @@ void effect() {
 	vec3 lighting = ambientColor; // start with just ambient lighting on the surface
 
 	// add the lighting contribution of all lights to the surface
-	for (int i = 0; i < lightCount; ++i) { // reducing lights from 16 to 1 will only really improve FPS from 235 to 245, so having 16 lights is fine
-		Light light = getLight(i);
+	// only lights whose range touches the fragment's cluster are considered
+	ivec2 lightCluster = lightsDeferred ? ivec2(0) : getLightCluster(fragWorldPosition);
+	for (int i = 0; i < lightCluster.y; ++i) {
+		Light light = getLight(getClusterLight(lightCluster.x + i));
 		
 		vec3 lightDir = normalize(light.position - fragWorldPosition);
 		float distance = length(light.position - fragWorldPosition);
@@ -185,6 +227,7 @@ void effect() {
 	
 	// set the color on the main canvas. Apply mesh brightness here as well. Higher brightness means less affected by ambient color
 	vec4 resultingColor = texColor * objectColor * mix(vec4(lighting.xyz, 1.0), vec4(1.0, 1.0, 1.0, 1.0), meshBrightness);
+	vec3 surfaceColor = (texColor * objectColor).rgb * (1.0 - meshBrightness); // used by deferred lights, which add onto the surface color
 
 	// moved discarding all the way down here
 	// why? because for some reason black outlines appear otherwise. I don't know why, but this fixes it
@@ -198,6 +241,9 @@ void effect() {
 
 	love_Canvases[1] = vec4(fragViewNormal.x / 2 + 0.5, fragViewNormal.y / 2 + 0.5, fragViewNormal.z / 2 + 0.5, 0.0); // pack normals into an RGBA format; alpha = draw no ambient occlusion
 
+	love_Canvases[3] = vec4(surfaceColor, 1.0); // this and the shading normal are only bound when deferred lights are enabled
+	love_Canvases[4] = vec4(normalMapNormalWorld * 0.5 + 0.5, 1.0);
+
 	// ignore canvases[2] as foliage doesn't support bloom. Also: since foliage is drawn *before* any bloom emitting meshes, foliage never has to draw black to overwrite the bloom either!
 	
 
@@ -6,7 +6,6 @@ uniform mat4 camMatrix;
 uniform float aspectRatio;
 uniform float fieldOfView;
 uniform mat4 sunWorldMatrix;
-uniform mat4 orthoMatrix;
 
 uniform float currentTime;
 
@@ -237,7 +236,7 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 	
 	// init variables for shadow map
 	mat4 sunViewMatrix = inverse(sunWorldMatrix);
-	fragPosLightSpace = orthoMatrix * sunViewMatrix * vec4(fragWorldPosition, 1.0);
+	fragPosLightSpace = sunViewMatrix * vec4(fragWorldPosition, 1.0); // the projection of the shadow cascade is applied in the fragment shader
 
 
 	return result;
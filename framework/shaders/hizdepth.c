@@ -0,0 +1,21 @@
+#pragma language glsl3
+
+// one level of the hierarchical depth buffer used for occlusion culling. Each pixel stores the furthest depth of the 4x4 block
+// of source pixels it covers, so an object is hidden if it is behind that depth everywhere it covers on the screen
+
+uniform Image sourceDepth; // depth canvas for the first level, the previous level after that
+uniform vec2 sourceSize;
+
+
+
+vec4 effect(vec4 color, Image tex, vec2 texture_coords, vec2 screen_coords) {
+	ivec2 base = ivec2(floor(love_PixelCoord.xy)) * 4;
+	ivec2 maxCoord = ivec2(sourceSize) - 1;
+	float depth = 0.0;
+	for (int y = 0; y < 4; y++) {
+		for (int x = 0; x < 4; x++) {
+			depth = max(depth, texelFetch(sourceDepth, min(base + ivec2(x, y), maxCoord), 0).r);
+		}
+	}
+	return vec4(depth, 0.0, 0.0, 1.0);
+}
@@ -16,7 +16,7 @@ varying float lifetime;
 varying vec3 fragWorldPosition;
 varying vec3 fragWorldNormal;
 varying float fragWorldDepth;
-uniform bool blends;
+// BLENDS is defined for the variant that draws blending vfx into the vfx canvases, see shadervariants.lua
 uniform float blendDistance = 1.0; // how many world units two vfx fragments need to be apart for the further one to have half the weight of the closer one
 
 // lights
@@ -26,8 +26,17 @@ struct Light {
 	float range;
 	float strength;
 };
-uniform vec4 lightsInfo[16 * 2]; // array where each even index is {posX, posY, posZ, range} and each uneven index is {colR, colG, colB, strength}
-uniform int lightCount;
+uniform Image lightData; // 2 rows, first row is {posX, posY, posZ, range} and second row is {colR, colG, colB, strength} of each light
+uniform Image lightClusters; // {offset, count} into lightIndices for each cluster. x = tile x + tile y * tiles on the x-axis, y = depth slice
+uniform Image lightIndices; // indices into lightData of the lights that touch each cluster, packed together
+uniform vec3 clusterCount; // number of clusters on the x, y and z-axis
+uniform vec3 clusterCameraPosition;
+uniform vec3 clusterCameraRight;
+uniform vec3 clusterCameraUp;
+uniform vec3 clusterCameraBack;
+uniform vec2 clusterTan; // tangent of half the horizontal and vertical field of view
+uniform vec2 clusterDepth; // x = near plane, y = depth slices / log(far / near)
+const int LIGHT_INDICES_WIDTH = 1024; // same as LIGHT_INDICES_WIDTH in scene3.lua
 uniform vec3 ambientColor;
 
 
@@ -37,27 +46,65 @@ uniform float shadowStrength; // used to make shadows more/less intense
 uniform vec3 sunDirection;
 uniform bool shadowsEnabled = false;
 uniform sampler2DShadow shadowCanvas;
+uniform mat4 shadowCascadeMatrices[4]; // from the sun's view space to the normalized coordinates of each cascade
+uniform vec4 shadowCascadeSplits; // view depth at which each cascade ends
+uniform int shadowCascadeCount = 1;
 
 
 
 Light getLight(int index) {
 	Light light;
-	light.position = lightsInfo[index * 2].xyz;
-	light.range = lightsInfo[index * 2].w;
-	light.color = lightsInfo[index * 2 + 1].xyz;
-	light.strength = lightsInfo[index * 2 + 1].w;
+	vec4 posRange = texelFetch(lightData, ivec2(index, 0), 0);
+	vec4 colStrength = texelFetch(lightData, ivec2(index, 1), 0);
+	light.position = posRange.xyz;
+	light.range = posRange.w;
+	light.color = colStrength.xyz;
+	light.strength = colStrength.w;
 	return light;
 }
 
 
+// returns the {offset, count} of the lights in the cluster that the given world position is in. Must match Scene3:updateLightClusters()
+ivec2 getLightCluster(vec3 worldPosition) {
+	vec3 offset = worldPosition - clusterCameraPosition;
+	float depth = max(-dot(offset, clusterCameraBack), clusterDepth.x);
+	vec2 ndc = vec2(dot(offset, clusterCameraRight), dot(offset, clusterCameraUp)) / (depth * clusterTan);
+	vec3 cluster = vec3((ndc * 0.5 + 0.5) * clusterCount.xy, log(depth / clusterDepth.x) * clusterDepth.y);
+	ivec3 c = ivec3(clamp(floor(cluster), vec3(0.0), clusterCount - 1.0));
+	return ivec2(texelFetch(lightClusters, ivec2(c.x + c.y * int(clusterCount.x), c.z), 0).rg);
+}
+
+
+int getClusterLight(int index) {
+	return int(texelFetch(lightIndices, ivec2(index % LIGHT_INDICES_WIDTH, index / LIGHT_INDICES_WIDTH), 0).r);
+}
+
+
+
+// cascaded shadows: picks the cascade by the fragment's view depth and returns the fragment's coordinates in the shadow canvas
+// the cascades are placed side by side in the shadow canvas, see Scene3:setShadowCascades()
+vec3 getShadowCoords(vec4 sunViewPosition) {
+	float ndcDepth = gl_FragCoord.z * 2.0 - 1.0;
+	float viewDepth = (2.0 * 0.1 * 1000.0) / (1000.0 + 0.1 - ndcDepth * (1000.0 - 0.1)); // camera near and far plane
+	int cascade = 0;
+	while (cascade < shadowCascadeCount - 1 && viewDepth > shadowCascadeSplits[cascade]) {
+		cascade++;
+	}
+	vec3 projCoords = (shadowCascadeMatrices[cascade] * sunViewPosition).xyz * 0.5 + 0.5;
+	if (projCoords.x >= 0.0 && projCoords.x <= 1.0) {
+		projCoords.x = (projCoords.x + float(cascade)) / float(shadowCascadeCount);
+	}
+	return projCoords;
+}
+
+
 
 // https://learnopengl.com/Advanced-Lighting/Shadows/Shadow-Mapping
 // calculate shadow using sampler2DShadow, which uses bilinear filtering automatically for better shadows, but has bigger problems with shadow acne :<
 // simpler version as we don't need to care about bias since particles are never 'on' a surface
 /*
 float calculateShadow() {
-	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-	projCoords = projCoords * 0.5 + 0.5;
+	vec3 projCoords = getShadowCoords(fragPosLightSpace);
 
 	// no shadows when outside the shadow canvas
 	if (projCoords.x < 0.0 || projCoords.x > 1.0 || projCoords.y < 0.0 || projCoords.y > 1.0) {
@@ -73,8 +120,7 @@ float calculateShadow() {
 */
 
 float calculateShadow() {
-	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-	projCoords = projCoords * 0.5 + 0.5;
+	vec3 projCoords = getShadowCoords(fragPosLightSpace);
 
 	// no shadows when outside the shadow canvas
 	if (projCoords.x < 0.0 || projCoords.x > 1.0 || projCoords.y < 0.0 || projCoords.y > 1.0) {
@@ -124,8 +170,10 @@ void effect() {
 	//float totalInfluence = 0;
 
 	// add the lighting contribution of all lights to the surface
-	for (int i = 0; i < lightCount; ++i) {
-		Light light = getLight(i);
+	// only lights whose range touches the fragment's cluster are considered
+	ivec2 lightCluster = getLightCluster(fragWorldPosition);
+	for (int i = 0; i < lightCluster.y; ++i) {
+		Light light = getLight(getClusterLight(lightCluster.x + i));
 		//if (light.strength > 0) { // only consider lights with a strength above 0
 		// distance to the light
 		float distance = length(light.position - fragWorldPosition);
@@ -150,19 +198,19 @@ void effect() {
 
 	// if the particle has 'blends' set to true, start accumulating colors onto the canvas with some maths
 	// however, if the particle has 'blends' set to false, simply just draw the particle color
-	if (blends) {
-		// in this case, blend mode is set to additive and two canvases are used (vfxCanvas1, vfxCanvas2)
-		//love_Canvases[0] = vec4(litColor.r * litColor.a, litColor.g * litColor.a, litColor.b * litColor.a, 1.0); // Q: why not store alpha here? A: docs says thet blend mode 'add': The alpha of the screen is not modified, hence moved to other canvas
-		// for red, simply add '1' to red to count the number of fragments being written
-		// for green, square the alpha to give a higher priority
-		//love_Canvases[1] = vec4(1.0, litColor.a, 1.0, 1.0);
-		float weight = exp2(-(fragWorldDepth - 32.0) / blendDistance);
-		vec3 weightedColor = litColor.rgb * weight;
-		love_Canvases[0] = vec4(weightedColor, 1.0);
-		love_Canvases[1] = vec4(1.0, litColor.a, weight, 1.0);
-	} else {
-		// in this case, blend mode is set to the default (alpha) one and the output canvase is the RenderCanvas
-		love_Canvases[0] = litColor;
-	}
+#ifdef BLENDS
+	// in this case, blend mode is set to additive and two canvases are used (vfxCanvas1, vfxCanvas2)
+	//love_Canvases[0] = vec4(litColor.r * litColor.a, litColor.g * litColor.a, litColor.b * litColor.a, 1.0); // Q: why not store alpha here? A: docs says thet blend mode 'add': The alpha of the screen is not modified, hence moved to other canvas
+	// for red, simply add '1' to red to count the number of fragments being written
+	// for green, square the alpha to give a higher priority
+	//love_Canvases[1] = vec4(1.0, litColor.a, 1.0, 1.0);
+	float weight = exp2(-(fragWorldDepth - 32.0) / blendDistance);
+	vec3 weightedColor = litColor.rgb * weight;
+	love_Canvases[0] = vec4(weightedColor, 1.0);
+	love_Canvases[1] = vec4(1.0, litColor.a, weight, 1.0);
+#else
+	// in this case, blend mode is set to the default (alpha) one and the output canvase is the RenderCanvas
+	love_Canvases[0] = litColor;
+#endif
 
 }
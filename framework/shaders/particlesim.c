@@ -0,0 +1,184 @@
+#pragma language glsl3
+
+// steps the particles of an emitter that collides with the scene, see Particles3:setCollision()
+// the state of each particle (position and velocity) is stored in a pair of float canvases. Each step reads the previous pair and writes the other one
+// each step draws one point per particle, placed on the texel of that particle, with the emit data of the instance mesh of the emitter attached to it
+
+const float zNear = 0.1;
+const float zFar = 1000.0;
+
+varying vec4 spawnPosition; // xyz = position the particle was emitted at, w = time it was emitted at
+varying vec4 spawnVelocity; // xyz = velocity it was emitted with
+
+
+
+#ifdef VERTEX
+
+attribute vec3 instPosition;
+attribute float instEmittedAt;
+attribute vec3 instVelocity;
+
+
+
+vec4 position(mat4 transform_projection, vec4 vertex_position) {
+	spawnPosition = vec4(instPosition, instEmittedAt);
+	spawnVelocity = vec4(instVelocity, 0.0);
+	return transform_projection * vertex_position; // the vertex position is the center of the texel of the particle, see Particles3:setCollision()
+}
+
+#endif
+
+
+
+#ifdef PIXEL
+
+uniform Image statePositions; // xyz = position, w = time the particle in this slot was emitted at
+uniform Image stateVelocities; // xyz = velocity without gravity, w = 1 if the particle is alive, 0 if it died in a collision
+uniform float currentTime;
+uniform float deltaTime;
+uniform vec3 gravity;
+uniform float drag;
+uniform float bounciness; // how much of the velocity into the surface is kept after bouncing, between 0 and 1
+uniform vec3 stateOffset; // moves the particles that were already stepped, see Particles3:move()
+uniform mat3 stateRotation; // rotates the velocity of the particles that were already stepped, see Particles3:redirect()
+
+
+
+// HEIGHTFIELD is defined for emitters that collide with a heightfield instead of the depth canvas, see shadervariants.lua
+#ifdef HEIGHTFIELD
+
+uniform Image heightfield; // heights in the red channel
+uniform vec4 heightfieldBounds; // xy = world position of the corner at texture coordinates 0,0, zw = size in world units
+uniform vec2 heightfieldRange; // height of a value of 0 and of a value of 1
+
+
+
+float getHeight(vec2 worldXY) {
+	vec2 uv = (worldXY - heightfieldBounds.xy) / heightfieldBounds.zw;
+	return mix(heightfieldRange.x, heightfieldRange.y, Texel(heightfield, uv).r);
+}
+
+
+
+// returns true if the point is below the heightfield, with the normal of the heightfield at that point
+bool collide(vec3 point, out vec3 normal) {
+	vec2 uv = (point.xy - heightfieldBounds.xy) / heightfieldBounds.zw;
+	if (uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0 || point.z >= getHeight(point.xy)) {
+		return false;
+	}
+	float spacing = heightfieldBounds.z / float(textureSize(heightfield, 0).x);
+	normal = normalize(vec3(
+		getHeight(point.xy - vec2(spacing, 0.0)) - getHeight(point.xy + vec2(spacing, 0.0)),
+		getHeight(point.xy - vec2(0.0, spacing)) - getHeight(point.xy + vec2(0.0, spacing)),
+		2.0 * spacing
+	));
+	return true;
+}
+
+#else
+
+uniform Image depthTexture;
+uniform mat4 camMatrix;
+uniform float aspectRatio;
+uniform float fieldOfView;
+uniform float collisionThickness; // how far behind the depth buffer a particle still counts as colliding, since nothing is known about what is behind it
+
+
+
+// position in camera space of the geometry drawn at the given screen coordinates
+vec3 getViewPosition(vec2 uv) {
+	float ndcDepth = Texel(depthTexture, uv).r * 2.0 - 1.0;
+	float linearDepth = (2.0 * zNear * zFar) / (zFar + zNear - ndcDepth * (zFar - zNear));
+	float tanHalfFov = tan(fieldOfView / 2.0);
+	vec2 ndc = uv * 2.0 - 1.0;
+	return vec3(ndc.x * tanHalfFov * aspectRatio * linearDepth, ndc.y * tanHalfFov * linearDepth, -linearDepth);
+}
+
+
+
+// returns true if the point is just behind the geometry in the depth canvas, with the normal of that geometry in world space
+bool collide(vec3 point, out vec3 normal) {
+	vec3 viewPoint = (inverse(camMatrix) * vec4(point, 1.0)).xyz;
+	if (-viewPoint.z <= zNear) {
+		return false;
+	}
+
+	// project to screen space the same way the scene's shaders do
+	float tanHalfFov = tan(fieldOfView / 2.0);
+	vec2 ndc = vec2(viewPoint.x / (aspectRatio * tanHalfFov), viewPoint.y / tanHalfFov) / -viewPoint.z;
+	if (abs(ndc.x) > 1.0 || abs(ndc.y) > 1.0) {
+		return false;
+	}
+	vec2 uv = ndc * 0.5 + 0.5;
+	if (Texel(depthTexture, uv).r == 1.0) {
+		return false; // nothing was drawn here
+	}
+
+	vec3 surface = getViewPosition(uv);
+	if (viewPoint.z > surface.z || viewPoint.z < surface.z - collisionThickness) {
+		return false;
+	}
+
+	// reconstruct the normal from the neighbouring depth values
+	vec2 texelSize = 1.0 / vec2(textureSize(depthTexture, 0));
+	vec3 viewNormal = normalize(cross(getViewPosition(uv + vec2(texelSize.x, 0.0)) - surface, getViewPosition(uv + vec2(0.0, texelSize.y)) - surface));
+	if (dot(viewNormal, surface) > 0.0) {
+		viewNormal = -viewNormal; // always face the camera, since that is the side the particle came from
+	}
+	normal = normalize(mat3(camMatrix) * viewNormal);
+	return true;
+}
+
+#endif
+
+
+
+void effect() {
+	ivec2 texel = ivec2(love_PixelCoord);
+	vec4 statePosition = texelFetch(statePositions, texel, 0);
+	vec4 stateVelocity = texelFetch(stateVelocities, texel, 0);
+	float dt = deltaTime;
+
+	// a new particle was emitted into this slot since the last step, so start from its emit data and catch up to the current time
+	// the emit data already includes any moves and redirects, the state of older particles still needs them
+	if (statePosition.w != spawnPosition.w) {
+		statePosition = spawnPosition;
+		stateVelocity = vec4(spawnVelocity.xyz, 1.0);
+		dt = max(0.0, currentTime - spawnPosition.w);
+	} else {
+		statePosition.xyz += stateOffset;
+		stateVelocity.xyz = stateRotation * stateVelocity.xyz;
+	}
+
+	if (stateVelocity.w > 0.0) {
+		// same model as the particles without collision: drag only slows down the velocity the particle was emitted with (every second it is
+		// multiplied by 1/2^drag), while gravity is added on top undragged. So the state stores the dragged part and gravity * age is added here
+		// both are integrated exactly over the step, so a particle that does not collide ends up where particlesvert.c would put it
+		float age = currentTime - statePosition.w;
+		float decay = pow(2.0, -drag * dt);
+		float travel = drag > 0.0 ? (1.0 - decay) / (drag * log(2.0)) : dt;
+		vec3 nextPosition = statePosition.xyz + stateVelocity.xyz * travel + gravity * (age - 0.5 * dt) * dt;
+		stateVelocity.xyz *= decay;
+		vec3 velocity = stateVelocity.xyz + gravity * age;
+
+		vec3 normal;
+		if (collide(nextPosition, normal)) {
+// DIES is defined for emitters whose particles die when they hit something, instead of bouncing off
+#ifdef DIES
+			stateVelocity.w = 0.0;
+#else
+			float intoSurface = dot(velocity, normal);
+			if (intoSurface < 0.0) {
+				stateVelocity.xyz -= (1.0 + bounciness) * intoSurface * normal; // bounce the whole velocity, gravity included
+			}
+#endif
+			nextPosition = statePosition.xyz; // stay on the side of the surface the particle came from
+		}
+		statePosition.xyz = nextPosition;
+	}
+
+	love_Canvases[0] = statePosition;
+	love_Canvases[1] = stateVelocity;
+}
+
+#endif
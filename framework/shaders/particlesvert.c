@@ -9,7 +9,6 @@ uniform mat4 camMatrix;
 uniform float aspectRatio;
 uniform float fieldOfView;
 uniform mat4 sunWorldMatrix;
-uniform mat4 orthoMatrix;
 
 // attributes
 attribute vec3 VertexNormal;
@@ -21,6 +20,12 @@ uniform float drag;
 uniform float currentTime; // current world time, used to calculate how old an instance is
 uniform float zOffset;
 
+// SIMULATED is defined for emitters that collide with the scene, which read their positions from the state canvases instead, see particlesim.c
+#ifdef SIMULATED
+uniform Image statePositions; // xyz = position, w = time the particle was emitted at
+uniform Image stateVelocities; // xyz = velocity without gravity, w = 0 if the particle died in a collision
+uniform int stateWidth; // instance i is stored at texel (i % stateWidth, i / stateWidth)
+#endif
 
 // mesh variables
 attribute vec3 instPosition;
@@ -258,6 +263,20 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 		worldPosition = instPosition + instVelocity * (currentTime - instEmittedAt) + 0.5 * gravity * pow((currentTime - instEmittedAt), 2.0);
 	}
 
+#ifdef SIMULATED
+	// the state is only used once it belongs to this particle, i.e. once it has been stepped since the particle was emitted
+	ivec2 stateTexel = ivec2(love_InstanceID % stateWidth, love_InstanceID / stateWidth);
+	vec4 statePosition = texelFetch(statePositions, stateTexel, 0);
+	if (statePosition.w == instEmittedAt) {
+		vec4 stateVelocity = texelFetch(stateVelocities, stateTexel, 0);
+		worldPosition = statePosition.xyz;
+		worldVelocity = stateVelocity.xyz + gravity * (currentTime - instEmittedAt);
+		if (stateVelocity.w == 0.0) {
+			size = 0.0; // died in a collision
+		}
+	}
+#endif
+
 	worldPosition = worldPosition + normalize(cameraWorldMatrix[3].xyz - worldPosition) * zOffset;
 
 	
@@ -299,7 +318,7 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 	fragWorldNormal = normalize((rotationMatrix * scaleMatrix * vec4(VertexNormal, 0.0)).xyz);
 
 	mat4 sunViewMatrix = inverse(sunWorldMatrix);
-	fragPosLightSpace = orthoMatrix * sunViewMatrix * vec4(fragWorldPosition, 1.0);
+	fragPosLightSpace = sunViewMatrix * vec4(fragWorldPosition, 1.0); // the projection of the shadow cascade is applied in the fragment shader
 
 
 	return result;
@@ -33,6 +33,9 @@ uniform vec3 foamColor; // xyz = color
 uniform vec3 foamColorShadow;
 uniform float foamInShadow;
 uniform sampler2DShadow shadowCanvas; // use Image when doing 'basic' sampling. Use sampler2DShadow when you want automatic bilinear filtering (but more prone to shadow acne :<)
+uniform mat4 shadowCascadeMatrices[4]; // from the sun's view space to the normalized coordinates of each cascade
+uniform vec4 shadowCascadeSplits; // view depth at which each cascade ends
+uniform int shadowCascadeCount = 1;
 uniform vec4 waterVelocity; // x&y = water velocity, z&w = distortion velocity
 uniform vec4 foamVelocity; // two directions & speeds at which the foams move
 
@@ -40,12 +43,29 @@ uniform vec4 foamVelocity; // two directions & speeds at which the foams move
 
 
 
+// cascaded shadows: picks the cascade by the fragment's view depth and returns the fragment's coordinates in the shadow canvas
+// the cascades are placed side by side in the shadow canvas, see Scene3:setShadowCascades()
+vec3 getShadowCoords(vec4 sunViewPosition) {
+	float ndcDepth = gl_FragCoord.z * 2.0 - 1.0;
+	float viewDepth = (2.0 * 0.1 * 1000.0) / (1000.0 + 0.1 - ndcDepth * (1000.0 - 0.1)); // camera near and far plane
+	int cascade = 0;
+	while (cascade < shadowCascadeCount - 1 && viewDepth > shadowCascadeSplits[cascade]) {
+		cascade++;
+	}
+	vec3 projCoords = (shadowCascadeMatrices[cascade] * sunViewPosition).xyz * 0.5 + 0.5;
+	if (projCoords.x >= 0.0 && projCoords.x <= 1.0) {
+		projCoords.x = (projCoords.x + float(cascade)) / float(shadowCascadeCount);
+	}
+	return projCoords;
+}
+
+
+
 // https://learnopengl.com/Advanced-Lighting/Shadows/Shadow-Mapping
 // calculate shadow using sampler2DShadow, which uses bilinear filtering automatically for better shadows, but has bigger problems with shadow acne :<
 
 float calculateShadow(vec4 fragPosLightSpace, vec3 surfaceNormalWorld) {
-	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-	projCoords = projCoords * 0.5 + 0.5;
+	vec3 projCoords = getShadowCoords(fragPosLightSpace);
 
 	// no shadows when outside the shadow canvas
 	if (projCoords.x < 0.0 || projCoords.x > 1.0 || projCoords.y < 0.0 || projCoords.y > 1.0) {
@@ -152,5 +172,10 @@ void effect() {
 	// apply bloom to canvas
 	// this is canvas 2 because 1 is the canvas with view-space normals, but we don't use it (but it's still here because un-setting it takes time)
 	love_Canvases[2] = vec4(texColor.x * meshBloom, texColor.y * meshBloom, texColor.z * meshBloom, 1.0);
+
+	// ripple meshes are not lit by point lights, so they leave no surface color for the deferred light pass to add onto
+	// both canvases are only bound when deferred lights are enabled, but have to be written whenever they are
+	love_Canvases[3] = vec4(0.0, 0.0, 0.0, 1.0);
+	love_Canvases[4] = vec4(fragWorldNormal * 0.5 + 0.5, 1.0);
 	
 }
\ No newline at end of file
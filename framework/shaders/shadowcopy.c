@@ -0,0 +1,13 @@
+#pragma language glsl3
+
+// copies the cached depth of the static shadow casters into the shadow canvas, so that only the other casters have to be drawn on top
+// see Scene3:setShadowCache()
+
+uniform Image cachedDepth;
+
+
+
+// this shader only outputs to the depthstencil
+void effect() {
+	gl_FragDepth = texelFetch(cachedDepth, ivec2(floor(love_PixelCoord.xy)), 0).r;
+}
@@ -16,7 +16,7 @@ attribute vec4 instMatColumn2;
 attribute vec4 instMatColumn3;
 attribute vec4 instMatColumn4;
 
-uniform bool isInstanced;
+// INSTANCED is defined for the variant that draws instanced meshes, see shadervariants.lua
 
 
 // rotate around X-axis
@@ -90,19 +90,19 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 	mat4 modelWorldMatrix;
 
 	// get the scale matrix, then the rotation matrix in XYZ order, then the translation matrix
-	if (isInstanced) {
-		// for instanced meshes, use the instance position/rotation/scale uniforms
-		//scaleMatrix = getScaleMatrix(instanceScale);
-		//rotationMatrix = getRotationMatrixZ(instanceRotation.z) * getRotationMatrixY(instanceRotation.y) * getRotationMatrixX(instanceRotation.x);
-		//translationMatrix = getTranslationMatrix(instancePosition);
-		modelWorldMatrix = mat4(instMatColumn1, instMatColumn2, instMatColumn3, instMatColumn4);
-	} else {
-		// for regular meshes, use the mesh position/rotation/scale variables
-		//scaleMatrix = getScaleMatrix(meshScale);
-		//rotationMatrix = getRotationMatrixZ(meshRotation.z) * getRotationMatrixY(meshRotation.y) * getRotationMatrixX(meshRotation.x);
-		//translationMatrix = getTranslationMatrix(meshPosition);
-		modelWorldMatrix = meshMatrix;
-	}
+#ifdef INSTANCED
+	// for instanced meshes, use the instance position/rotation/scale uniforms
+	//scaleMatrix = getScaleMatrix(instanceScale);
+	//rotationMatrix = getRotationMatrixZ(instanceRotation.z) * getRotationMatrixY(instanceRotation.y) * getRotationMatrixX(instanceRotation.x);
+	//translationMatrix = getTranslationMatrix(instancePosition);
+	modelWorldMatrix = mat4(instMatColumn1, instMatColumn2, instMatColumn3, instMatColumn4);
+#else
+	// for regular meshes, use the mesh position/rotation/scale variables
+	//scaleMatrix = getScaleMatrix(meshScale);
+	//rotationMatrix = getRotationMatrixZ(meshRotation.z) * getRotationMatrixY(meshRotation.y) * getRotationMatrixX(meshRotation.x);
+	//translationMatrix = getTranslationMatrix(meshPosition);
+	modelWorldMatrix = meshMatrix;
+#endif
 
 	//mat4 modelWorldMatrix = translationMatrix * rotationMatrix * scaleMatrix;
 	mat4 viewMatrix = inverse(sunWorldMatrix);
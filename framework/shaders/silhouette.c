@@ -25,7 +25,7 @@ attribute vec4 instMatColumn2;
 attribute vec4 instMatColumn3;
 attribute vec4 instMatColumn4;
 
-uniform bool isInstanced;
+// INSTANCED is defined for the variant that draws instanced meshes, see shadervariants.lua
 
 
 
@@ -54,19 +54,19 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 	mat4 modelWorldMatrix;
 
 	// get the scale matrix, then the rotation matrix in XYZ order, then the translation matrix
-	if (isInstanced) {
-		// for instanced meshes, use the instance position/rotation/scale uniforms
-		//scaleMatrix = getScaleMatrix(instanceScale);
-		//rotationMatrix = getRotationMatrixZ(instanceRotation.z) * getRotationMatrixY(instanceRotation.y) * getRotationMatrixX(instanceRotation.x);
-		//translationMatrix = getTranslationMatrix(instancePosition);
-		modelWorldMatrix = mat4(instMatColumn1, instMatColumn2, instMatColumn3, instMatColumn4);
-	} else {
-		// for regular meshes, use the mesh position/rotation/scale variables
-		//scaleMatrix = getScaleMatrix(meshScale);
-		//rotationMatrix = getRotationMatrixZ(meshRotation.z) * getRotationMatrixY(meshRotation.y) * getRotationMatrixX(meshRotation.x);
-		//translationMatrix = getTranslationMatrix(meshPosition);
-		modelWorldMatrix = meshMatrix;
-	}
+#ifdef INSTANCED
+	// for instanced meshes, use the instance position/rotation/scale uniforms
+	//scaleMatrix = getScaleMatrix(instanceScale);
+	//rotationMatrix = getRotationMatrixZ(instanceRotation.z) * getRotationMatrixY(instanceRotation.y) * getRotationMatrixX(instanceRotation.x);
+	//translationMatrix = getTranslationMatrix(instancePosition);
+	modelWorldMatrix = mat4(instMatColumn1, instMatColumn2, instMatColumn3, instMatColumn4);
+#else
+	// for regular meshes, use the mesh position/rotation/scale variables
+	//scaleMatrix = getScaleMatrix(meshScale);
+	//rotationMatrix = getRotationMatrixZ(meshRotation.z) * getRotationMatrixY(meshRotation.y) * getRotationMatrixX(meshRotation.x);
+	//translationMatrix = getTranslationMatrix(meshPosition);
+	modelWorldMatrix = meshMatrix;
+#endif
 
 
 	// construct the model's world matrix, i.e. where in the world is each vertex of this mesh located
@@ -101,17 +101,17 @@ uniform vec4 silhouetteColor;
 // sprites
 uniform vec2 spritePosition;
 uniform vec2 spriteSheetSize;
-uniform bool isSpriteSheet;
+// SPRITESHEET is defined for the variant that draws sprite meshes, see shadervariants.lua
 
 
 vec4 effect(vec4 color, Image tex, vec2 texture_coords, vec2 screen_coords) {
 
 	vec2 coords;
-	if (isSpriteSheet) {
-		coords = texture_coords.xy / spriteSheetSize + spritePosition / spriteSheetSize;
-	} else {
-		coords = texture_coords.xy;
-	}
+#ifdef SPRITESHEET
+	coords = texture_coords.xy / spriteSheetSize + spritePosition / spriteSheetSize;
+#else
+	coords = texture_coords.xy;
+#endif
 	vec4 texColor = Texel(tex, coords);
 	if (texColor.a < 0.01) {
 		discard;
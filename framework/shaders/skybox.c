@@ -41,7 +41,8 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 	mat4 viewMatrix = mat4(mat3(inverse(camMatrix)));
 
 	vec4 result = projectionMatrix * viewMatrix * vec4(vertex_position.xyz, 1.0);
-	return result;
+	// place the skybox at the far plane, so that it fails the depth test wherever geometry was drawn
+	return result.xyww;
 }
 
 
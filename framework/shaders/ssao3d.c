@@ -10,6 +10,7 @@ uniform float kernelScalar;
 uniform int samples; // higher samples = less noisy ambient occlusion
 
 uniform Image noiseTexture; // assumed to be a 16x16 noise texture where r,g,b = x,y,z normal vector with z>0
+uniform vec2 noiseOffset; // changes every frame when ambient occlusion is accumulated over multiple frames, so that each frame samples different directions
 
 const float rangeCheckScalar = 20.0; // larger value == need to zoom out further for AO to fade away
 
@@ -91,7 +92,7 @@ float calculateOcclusion(vec3 fragmentPos, vec3 normal, vec2 texCoord, Image dep
 		float(love_PixelCoord.y) / 8.0
 	);
 
-	float sampledRotation = Texel(noiseTexture, noiseSamplePosition).r * 6.283; // sample a rotation for this pixel from the noise texture
+	float sampledRotation = Texel(noiseTexture, noiseSamplePosition + noiseOffset).r * 6.283; // sample a rotation for this pixel from the noise texture
 	float cosAngle = cos(sampledRotation);
 	float sinAngle = sin(sampledRotation);
 
@@ -5,15 +5,15 @@
 
 // coloring
 uniform vec3 ambientColor;
-uniform float meshBrightness;
-uniform vec4 meshColor;
+varying vec4 trailColor;
+varying float trailBrightness;
 
 // textures
 uniform Image meshTexture;
 
 varying vec2 texCoords;
 varying float fragWorldDepth;
-uniform bool blends;
+// BLENDS is defined for the variant that draws blending vfx into the vfx canvases, see shadervariants.lua
 uniform float blendDistance = 1.0; // how many world units two vfx fragments need to be apart for the further one to have half the weight of the closer one
 
 
@@ -24,7 +24,7 @@ uniform float blendDistance = 1.0; // how many world units two vfx fragments nee
 void effect() {
 
 	vec4 color = VaryingColor;
-	color = vec4(color.x * meshColor.x, color.y * meshColor.y, color.z * meshColor.z, color.w * meshColor.w);
+	color = vec4(color.x * trailColor.x, color.y * trailColor.y, color.z * trailColor.z, color.w * trailColor.w);
 	
 	
 	if (love_PixelCoord.x < 0 || love_PixelCoord.x > love_ScreenSize.x || love_PixelCoord.y < 0 || love_PixelCoord.y > love_ScreenSize.y) {
@@ -50,27 +50,27 @@ void effect() {
 	
 	//set the color on the main canvas. Apply mesh brightness here as well. Higher brightness means less affected by ambient color
 	vec4 resultingColor = texColor * color; // mix color towards fresnel color
-	vec4 resultingLighting = mix(vec4(lighting.xyz, 1.0), vec4(1.0, 1.0, 1.0, 1.0), meshBrightness); // mix lighting based on mesh brightness
+	vec4 resultingLighting = mix(vec4(lighting.xyz, 1.0), vec4(1.0, 1.0, 1.0, 1.0), trailBrightness); // mix lighting based on mesh brightness
 	vec4 litColor = resultingColor * resultingLighting;
 
 
 	
 	//love_Canvases[0] = resultingColor;
 
-	if (blends) {
-		// in this case, blend mode is set to additive and two canvases are used (vfxCanvas1, vfxCanvas2)
-		//love_Canvases[0] = vec4(litColor.r * litColor.a, litColor.g * litColor.a, litColor.b * litColor.a, 1.0);
-		// for red, simply add '1' to red to count the number of fragments being written
-		// for green, square the alpha to give a higher priority
-		//love_Canvases[1] = vec4(1.0, litColor.a, 1.0, 1.0);
-		float weight = exp2(-(fragWorldDepth - 32.0) / blendDistance);
-		vec3 weightedColor = litColor.rgb * weight;
-		love_Canvases[0] = vec4(weightedColor, 1.0);
-		love_Canvases[1] = vec4(1.0, litColor.a, weight, 1.0);
-	} else {
-		// in this case, blend mode is set to the default (alpha) one and the output canvase is the RenderCanvas
-		love_Canvases[0] = litColor;
-	}
+#ifdef BLENDS
+	// in this case, blend mode is set to additive and two canvases are used (vfxCanvas1, vfxCanvas2)
+	//love_Canvases[0] = vec4(litColor.r * litColor.a, litColor.g * litColor.a, litColor.b * litColor.a, 1.0);
+	// for red, simply add '1' to red to count the number of fragments being written
+	// for green, square the alpha to give a higher priority
+	//love_Canvases[1] = vec4(1.0, litColor.a, 1.0, 1.0);
+	float weight = exp2(-(fragWorldDepth - 32.0) / blendDistance);
+	vec3 weightedColor = litColor.rgb * weight;
+	love_Canvases[0] = vec4(weightedColor, 1.0);
+	love_Canvases[1] = vec4(1.0, litColor.a, weight, 1.0);
+#else
+	// in this case, blend mode is set to the default (alpha) one and the output canvase is the RenderCanvas
+	love_Canvases[0] = litColor;
+#endif
 
 }
 
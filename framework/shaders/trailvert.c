@@ -13,14 +13,17 @@ const vec3 UP_DIRECTION = vec3(0.0, 0.0, 1.0);
 const vec3 FRONT_DIRECTION = vec3(0.0, 1.0, 0.0);
 
 
-const int MAX_POINTS = 15;
-uniform vec3 bezierPoints[MAX_POINTS]; // buffer that stores points in the bezier curve in order (not all indices may be in use!)
-uniform int pointCount; // how many points the supplied bezier contains, thus how many to sample from the above variable
-uniform float age; // how many seconds ago the trail got emitted
-uniform bool facesCamera;
-uniform Image dataTexture;
-uniform float duration;
-uniform float length;
+// the paths of all trails in the scene are sampled on the CPU and stored in this texture, two rows per trail
+// the first row holds the position (rgb) and width (a) of each sample, the second row holds the direction of the path (rgb)
+const int PATH_SAMPLES = 64; // same as PATH_SAMPLES in trail3.lua
+uniform Image trailPaths;
+
+// per-instance variables, all trails with the same texture are drawn at once
+attribute vec4 TrailTiming; // how many seconds ago the trail got emitted, duration, length, first row of the path in trailPaths
+attribute vec4 TrailColor;
+attribute vec2 TrailStyle; // brightness, faces camera (0 or 1)
+varying vec4 trailColor;
+varying float trailBrightness;
 varying vec2 texCoords;
 varying float fragWorldDepth;
 
@@ -43,42 +46,17 @@ mat4 getPerspectiveMatrix(float fieldOfView, float aspect) {
 
 
 
-vec3 deCasteljeau(in vec3 points[MAX_POINTS], int n, float x) {
-	vec3 tempPoints[MAX_POINTS];
-	for (int i = 0; i < n; i++) {
-		tempPoints[i] = points[i];
-	}
-	// interpolate. First go over all segments, then segments minus one, minus two etc.
-	for (int a = 1; a < n; a++) {
-		for (int b = 0; b < n - a; b++) {
-			tempPoints[b] = mix(tempPoints[b], tempPoints[b + 1], x);
-		}
-	}
-	return tempPoints[0];
-}
-
-
-
-vec3 getDirectionAt(float x) {
-	int n = pointCount - 1;
-	vec3 derivatives[MAX_POINTS];
-	for (int i = 0; i < n; i++) {
-		derivatives[i] = (bezierPoints[i + 1] - bezierPoints[i]) * float(n);
-	}
-
-	return normalize(deCasteljeau(derivatives, n, x));
-}
-
-
-
-vec3 getPositionAt(float x) {
-	return deCasteljeau(bezierPoints, pointCount, x);
+// linearly interpolates between the two samples of a row that surround 'x'
+vec4 samplePath(int row, float x) {
+	float s = x * float(PATH_SAMPLES - 1);
+	int i = min(int(s), PATH_SAMPLES - 2);
+	return mix(texelFetch(trailPaths, ivec2(i, row), 0), texelFetch(trailPaths, ivec2(i + 1, row), 0), s - float(i));
 }
 
 
 
 // calculates offset to the left
-vec3 calculateOffset(vec3 direction, float width) {
+vec3 calculateOffset(vec3 direction, float width, bool facesCamera) {
 	vec3 right;
 
 	if (!facesCamera) {
@@ -101,15 +79,6 @@ vec3 calculateOffset(vec3 direction, float width) {
 
 
 
-// width curve decoding
-// number curves are stored across two channels (r & g or b & a) to ensure enough bit precision. This does mean we need more work to extract that information
-float decodeFromChannels(float high, float low) {
-	return high + (low / 256.0); // combine high and low channels
-}
-
-
-
-
 vec4 position(mat4 transform_projection, vec4 vertex_position) {
 
 	mat4 cameraWorldMatrix = camMatrix;
@@ -119,6 +88,13 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 
 	texCoords = vertex_position.xy;
 
+	float age = TrailTiming.x;
+	float duration = TrailTiming.y;
+	float length = TrailTiming.z;
+	int row = int(TrailTiming.w);
+	trailColor = TrailColor;
+	trailBrightness = TrailStyle.x;
+
 	// where on the curve the start and end of the mesh are positioned
 	float x1 = age / duration;
 	float x0 = (age - length) / duration;
@@ -127,15 +103,12 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 	float x = mix(x0, x1, vertex_position.x);
 	x = max(0.0, min(1.0, x));
 
-	// decode width
-	vec4 data = Texel(dataTexture, vec2(x, 0.5));
-	float width = decodeFromChannels(data.r, data.g) * 64.0; // remap from 0-1 to 0-64
-
-
-	vec3 direction = getDirectionAt(x);
-	vec3 curvePosition = getPositionAt(x);
+	vec4 pathSample = samplePath(row, x);
+	vec3 curvePosition = pathSample.xyz;
+	float width = pathSample.w;
+	vec3 direction = normalize(samplePath(row + 1, x).xyz);
 
-	vec3 offsetRight = calculateOffset(direction, width);
+	vec3 offsetRight = calculateOffset(direction, width, TrailStyle.y > 0.5);
 	vec3 left = curvePosition - offsetRight;
 	vec3 right = curvePosition + offsetRight;
 
@@ -22,8 +22,18 @@ struct Light {
 	float range;
 	float strength;
 };
-uniform vec4 lightsInfo[16 * 2]; // array where each even index is {posX, posY, posZ, range} and each uneven index is {colR, colG, colB, strength}
-uniform int lightCount;
+uniform Image lightData; // 2 rows, first row is {posX, posY, posZ, range} and second row is {colR, colG, colB, strength} of each light
+uniform Image lightClusters; // {offset, count} into lightIndices for each cluster. x = tile x + tile y * tiles on the x-axis, y = depth slice
+uniform Image lightIndices; // indices into lightData of the lights that touch each cluster, packed together
+uniform vec3 clusterCount; // number of clusters on the x, y and z-axis
+uniform vec3 clusterCameraPosition;
+uniform vec3 clusterCameraRight;
+uniform vec3 clusterCameraUp;
+uniform vec3 clusterCameraBack;
+uniform vec2 clusterTan; // tangent of half the horizontal and vertical field of view
+uniform vec2 clusterDepth; // x = near plane, y = depth slices / log(far / near)
+const int LIGHT_INDICES_WIDTH = 1024; // same as LIGHT_INDICES_WIDTH in scene3.lua
+uniform bool lightsDeferred = false; // if true, point lights are added later in the deferred light pass, see Scene3:applyDeferredLights()
 uniform vec3 ambientColor;
 
 // blob shadows
@@ -50,11 +60,13 @@ uniform vec3 meshFresnelColor; // vec3 since fresnel won't be supporting transpa
 varying vec3 instColor;
 varying vec3 instColorShadow;
 
-uniform bool isInstanced;
+// INSTANCED is defined for the variant that draws instanced meshes, see shadervariants.lua
 
-// masking
-uniform float masked;
-uniform Image maskCanvas; // r16
+// masked meshes are not drawn where a mask wrote to the stencil buffer, which is set up before drawing in scene3.lua
+
+// level-of-detail cross-fade, see Mesh3:updateLOD()
+uniform float lodDither = 0.0; // 0 = no fade, >0 = fading out by that amount, <0 = fading in by that amount
+uniform Image ditherTexture; // same ordered-dither pattern the masks use
 
 // triplanar texture projection variables
 //uniform float triplanarScale;
@@ -64,6 +76,9 @@ uniform Image MainTex; // used to be the 'tex' argument, but is now passed separ
 uniform Image meshTexture; // replaces MainTex. Instead of using mesh:setTexture(), they are now passed separately so that a mesh can be reused with different textures on them
 uniform Image normalMap;
 uniform sampler2DShadow shadowCanvas; // use Image when doing 'basic' sampling. Use sampler2DShadow when you want automatic bilinear filtering (but more prone to shadow acne :<)
+uniform mat4 shadowCascadeMatrices[4]; // from the sun's view space to the normalized coordinates of each cascade
+uniform vec4 shadowCascadeSplits; // view depth at which each cascade ends
+uniform int shadowCascadeCount = 1;
 uniform CubeImage skyboxImage;
 varying vec2 texture_coords;
 
@@ -74,19 +89,54 @@ varying vec2 texture_coords;
 
 Light getLight(int index) {
 	Light light;
-	light.position = lightsInfo[index * 2].xyz;
-	light.range = lightsInfo[index * 2].w;
-	light.color = lightsInfo[index * 2 + 1].xyz;
-	light.strength = lightsInfo[index * 2 + 1].w;
+	vec4 posRange = texelFetch(lightData, ivec2(index, 0), 0);
+	vec4 colStrength = texelFetch(lightData, ivec2(index, 1), 0);
+	light.position = posRange.xyz;
+	light.range = posRange.w;
+	light.color = colStrength.xyz;
+	light.strength = colStrength.w;
 	return light;
 }
 
 
+// returns the {offset, count} of the lights in the cluster that the given world position is in. Must match Scene3:updateLightClusters()
+ivec2 getLightCluster(vec3 worldPosition) {
+	vec3 offset = worldPosition - clusterCameraPosition;
+	float depth = max(-dot(offset, clusterCameraBack), clusterDepth.x);
+	vec2 ndc = vec2(dot(offset, clusterCameraRight), dot(offset, clusterCameraUp)) / (depth * clusterTan);
+	vec3 cluster = vec3((ndc * 0.5 + 0.5) * clusterCount.xy, log(depth / clusterDepth.x) * clusterDepth.y);
+	ivec3 c = ivec3(clamp(floor(cluster), vec3(0.0), clusterCount - 1.0));
+	return ivec2(texelFetch(lightClusters, ivec2(c.x + c.y * int(clusterCount.x), c.z), 0).rg);
+}
+
+
+int getClusterLight(int index) {
+	return int(texelFetch(lightIndices, ivec2(index % LIGHT_INDICES_WIDTH, index / LIGHT_INDICES_WIDTH), 0).r);
+}
+
+
+// cascaded shadows: picks the cascade by the fragment's view depth and returns the fragment's coordinates in the shadow canvas
+// the cascades are placed side by side in the shadow canvas, see Scene3:setShadowCascades()
+vec3 getShadowCoords(vec4 sunViewPosition) {
+	float ndcDepth = gl_FragCoord.z * 2.0 - 1.0;
+	float viewDepth = (2.0 * 0.1 * 1000.0) / (1000.0 + 0.1 - ndcDepth * (1000.0 - 0.1)); // camera near and far plane
+	int cascade = 0;
+	while (cascade < shadowCascadeCount - 1 && viewDepth > shadowCascadeSplits[cascade]) {
+		cascade++;
+	}
+	vec3 projCoords = (shadowCascadeMatrices[cascade] * sunViewPosition).xyz * 0.5 + 0.5;
+	if (projCoords.x >= 0.0 && projCoords.x <= 1.0) {
+		projCoords.x = (projCoords.x + float(cascade)) / float(shadowCascadeCount);
+	}
+	return projCoords;
+}
+
+
+
 // https://learnopengl.com/Advanced-Lighting/Shadows/Shadow-Mapping
 // calculate shadow using sampler2DShadow, which uses bilinear filtering automatically for better shadows, but has bigger problems with shadow acne :<
 float calculateShadow(vec4 fragPosLightSpace, vec3 surfaceNormalWorld) {
-	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-	projCoords = projCoords * 0.5 + 0.5;
+	vec3 projCoords = getShadowCoords(fragPosLightSpace);
 
 	// no shadows when outside the shadow canvas
 	if (projCoords.x < 0.0 || projCoords.x > 1.0 || projCoords.y < 0.0 || projCoords.y > 1.0) {
@@ -124,22 +174,24 @@ float calculateShadow(vec4 fragPosLightSpace, vec3 surfaceNormalWorld) {
 
 
 void effect() {
-	// apply masking
-	vec2 screen_fraction = vec2(love_PixelCoord.x / love_ScreenSize.x, love_PixelCoord.y / love_ScreenSize.y);
-	if (Texel(maskCanvas, screen_fraction).r > 1.0 - masked) {
-		discard;
+	// dithered cross-fade between two levels of detail. Both levels use the same pattern with opposite signs so together they cover every pixel once
+	if (lodDither != 0.0) {
+		float ditherThreshold = Texel(ditherTexture, love_PixelCoord.xy / 16.0).r;
+		if ((lodDither > 0.0) == (ditherThreshold < abs(lodDither))) {
+			discard;
+		}
 	}
 
 	// argument 'color' doesn't exist when using multiple canvases, so use built-in VaryingColor
 	vec4 color;
 	vec4 shadowColor;
-	if (isInstanced) {
-		color = vec4(VaryingColor.x * instColor.x, VaryingColor.y * instColor.y, VaryingColor.z * instColor.z, VaryingColor.w);
-		shadowColor = vec4(VaryingColor.x * instColorShadow.x, VaryingColor.y * instColorShadow.y, VaryingColor.z * instColorShadow.z, VaryingColor.w);
-	} else {
-		color = vec4(VaryingColor.x * meshColor.x, VaryingColor.y * meshColor.y, VaryingColor.z * meshColor.z, VaryingColor.w);
-		shadowColor = vec4(VaryingColor.x * meshColorShadow.x, VaryingColor.y * meshColorShadow.y, VaryingColor.z * meshColorShadow.z, VaryingColor.w);
-	}
+#ifdef INSTANCED
+	color = vec4(VaryingColor.x * instColor.x, VaryingColor.y * instColor.y, VaryingColor.z * instColor.z, VaryingColor.w);
+	shadowColor = vec4(VaryingColor.x * instColorShadow.x, VaryingColor.y * instColorShadow.y, VaryingColor.z * instColorShadow.z, VaryingColor.w);
+#else
+	color = vec4(VaryingColor.x * meshColor.x, VaryingColor.y * meshColor.y, VaryingColor.z * meshColor.z, VaryingColor.w);
+	shadowColor = vec4(VaryingColor.x * meshColorShadow.x, VaryingColor.y * meshColorShadow.y, VaryingColor.z * meshColorShadow.z, VaryingColor.w);
+#endif
 	
 	
 	if (love_PixelCoord.x < 0 || love_PixelCoord.x > love_ScreenSize.x || love_PixelCoord.y < 0 || love_PixelCoord.y > love_ScreenSize.y) {
@@ -185,8 +237,10 @@ void effect() {
 	vec3 lighting = ambientColor; // start with just ambient lighting on the surface
 
 	// add the lighting contribution of all lights to the surface
-	for (int i = 0; i < lightCount; ++i) { // reducing lights from 16 to 1 will only really improve FPS from 235 to 245, so having 16 lights is fine
-		Light light = getLight(i);
+	// only lights whose range touches the fragment's cluster are considered
+	ivec2 lightCluster = lightsDeferred ? ivec2(0) : getLightCluster(fragWorldPosition);
+	for (int i = 0; i < lightCluster.y; ++i) {
+		Light light = getLight(getClusterLight(lightCluster.x + i));
 		
 		vec3 lightDir = normalize(light.position - fragWorldPosition);
 		float distance = length(light.position - fragWorldPosition);
@@ -227,9 +281,21 @@ void effect() {
 	//set the color on the main canvas. Apply mesh brightness here as well. Higher brightness means less affected by ambient color
 	vec4 resultingColor = mix(mix(texColor, skyboxColor, meshReflectance) * objectColor, vec4(meshFresnelColor, 1.0), fresnel); // mix color towards fresnel color
 	vec4 resultingLighting = mix(vec4(lighting.xyz, 1.0), vec4(1.0, 1.0, 1.0, 1.0), meshBrightness); // mix lighting based on mesh brightness
+	vec3 surfaceColor = resultingColor.rgb * (1.0 - meshBrightness); // used by deferred lights, which add onto the surface color
 	resultingColor = resultingColor * resultingLighting;
 
 
+#ifdef OIT
+	// OIT is defined for the variant that draws semi-transparent meshes with weighted blended order-independent transparency, see Scene3:setOrderIndependentTransparency()
+	// all canvases are blended additively. The first canvas sums the weighted colors, the second sums the weights and -log(1 - alpha), which adds up
+	// to -log of the product of (1 - alpha), i.e. how much of the background is still visible
+	float alpha = resultingColor.a;
+	float viewDepth = 1.0 / gl_FragCoord.w;
+	float weight = alpha * clamp(10.0 / (1e-5 + pow(viewDepth / 5.0, 2.0) + pow(viewDepth / 200.0, 6.0)), 1e-2, 3e3);
+	love_Canvases[0] = vec4(resultingColor.rgb * weight, 1.0);
+	love_Canvases[1] = vec4(weight, -log(max(1.0 - alpha, 1e-4)), 0.0, 1.0);
+	love_Canvases[2] = vec4(color.x * meshBloom * alpha, color.y * meshBloom * alpha, color.z * meshBloom * alpha, 1.0);
+#else
 	// debug normal maps. This shows fragment normals in world-space
 	//resultingColor = resultingColor * 0.00001 + vec4((normalMapNormalWorld.xyz + vec3(1.0)) / 2.0, 1.0);
 	love_Canvases[0] = resultingColor;
@@ -238,6 +304,10 @@ void effect() {
 
 	// apply bloom to canvas. Semi-transparent meshes will emit weaker bloom
 	love_Canvases[2] = vec4(color.x * meshBloom, color.y * meshBloom, color.z * meshBloom, 1.0 - meshTransparency);
+
+	love_Canvases[3] = vec4(surfaceColor, 1.0); // this and the shading normal are only bound when deferred lights are enabled
+	love_Canvases[4] = vec4(normalMapNormalWorld * 0.5 + 0.5, 1.0);
+#endif
 	
 
 }
@@ -6,7 +6,6 @@ uniform mat4 camMatrix;
 uniform float aspectRatio;
 uniform float fieldOfView;
 uniform mat4 sunWorldMatrix;
-uniform mat4 orthoMatrix;
 
 // attributes
 attribute vec3 VertexNormal;
@@ -35,7 +34,7 @@ attribute vec3 instanceColor;
 attribute vec3 instanceColorShadow;
 varying vec3 instColor;
 varying vec3 instColorShadow;
-uniform bool isInstanced;
+// INSTANCED is defined for the variant that draws instanced meshes, see shadervariants.lua
 
 varying vec3 fragWorldPosition; // output automatically interpolated fragment world position
 varying vec3 fragViewNormal; // used for normal map for SSAO (in screen space)
@@ -144,26 +143,26 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 	mat4 modelWorldMatrix;
 
 	// get the scale matrix, then the rotation matrix in XYZ order, then the translation matrix
-	if (isInstanced) {
-		// for instanced meshes, use the instance position/rotation/scale uniforms
-		/*
-		scaleMatrix = getScaleMatrix(instanceScale);
-		rotationMatrix = getRotationMatrixZ(instanceRotation.z) * getRotationMatrixY(instanceRotation.y) * getRotationMatrixX(instanceRotation.x);
-		translationMatrix = getTranslationMatrix(instancePosition);
-		*/
-		instColor = instanceColor; // pass color attribute from vertex shader to the fragment shader since the fragment shader doesn't support attributes for some reason?
-		instColorShadow = instanceColorShadow;
-
-		modelWorldMatrix = mat4(instMatColumn1, instMatColumn2, instMatColumn3, instMatColumn4);
-	} else {
-		// for regular meshes, use the mesh position/rotation/scale variables
-		/*
-		scaleMatrix = getScaleMatrix(meshScale);
-		rotationMatrix = getRotationMatrixZ(meshRotation.z) * getRotationMatrixY(meshRotation.y) * getRotationMatrixX(meshRotation.x);
-		translationMatrix = getTranslationMatrix(meshPosition);
-		*/
-		modelWorldMatrix = meshMatrix;
-	}
+#ifdef INSTANCED
+	// for instanced meshes, use the instance position/rotation/scale uniforms
+	/*
+	scaleMatrix = getScaleMatrix(instanceScale);
+	rotationMatrix = getRotationMatrixZ(instanceRotation.z) * getRotationMatrixY(instanceRotation.y) * getRotationMatrixX(instanceRotation.x);
+	translationMatrix = getTranslationMatrix(instancePosition);
+	*/
+	instColor = instanceColor; // pass color attribute from vertex shader to the fragment shader since the fragment shader doesn't support attributes for some reason?
+	instColorShadow = instanceColorShadow;
+
+	modelWorldMatrix = mat4(instMatColumn1, instMatColumn2, instMatColumn3, instMatColumn4);
+#else
+	// for regular meshes, use the mesh position/rotation/scale variables
+	/*
+	scaleMatrix = getScaleMatrix(meshScale);
+	rotationMatrix = getRotationMatrixZ(meshRotation.z) * getRotationMatrixY(meshRotation.y) * getRotationMatrixX(meshRotation.x);
+	translationMatrix = getTranslationMatrix(meshPosition);
+	*/
+	modelWorldMatrix = meshMatrix;
+#endif
 
 
 	// construct the model's world matrix, i.e. where in the world is each vertex of this mesh located
@@ -242,7 +241,7 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 	
 
 	mat4 sunViewMatrix = inverse(sunWorldMatrix);
-	fragPosLightSpace = orthoMatrix * sunViewMatrix * vec4(fragWorldPosition, 1.0);
+	fragPosLightSpace = sunViewMatrix * vec4(fragWorldPosition, 1.0); // the projection of the shadow cascade is applied in the fragment shader
 
 
 
@@ -17,7 +17,7 @@ attribute vec4 instMatColumn3;
 attribute vec4 instMatColumn4;
 
 
-uniform bool isInstanced;
+// INSTANCED is defined for the variant that draws instanced meshes, see shadervariants.lua
 
 
 
@@ -41,11 +41,11 @@ vec4 position(mat4 transform_projection, vec4 vertex_position) {
 	mat4 modelWorldMatrix;
 
 	// get the scale matrix, then the rotation matrix in XYZ order, then the translation matrix
-	if (isInstanced) {
-		modelWorldMatrix = mat4(instMatColumn1, instMatColumn2, instMatColumn3, instMatColumn4);
-	} else {
-		modelWorldMatrix = meshMatrix;
-	}
+#ifdef INSTANCED
+	modelWorldMatrix = mat4(instMatColumn1, instMatColumn2, instMatColumn3, instMatColumn4);
+#else
+	modelWorldMatrix = meshMatrix;
+#endif
 
 	mat4 cameraWorldMatrix = camMatrix;
 	mat4 viewMatrix = inverse(cameraWorldMatrix);